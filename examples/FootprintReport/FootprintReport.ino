@@ -0,0 +1,88 @@
+/**
+* LoLa Footprint Report
+*
+* Prints the RAM used by each LoLa class against its budget, and the linker sections.
+* Budgets are checked with static_assert in Diagnostics\LoLaFootprint.h, so a regression fails the build.
+*
+* Representative configurations, one build each, selected with LOLA_FOOTPRINT_CONFIGURATION:
+*	0 - Minimal, no encryption, no frequency hop.
+*	1 - Default, encryption only.
+*	2 - Encryption, frequency hop and channel scan.
+*	3 - Everything, adds FEC for surfaces and streams and low power listen.
+* FOOTPRINT_SURFACE_COUNT sets the surfaces, from 1 to 4.
+*
+* Both have defaults here, override them from the command line to build every configuration, e.g.:
+*	arduino-cli compile --fqbn stm32duino:STM32F1:genericSTM32F103C
+*		--build-property "build.extra_flags=-DLOLA_FOOTPRINT_CONFIGURATION=2 -DFOOTPRINT_SURFACE_COUNT=4" examples/FootprintReport
+* footprint_configurations.sh builds them all, each build runs the budget asserts.
+* Flash and RAM totals per configuration are in the build output.
+*
+*/
+
+#define SERIAL_BAUD_RATE 500000
+
+#ifndef LOLA_FOOTPRINT_CONFIGURATION
+#define LOLA_FOOTPRINT_CONFIGURATION 1
+#endif
+
+#ifndef FOOTPRINT_SURFACE_COUNT
+#define FOOTPRINT_SURFACE_COUNT 2
+#endif
+
+#define _TASK_OO_CALLBACKS
+#define _TASK_PRIORITY
+#include <TaskScheduler.h>
+
+#include <LoLaDriverSi446x.h>
+#include <LoLaManagerInclude.h>
+#include <Diagnostics\LoLaFootprint.h>
+#include "..\ExampleHost\ExampleControllerSurface.h"
+
+
+///Process scheduler.
+Scheduler SchedulerBase, SchedulerHighPriority;
+///
+
+///Radio manager and driver, host with surfaces.
+LoLaSi446xPacketDriver LoLaDriver(&SchedulerHighPriority);
+LoLaManagerHost LoLaManager(&SchedulerBase, &SchedulerHighPriority, &LoLaDriver);
+///
+
+///Surfaces.
+ControllerSurface Surfaces[FOOTPRINT_SURFACE_COUNT];
+SyncSurfaceReader<PACKET_DEFINITION_USER_HEADERS_START> Reader0(&SchedulerBase, &LoLaDriver, &Surfaces[0]);
+#if FOOTPRINT_SURFACE_COUNT > 1
+SyncSurfaceReader<PACKET_DEFINITION_USER_HEADERS_START + 2> Reader1(&SchedulerBase, &LoLaDriver, &Surfaces[1]);
+#endif
+#if FOOTPRINT_SURFACE_COUNT > 2
+SyncSurfaceReader<PACKET_DEFINITION_USER_HEADERS_START + 4> Reader2(&SchedulerBase, &LoLaDriver, &Surfaces[2]);
+#endif
+#if FOOTPRINT_SURFACE_COUNT > 3
+SyncSurfaceReader<PACKET_DEFINITION_USER_HEADERS_START + 6> Reader3(&SchedulerBase, &LoLaDriver, &Surfaces[3]);
+#endif
+///
+
+void setup()
+{
+	Serial.begin(SERIAL_BAUD_RATE);
+	while (!Serial)
+		;
+	delay(1000);
+	Serial.println(F("LoLa Footprint Report"));
+
+	LoLaFootprint::PrintConfiguration(&Serial);
+	Serial.print(F("Surfaces: "));
+	Serial.println(FOOTPRINT_SURFACE_COUNT);
+	Serial.println();
+
+	LoLaFootprint::PrintSizes(&Serial);
+	Serial.print(F("ControllerSurface: "));
+	Serial.println(sizeof(ControllerSurface));
+	Serial.println();
+
+	LoLaFootprint::PrintSections(&Serial);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Builds the FootprintReport for every configuration, the budget asserts run in each build.
+# Usage: examples/FootprintReport/footprint_configurations.sh [fqbn]
+
+FQBN=${1:-stm32duino:STM32F1:genericSTM32F103C}
+SKETCH=$(dirname "$0")
+
+for CONFIGURATION in 0 1 2 3; do
+	for SURFACES in 1 4; do
+		echo "Configuration ${CONFIGURATION}, ${SURFACES} surfaces."
+		arduino-cli compile --fqbn "${FQBN}" \
+			--build-property "build.extra_flags=-DLOLA_FOOTPRINT_CONFIGURATION=${CONFIGURATION} -DFOOTPRINT_SURFACE_COUNT=${SURFACES}" \
+			"${SKETCH}" || exit 1
+	done
+done
@@ -0,0 +1,193 @@
+// LoLaFootprint.h
+
+#ifndef _LOLA_FOOTPRINT_h
+#define _LOLA_FOOTPRINT_h
+
+#include <Stream.h>
+#include <LoLaDefinitions.h>
+#include <LoLaDriverSi446x.h>
+#include <LoLaManagerInclude.h>
+#include <Services\SyncSurface\SyncSurfaceReader.h>
+#include <Services\SyncSurface\SyncSurfaceWriter.h>
+
+//RAM budgets per class, in bytes. Override before including to tighten them for a project.
+//Ceilings, not targets. A failed assert means something grew, not that the build is broken.
+//Each budget is the class' member layout on STM32F1 (32 bit pointers, 4 byte alignment), plus LOLA_FOOTPRINT_MARGIN_PERCENT.
+//Layouts follow the configuration, so queue and map sizes scale the budgets with them.
+//Crypto and channel management members are always compiled in, encryption and frequency hop don't change the class sizes.
+#ifndef LOLA_FOOTPRINT_MARGIN_PERCENT
+#define LOLA_FOOTPRINT_MARGIN_PERCENT						30 //Layouts are estimated, not read from the map file.
+#endif
+
+#define LOLA_FOOTPRINT_WITH_MARGIN(bytes)					((((bytes) * (100 + LOLA_FOOTPRINT_MARGIN_PERCENT)) / 100))
+
+//Building blocks.
+#define LOLA_FOOTPRINT_TASK_BYTES							64 //TaskScheduler Task, with OO callbacks and priority.
+#define LOLA_FOOTPRINT_SERVICE_BYTES						(LOLA_FOOTPRINT_TASK_BYTES + 24) //ILoLaService and IPacketSendService.
+#define LOLA_FOOTPRINT_PACKET_BYTES(size)					((size) + 12) //Vtable, definition and payload size, then the data.
+#define LOLA_FOOTPRINT_PACKET_DEFINITION_BYTES				16
+
+#ifdef DEBUG_LOLA
+#define LOLA_FOOTPRINT_DEBUG_BYTES							32
+#else
+#define LOLA_FOOTPRINT_DEBUG_BYTES							0
+#endif
+
+//Ack and FEC definitions, then the header lookup with definition and owner service.
+#define LOLA_FOOTPRINT_PACKET_MAP_BYTES						(2 * LOLA_FOOTPRINT_PACKET_DEFINITION_BYTES + 8 + LOLA_PACKET_MAP_TOTAL_SIZE * (2 * sizeof(void*) + 1))
+
+#ifndef LOLA_FOOTPRINT_PACKET_MAP_MAX_BYTES
+#define LOLA_FOOTPRINT_PACKET_MAP_MAX_BYTES					LOLA_FOOTPRINT_WITH_MARGIN(LOLA_FOOTPRINT_PACKET_MAP_BYTES)
+#endif
+
+//Driver base: radio info, counters, synced clock (32) and crypto encoder (Ascon128, SHA256 and key holders, 256).
+//Packet driver: incoming, outgoing and queued frames, pending acks, FEC groups, slot tasks, urgent handlers,
+//services manager with link info (192) and the slot and radio state statistics (160).
+#define LOLA_FOOTPRINT_DRIVER_BYTES							(112 + 32 + 256 + LOLA_FOOTPRINT_PACKET_MAP_BYTES + \
+															(2 + LOLA_PACKET_DRIVER_TX_QUEUE_SIZE) * LOLA_FOOTPRINT_PACKET_BYTES(LOLA_PACKET_MAX_FRAME_SIZE) + \
+															(LOLA_PACKET_ACK_PENDING_QUEUE_SIZE + 1) * 8 + 8 + \
+															2 * (LOLA_PACKET_FEC_MAX_CONTENT_SIZE + 8) + 16 + \
+															2 * (LOLA_FOOTPRINT_TASK_BYTES + 16) + \
+															LOLA_PACKET_DRIVER_URGENT_HANDLERS_SIZE * (sizeof(void*) + 2) + 24 + \
+															MAX_RADIO_SERVICES_COUNT * sizeof(void*) + 192 + \
+															160 + LOLA_FOOTPRINT_DEBUG_BYTES)
+
+#ifndef LOLA_FOOTPRINT_DRIVER_MAX_BYTES
+#define LOLA_FOOTPRINT_DRIVER_MAX_BYTES						LOLA_FOOTPRINT_WITH_MARGIN(LOLA_FOOTPRINT_DRIVER_BYTES)
+#endif
+
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+#define LOLA_FOOTPRINT_SCAN_BYTES							(LOLA_LINK_SPECTRUM_SCANNER_MAX_CHANNELS + LOLA_LINK_RENDEZVOUS_SET_SIZE + 16)
+#else
+#define LOLA_FOOTPRINT_SCAN_BYTES							0
+#endif
+
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+#define LOLA_FOOTPRINT_LPL_BYTES							16
+#else
+#define LOLA_FOOTPRINT_LPL_BYTES							0
+#endif
+
+//Service and out packet, timed hopper with its schedule, power balancer (40), channel manager,
+//key exchanger and token source (148), then the host's clock sync and latency meter (64).
+#define LOLA_FOOTPRINT_LINK_SERVICE_BYTES					(LOLA_FOOTPRINT_SERVICE_BYTES + LOLA_FOOTPRINT_PACKET_BYTES(LOLA_LINK_SERVICE_PACKET_MAX_SIZE) + 24 + \
+															LOLA_FOOTPRINT_SERVICE_BYTES + LOLA_LINK_HOP_SCHEDULE_SIZE * 12 + 28 + \
+															40 + \
+															LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS * 3 + 48 + \
+															148 + \
+															64 + LOLA_LINK_SERVICE_UNLINK_MAX_LATENCY_SAMPLES * sizeof(uint16_t) + \
+															LOLA_FOOTPRINT_SCAN_BYTES + LOLA_FOOTPRINT_LPL_BYTES + LOLA_FOOTPRINT_DEBUG_BYTES)
+
+#ifndef LOLA_FOOTPRINT_LINK_SERVICE_MAX_BYTES
+#define LOLA_FOOTPRINT_LINK_SERVICE_MAX_BYTES				LOLA_FOOTPRINT_WITH_MARGIN(LOLA_FOOTPRINT_LINK_SERVICE_BYTES)
+#endif
+
+//Service, sync state, packet holder and both definitions.
+#define LOLA_FOOTPRINT_SURFACE_SERVICE_BYTES				(LOLA_FOOTPRINT_SERVICE_BYTES + 20 + \
+															LOLA_FOOTPRINT_PACKET_BYTES(LOLA_PACKET_MIN_PACKET_SIZE + PACKET_DEFINITION_SYNC_DATA_PAYLOAD_SIZE) + 12 + \
+															2 * LOLA_FOOTPRINT_PACKET_DEFINITION_BYTES)
+
+#ifndef LOLA_FOOTPRINT_SURFACE_SERVICE_MAX_BYTES
+#define LOLA_FOOTPRINT_SURFACE_SERVICE_MAX_BYTES			LOLA_FOOTPRINT_WITH_MARGIN(LOLA_FOOTPRINT_SURFACE_SERVICE_BYTES)
+#endif
+
+#define LOLA_FOOTPRINT_TEST_HEADER							(PACKET_DEFINITION_USER_HEADERS_START)
+
+static_assert(sizeof(LoLaPacketMap) <= LOLA_FOOTPRINT_PACKET_MAP_MAX_BYTES, "LoLaPacketMap over RAM budget.");
+static_assert(sizeof(LoLaSi446xPacketDriver) <= LOLA_FOOTPRINT_DRIVER_MAX_BYTES, "LoLaSi446xPacketDriver over RAM budget.");
+static_assert(sizeof(LoLaLinkHostService) <= LOLA_FOOTPRINT_LINK_SERVICE_MAX_BYTES, "LoLaLinkHostService over RAM budget.");
+static_assert(sizeof(LoLaLinkRemoteService) <= LOLA_FOOTPRINT_LINK_SERVICE_MAX_BYTES, "LoLaLinkRemoteService over RAM budget.");
+static_assert(sizeof(SyncSurfaceReader<LOLA_FOOTPRINT_TEST_HEADER>) <= LOLA_FOOTPRINT_SURFACE_SERVICE_MAX_BYTES, "SyncSurfaceReader over RAM budget.");
+static_assert(sizeof(SyncSurfaceWriter<LOLA_FOOTPRINT_TEST_HEADER>) <= LOLA_FOOTPRINT_SURFACE_SERVICE_MAX_BYTES, "SyncSurfaceWriter over RAM budget.");
+
+class LoLaFootprint
+{
+private:
+	static void PrintSize(Stream* serial, const __FlashStringHelper* name, const uint32_t size)
+	{
+		serial->print(name);
+		serial->print(F(": "));
+		serial->println(size);
+	}
+
+	static void PrintSize(Stream* serial, const __FlashStringHelper* name, const uint32_t size, const uint32_t budget)
+	{
+		serial->print(name);
+		serial->print(F(": "));
+		serial->print(size);
+		serial->print(F(" / "));
+		serial->println(budget);
+	}
+
+public:
+	static void PrintConfiguration(Stream* serial)
+	{
+#ifdef LOLA_FOOTPRINT_CONFIGURATION
+		serial->print(F("Configuration: "));
+		serial->println(LOLA_FOOTPRINT_CONFIGURATION);
+#endif
+		serial->print(F("Budget Margin: "));
+		serial->print(LOLA_FOOTPRINT_MARGIN_PERCENT);
+		serial->println('%');
+		serial->print(F("Encryption: "));
+#ifdef LOLA_LINK_USE_ENCRYPTION
+		serial->println(F("yes"));
+#else
+		serial->println(F("no"));
+#endif
+		serial->print(F("Frequency Hop: "));
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+		serial->println(F("yes"));
+#else
+		serial->println(F("no"));
+#endif
+		serial->print(F("Channel Scan: "));
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+		serial->println(F("yes"));
+#else
+		serial->println(F("no"));
+#endif
+		serial->print(F("Low Power Listen: "));
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+		serial->println(F("yes"));
+#else
+		serial->println(F("no"));
+#endif
+		serial->print(F("Packet Map Size: "));
+		serial->println(LOLA_PACKET_MAP_TOTAL_SIZE);
+		serial->print(F("Max Services: "));
+		serial->println(MAX_RADIO_SERVICES_COUNT);
+	}
+
+	//Per class RAM, against budget.
+	static void PrintSizes(Stream* serial)
+	{
+		PrintSize(serial, F("LoLaPacketMap"), sizeof(LoLaPacketMap), LOLA_FOOTPRINT_PACKET_MAP_MAX_BYTES);
+		PrintSize(serial, F("LoLaServicesManager"), sizeof(LoLaServicesManager));
+		PrintSize(serial, F("LoLaSi446xPacketDriver"), sizeof(LoLaSi446xPacketDriver), LOLA_FOOTPRINT_DRIVER_MAX_BYTES);
+		PrintSize(serial, F("LoLaLinkHostService"), sizeof(LoLaLinkHostService), LOLA_FOOTPRINT_LINK_SERVICE_MAX_BYTES);
+		PrintSize(serial, F("LoLaLinkRemoteService"), sizeof(LoLaLinkRemoteService), LOLA_FOOTPRINT_LINK_SERVICE_MAX_BYTES);
+		PrintSize(serial, F("LoLaCryptoEncoder"), sizeof(LoLaCryptoEncoder));
+		PrintSize(serial, F("LoLaCryptoKeyExchanger"), sizeof(LoLaCryptoKeyExchanger));
+		PrintSize(serial, F("SyncSurfaceReader"), sizeof(SyncSurfaceReader<LOLA_FOOTPRINT_TEST_HEADER>), LOLA_FOOTPRINT_SURFACE_SERVICE_MAX_BYTES);
+		PrintSize(serial, F("SyncSurfaceWriter"), sizeof(SyncSurfaceWriter<LOLA_FOOTPRINT_TEST_HEADER>), LOLA_FOOTPRINT_SURFACE_SERVICE_MAX_BYTES);
+	}
+
+	//Linker sections, where the core exposes them.
+	static void PrintSections(Stream* serial)
+	{
+#if defined(ARDUINO_ARCH_STM32F1)
+		extern char _etext, _sdata, _edata, __bss_start__, __bss_end__;
+
+		serial->print(F(".text end: 0x"));
+		serial->println((uint32_t)&_etext, HEX);
+		serial->print(F(".data: "));
+		serial->println((uint32_t)(&_edata - &_sdata));
+		serial->print(F(".bss: "));
+		serial->println((uint32_t)(&__bss_end__ - &__bss_start__));
+#else
+		serial->println(F("Sections: see the build output."));
+#endif
+	}
+};
+#endif
@@ -10,6 +10,7 @@
 #include <LoLaClock\ILoLaClockSource.h>
 #include <LoLaClock\RTCClockSource.h>
 #include <LoLaDefinitions.h>
+#include <PacketDriver\UrgentPacketDispatcher.h>
 
 class ILoLaDriver
 {
@@ -30,10 +31,14 @@ protected:
 	struct OutputInfoType
 	{
 		volatile uint32_t Micros = ILOLA_INVALID_MICROS;
+		volatile uint8_t Header = 0xff;
+		volatile uint8_t Id = 0;
 
 		void Clear()
 		{
 			Micros = ILOLA_INVALID_MICROS;
+			Header = 0xff;
+			Id = 0;
 		}
 	};
 
@@ -127,6 +132,8 @@ public:
 	void SetLinkStatus(const bool linked)
 	{
 		LinkActive = linked;
+
+		OnLinkStatusUpdated();
 	}
 
 	bool HasLink()
@@ -135,6 +142,31 @@ public:
 	}
 
 #ifdef LOLA_MOCK_PACKET_LOSS
+#ifdef LOLA_MOCK_PACKET_LOSS_BURST
+	bool MockBurstState = false;
+
+	//Gilbert-Elliott model, losses come in bursts while in the bad state.
+	bool GetLossChance()
+	{
+		if (MockBurstState)
+		{
+			MockBurstState = random(100) + 1 > MOCK_PACKET_LOSS_BURST_BAD_TO_GOOD;
+		}
+		else
+		{
+			MockBurstState = random(100) + 1 <= MOCK_PACKET_LOSS_BURST_GOOD_TO_BAD;
+		}
+
+		if (MockBurstState)
+		{
+			return random(100) + 1 > MOCK_PACKET_LOSS_BURST_BAD;
+		}
+		else
+		{
+			return random(100) + 1 > MOCK_PACKET_LOSS_BURST_GOOD;
+		}
+	}
+#else
 	bool GetLossChance()
 	{
 		if (LinkActive)
@@ -149,11 +181,33 @@ public:
 	}
 #endif
 
+#ifdef LOLA_MOCK_INTERFERENCE_CHANNEL_MASK
+	//Narrowband interference model, corrupts most packets on the jammed channels.
+	bool GetInterferenceChance()
+	{
+		return ((LOLA_MOCK_INTERFERENCE_CHANNEL_MASK >> (CurrentChannel - GetChannelMin())) & 1) &&
+			(random(100) + 1 <= MOCK_PACKET_LOSS_INTERFERENCE);
+	}
+#endif
+#endif
+
 	uint32_t GetETTMMicros()
 	{
 		return ETTM;
 	}
 
+	//From Transmit() to the last bit on air, for a frame of this size.
+	uint32_t GetAirtimeMicros(const uint8_t frameSize)
+	{
+		if (GetDataRateBitsPerSecond() == 0)
+		{
+			return ETTM;
+		}
+
+		return GetTransmitStartMicros() +
+			((((uint32_t)GetFrameOverheadBytes() + frameSize) * 8 * (uint32_t)1000000) / GetDataRateBitsPerSecond());
+	}
+
 	void SetETTM(const uint32_t ettmMicros)
 	{
 #ifdef LOLA_LINK_USE_LATENCY_COMPENSATION
@@ -196,7 +250,12 @@ public:
 
 	uint8_t GetRSSINormalized()
 	{
-		return (uint8_t)map(constrain(GetLastValidRSSI(), GetRSSIMin(), GetRSSIMax()),
+		return NormalizeRSSI(GetLastValidRSSI());
+	}
+
+	uint8_t NormalizeRSSI(const int16_t rssi)
+	{
+		return (uint8_t)map(constrain(rssi, GetRSSIMin(), GetRSSIMax()),
 			GetRSSIMin(), GetRSSIMax(),
 			0, UINT8_MAX);
 	}
@@ -260,6 +319,14 @@ public:
 		return LastValidSentInfo.Micros;
 	}
 
+	//Is the packet with this header and id the last one we got out.
+	bool IsLastValidSent(const uint8_t header, const uint8_t id)
+	{
+		return LastValidSentInfo.Micros != ILOLA_INVALID_MICROS &&
+			LastValidSentInfo.Header == header &&
+			LastValidSentInfo.Id == id;
+	}
+
 	int16_t GetLastValidRSSI()
 	{
 		return LastValidReceivedInfo.RSSI;
@@ -305,15 +372,43 @@ protected:
 	virtual int16_t GetRSSIMax() const { return 0; }
 	virtual int16_t GetRSSIMin() const { return ILOLA_DEFAULT_MIN_RSSI; }
 
+	//Approximate supply current per radio state, for energy estimates.
+	virtual uint32_t GetReceivingCurrentMicroAmps() const { return 0; }
+	virtual uint32_t GetTransmittingCurrentMicroAmps() const { return 0; }
+	virtual uint32_t GetSleepingCurrentMicroAmps() const { return 0; }
+
+	//Radio physical layer, for the airtime model. No data rate falls back to ETTM.
+	virtual uint32_t GetDataRateBitsPerSecond() const { return 0; }
+	//Preamble, sync word, length field and radio CRC.
+	virtual uint8_t GetFrameOverheadBytes() const { return 0; }
+	//From Transmit() to the first bit on air.
+	virtual uint32_t GetTransmitStartMicros() const { return 0; }
+
 public:
 	//Packet driver implementation.
 	virtual bool SendPacket(ILoLaPacket* packet) { return false; }
 	virtual bool Setup() { return true; }
 	virtual bool AllowedSend() { return false; }
+	//Checks if this packet's frame fits in what's left of the send slot.
+	virtual bool AllowedSend(const uint8_t packetSize) { return AllowedSend(); }
+	//Returns false if the driver doesn't publish send slot events.
+	virtual bool RequestSendSlotEvent() { return false; }
 	virtual void OnStart() {}
 	virtual void OnStop() {}
 	virtual void OnChannelUpdated() {}
 	virtual void OnTransmitPowerUpdated() {}
+	virtual void OnLinkStatusUpdated() {}
+
+	//Radio power, only while idle. Sending or restoring RX wakes it up too.
+	virtual bool SleepRadio() { return false; }
+	virtual void WakeRadio() {}
+
+	//Cut-through receive, the handler runs in the radio's callback.
+	virtual bool AddUrgentHandler(const uint8_t header, ILoLaUrgentHandler* handler) { return false; }
+
+	//Background channel sampling, split in two steps to let the RSSI settle.
+	virtual bool StartChannelSample(const uint8_t channel) { return false; }
+	virtual int16_t EndChannelSample() { return ILOLA_INVALID_RSSI; }
 
 	//Device driver implementation.
 	virtual uint8_t GetChannelMax() const { return 0; }
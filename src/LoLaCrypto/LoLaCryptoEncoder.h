@@ -42,6 +42,13 @@ private:
 
 	uint32_t TokenSeed = 0; //Last 4 bytes of key are used for token.
 
+	//Set while the cypher or keys are in use, the receive callback can't decode then.
+	volatile bool Busy = false;
+
+	//Helpers.
+	uint8_t HeaderHolder = 0;
+	uint16_t CRCHolder = 0;
+
 
 	///CRC validation.
 	FastCRC16 CRC16;
@@ -60,6 +67,11 @@ private:
 	}
 
 public:
+	inline bool IsBusy()
+	{
+		return Busy;
+	}
+
 	inline void ResetCypherBlock()
 	{
 		Cypher.setKey(KeyHolder, sizeof(KeyHolder));
@@ -70,18 +82,23 @@ public:
 	//Returns 8 bit MAC/CRC.
 	uint16_t Encode(uint8_t* message, const uint8_t messageLength)
 	{
+		Busy = true;
 		if (EncoderState == StageEnum::FullPower)
 		{
 			ResetCypherBlock();
 			Cypher.encrypt(message, message, messageLength);
 		}
 
-		return CRC16.modbus(message, messageLength);
+		CRCHolder = CRC16.modbus(message, messageLength);
+		Busy = false;
+
+		return CRCHolder;
 	}
 
 	//Returns 8 bit MAC/CRC.
 	uint16_t Encode(uint8_t* message, const uint8_t messageLength, uint8_t* outputMessage)
 	{
+		Busy = true;
 		if (EncoderState == StageEnum::FullPower)
 		{
 			ResetCypherBlock();
@@ -92,14 +109,19 @@ public:
 			memcpy(outputMessage, message, messageLength);
 		}
 
-		return CRC16.modbus(outputMessage, messageLength);
+		CRCHolder = CRC16.modbus(outputMessage, messageLength);
+		Busy = false;
+
+		return CRCHolder;
 	}
 
 	//Returns 8 bit MAC/CRC.
 	uint8_t Decode(uint8_t* message, const uint8_t messageLength, const uint16_t crc)
 	{
+		Busy = true;
 		if (crc != CRC16.modbus(message, messageLength))
 		{
+			Busy = false;
 			return false;
 		}
 
@@ -108,24 +130,46 @@ public:
 			ResetCypherBlock();
 			Cypher.decrypt(message, message, messageLength);
 		}
+		Busy = false;
 
 		return true;
 	}
 
+	//Header only, to choose a path before decoding the whole message.
+	uint8_t DecodeHeader(uint8_t* message)
+	{
+		if (EncoderState == StageEnum::FullPower)
+		{
+			Busy = true;
+			ResetCypherBlock();
+			Cypher.decrypt(&HeaderHolder, message, sizeof(uint8_t));
+			Busy = false;
+
+			return HeaderHolder;
+		}
+
+		return message[0];
+	}
+
 	void EncodeDirect(uint8_t* message, const uint8_t messageLength)
 	{
+		Busy = true;
 		ResetCypherBlock();
 		Cypher.encrypt(message, message, messageLength);
+		Busy = false;
 	}
 
 	void DecodeDirect(uint8_t* inputMessage, const uint8_t messageLength, uint8_t* outputMessage)
 	{
+		Busy = true;
 		ResetCypherBlock();
 		Cypher.decrypt(outputMessage, inputMessage, messageLength);
+		Busy = false;
 	}
 
 	void Clear()
 	{
+		Busy = true;
 		EncoderState = StageEnum::AllClear;
 
 		for (uint8_t i = 0; i < TokenSize; i++)
@@ -140,6 +184,7 @@ public:
 		}
 
 		TokenSeed = 0;
+		Busy = false;
 	}
 
 	bool SetEnabled()
@@ -169,6 +214,7 @@ public:
 			return false;
 		}
 
+		Busy = true;
 		Cypher.clear();
 
 		//HKey reduction, only use keySize bytes for key.
@@ -180,12 +226,14 @@ public:
 		//Test if key is accepted.
 		if (!Cypher.setKey(KeyHolder, KeySize))
 		{
+			Busy = false;
 			return false;
 		}
 
 		//Test setting IV.
 		if (!Cypher.setIV(IVHolder, KeySize))
 		{
+			Busy = false;
 			return false;
 		}
 
@@ -195,6 +243,7 @@ public:
 		ResetCypherBlock();
 
 		EncoderState = StageEnum::AllReady;
+		Busy = false;
 
 		return true;
 	}
@@ -220,6 +269,7 @@ public:
 	{
 		//Custom key expansion.
 		//TODO: Replace with RFC HKDF.
+		Busy = true;
 
 		//Id 1 with Session.
 		Hasher.clear();
@@ -268,6 +318,7 @@ public:
 		IVHolder[13] = ATUI.array[1];
 		IVHolder[14] = ATUI.array[2];
 		IVHolder[15] = ATUI.array[3];
+		Busy = false;
 	}
 
 	uint32_t GetSeed()
@@ -287,14 +338,31 @@ public:
 
 	void SetToken(const uint32_t token)
 	{
+		SetTokenHashed(HashToken(token));
+	}
+
+	//Slow, to be precomputed ahead of use.
+	uint32_t HashToken(const uint32_t token)
+	{
+		Hasher.clear();
 		ATUI.uint = token;
 		Hasher.update(ATUI.array, sizeof(uint32_t));
 		Hasher.finalize(ATUI.array, sizeof(uint32_t));
 
+		return ATUI.uint;
+	}
+
+	//Fast, no hashing.
+	void SetTokenHashed(const uint32_t hashedToken)
+	{
+		Busy = true;
+		ATUI.uint = hashedToken;
+
 		for (uint8_t i = 0; i < TokenSize; i++)
 		{
 			TokenHolder[i] = ATUI.array[i];
 		}
+		Busy = false;
 	}
 };
 #endif
\ No newline at end of file
@@ -32,7 +32,12 @@ public:
 
 	uint32_t GetToken(const uint32_t syncMillis)
 	{
-		return (syncMillis / TOTPPeriodMillis) ^ TOTPSeed;
+		return GetHopToken(syncMillis / TOTPPeriodMillis);
+	}
+
+	uint32_t GetHopToken(const uint32_t hopNumber)
+	{
+		return hopNumber ^ TOTPSeed;
 	}
 };
 #endif
\ No newline at end of file
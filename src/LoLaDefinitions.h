@@ -9,6 +9,8 @@
 
 //#define LOLA_MOCK_RADIO
 //#define LOLA_MOCK_PACKET_LOSS
+//#define LOLA_MOCK_INTERFERENCE_CHANNEL_MASK				((uint32_t)0x00000F00) //Jammed channels, requires LOLA_MOCK_PACKET_LOSS.
+//#define LOLA_MOCK_PACKET_LOSS_BURST						//Gilbert-Elliott burst loss, requires LOLA_MOCK_PACKET_LOSS.
 
 #define LOLA_LINK_USE_RTC_CLOCK_SOURCE
 #define LOLA_LINK_USE_LATENCY_COMPENSATION
@@ -21,9 +23,43 @@
 //#define LOLA_LINK_USE_TOKEN_HOP
 //#define LOLA_LINK_USE_FREQUENCY_HOP
 //#define DEBUG_LINK_FREQUENCY_HOP
+//#define LOLA_LINK_USE_CHANNEL_SCAN
+
+//#define LOLA_SYNC_SURFACE_USE_FEC
+//#define LOLA_STREAM_USE_FEC
+//#define LOLA_TRANSPORT_USE_FEC
+
+//FootprintReport build configurations, they replace the toggles above.
+//Selected by defining LOLA_FOOTPRINT_CONFIGURATION before including LoLa.
+#ifdef LOLA_FOOTPRINT_CONFIGURATION
+#undef LOLA_LINK_USE_ENCRYPTION
+#undef LOLA_LINK_USE_FREQUENCY_HOP
+#undef LOLA_LINK_USE_CHANNEL_SCAN
+#undef LOLA_SYNC_SURFACE_USE_FEC
+#undef LOLA_STREAM_USE_FEC
+#undef LOLA_TRANSPORT_USE_FEC
+#if (LOLA_FOOTPRINT_CONFIGURATION == 0) //Minimal.
+#elif (LOLA_FOOTPRINT_CONFIGURATION == 1) //Default, encryption only.
+#define LOLA_LINK_USE_ENCRYPTION
+#elif (LOLA_FOOTPRINT_CONFIGURATION == 2) //Frequency hop, with channel scan.
+#define LOLA_LINK_USE_ENCRYPTION
+#define LOLA_LINK_USE_FREQUENCY_HOP
+#define LOLA_LINK_USE_CHANNEL_SCAN
+#elif (LOLA_FOOTPRINT_CONFIGURATION == 3) //Everything.
+#define LOLA_LINK_USE_ENCRYPTION
+#define LOLA_LINK_USE_FREQUENCY_HOP
+#define LOLA_LINK_USE_CHANNEL_SCAN
+#define LOLA_SYNC_SURFACE_USE_FEC
+#define LOLA_STREAM_USE_FEC
+#define LOLA_TRANSPORT_USE_FEC
+#define LOLA_LINK_USE_LOW_POWER_LISTEN
+#else
+#error Unknown LOLA_FOOTPRINT_CONFIGURATION.
+#endif
+#endif
 
 
-#define LOLA_PACKET_MAP_TOTAL_SIZE							20 //255 //Reduce this to the highest header value in the mapping, to reduce memory usage.
+#define LOLA_PACKET_MAP_TOTAL_SIZE							20 //Max mapped definitions, headers can use the full 8-bit range.
 
 //Reserved [0;1] for Ack.
 #define PACKET_DEFINITION_ACK_HEADER						0x00
@@ -31,8 +67,11 @@
 //Reserved [1;5] for Link service.
 #define PACKET_DEFINITION_LINK_START_HEADER					(PACKET_DEFINITION_ACK_HEADER + 1)
 
+//Reserved [6] for FEC parity.
+#define PACKET_DEFINITION_FEC_HEADER						(PACKET_DEFINITION_LINK_START_HEADER + 5)
+
 //User services range start.
-#define PACKET_DEFINITION_USER_HEADERS_START				(PACKET_DEFINITION_LINK_START_HEADER + 5)
+#define PACKET_DEFINITION_USER_HEADERS_START				(PACKET_DEFINITION_FEC_HEADER + 1)
 
 #define LOLA_LINK_DEBUG_UPDATE_SECONDS						60
 
@@ -53,6 +92,28 @@
 #define LOLA_LINK_UNLINKED_BACK_OFF_DURATION_MILLIS			(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS/2)
 #define LOLA_LINK_LINKED_BACK_OFF_DURATION_MILLIS			(1) //Reduce congested duplex.
 
+//Linked frames queued behind the one on air, sent back-to-back while they fit in the slot.
+#define LOLA_PACKET_DRIVER_TX_QUEUE_SIZE					2
+#define LOLA_PACKET_DRIVER_INTER_FRAME_GAP_MICROS			(uint32_t)(300) //Partner's receive processing.
+
+//Urgent packets are decoded and handled in the receive callback, the rest goes async.
+#define LOLA_PACKET_DRIVER_URGENT_HANDLERS_SIZE				2
+#define LOLA_PACKET_DRIVER_URGENT_BUDGET_MICROS				(uint32_t)(150) //Read, decode and handler. Over it, the handler is demoted to the async path.
+
+// Piggybacked acks, only when linked.
+#define LOLA_PACKET_ACK_PENDING_QUEUE_SIZE					2
+#define LOLA_PACKET_ACK_PIGGYBACK_GRACE_MILLIS				(uint32_t)(2) //Wait for an outgoing packet, before sending a standalone ack.
+#define LOLA_PACKET_ACK_PIGGYBACK_MAX_AGE_MILLIS			(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS) //Sender has given up by then.
+
+// XOR parity over groups of FEC enabled packets, repairs one loss per group.
+#define LOLA_PACKET_FEC_GROUP_SIZE							(uint8_t)(4) //25% overhead.
+#define LOLA_PACKET_FEC_FLUSH_MILLIS						(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS) //Partial groups get their parity after this.
+
+// Linked low power, the radio sleeps through our own slot when there's nothing to send.
+//#define LOLA_LINK_USE_SLOT_SLEEP
+#define LOLA_RADIO_SLOT_SLEEP_MIN_MICROS					(uint32_t)(1000) //Not worth it for less.
+#define LOLA_RADIO_WAKE_UP_MARGIN_MICROS					(uint32_t)(500) //Back in RX before the partner's slot.
+
 #define LOLA_LINK_INFO_MAC_LENGTH							8 //Following MAC-64, because why not?
 
 #define RADIO_POWER_BALANCER_RSSI_SAMPLE_COUNT				3
@@ -67,9 +128,17 @@
 #define MOCK_PACKET_LOSS_SMOKE_SIGNALS						35
 #define MOCK_PACKET_LOSS_LINKING							MOCK_PACKET_LOSS_HARD
 #define MOCK_PACKET_LOSS_LINKED								MOCK_PACKET_LOSS_SOFT
+#define MOCK_PACKET_LOSS_INTERFERENCE						90
+
+//Gilbert-Elliott, transition and loss chances in %, per packet.
+#define MOCK_PACKET_LOSS_BURST_GOOD_TO_BAD					2
+#define MOCK_PACKET_LOSS_BURST_BAD_TO_GOOD					25
+#define MOCK_PACKET_LOSS_BURST_GOOD							1
+#define MOCK_PACKET_LOSS_BURST_BAD							60
 
 // How long to stay on a channel/token. TODO: Reduce when clocksync is better.
 #define LOLA_LINK_SERVICE_LINKED_TIMED_HOP_PERIOD_MILLIS	(uint32_t)(10000) 
+#define LOLA_LINK_HOP_SCHEDULE_SIZE							(uint8_t)(4) //Hops precomputed ahead.
 
 //Not linked.
 #define LOLA_LINK_SERVICE_UNLINK_MIN_LATENCY_SAMPLES		(uint8_t)(2)
@@ -90,6 +159,16 @@
 #define LOLA_LINK_SERVICE_UNLINK_SESSION_LIFETIME			(uint32_t)(LOLA_LINK_SERVICE_UNLINK_HOST_MAX_BEFORE_SLEEP/2)
 #define LOLA_LINK_SERVICE_UNLINK_KEY_PAIR_LIFETIME			(uint32_t)(60000) //Key pairs last 60 seconds.
 
+//Low power listening, the sleeping remote only listens for a short window each wake period.
+//The host fills the gaps between Id broadcasts with short wake beacons, in bursts that cover one wake period.
+//#define LOLA_LINK_USE_LOW_POWER_LISTEN
+#define LOLA_LINK_LPL_WAKE_PERIOD_MILLIS					(uint32_t)(250) //Worst case reconnect latency added.
+#define LOLA_LINK_LPL_BEACON_PERIOD_MILLIS					(uint32_t)(LOLA_LINK_UNLINKED_BACK_OFF_DURATION_MILLIS + 1)
+#define LOLA_LINK_LPL_LISTEN_MILLIS							(uint32_t)(LOLA_LINK_LPL_BEACON_PERIOD_MILLIS * 2) //At least one beacon in the window.
+#define LOLA_LINK_LPL_REMOTE_MAX_SLEEP_MILLIS				(uint32_t)(30000) //Then back to searching, in case the host is sleeping too.
+#define LOLA_LINK_LPL_BURST_MILLIS							(uint32_t)(LOLA_LINK_LPL_WAKE_PERIOD_MILLIS + LOLA_LINK_LPL_LISTEN_MILLIS) //Any window straddling the edges too.
+#define LOLA_LINK_LPL_BURST_PERIOD_MILLIS					(uint32_t)(LOLA_LINK_LPL_WAKE_PERIOD_MILLIS * 8) //Worst case reconnect latency for a sleeping remote.
+
 //Linked.
 #define LOLA_LINK_SERVICE_LINKED_MAX_BEFORE_DISCONNECT		(uint32_t)(3000)
 #define LOLA_LINK_SERVICE_LINKED_RESEND_PERIOD				(uint32_t)((ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*2)/3)
@@ -7,6 +7,7 @@
 #include <Callback.h>
 #include <RingBufCPP.h>
 #include <LoLaCrypto\PseudoMacGenerator.h>
+#include <LoLaLinkQualityEstimator.h>
 
 
 class LoLaLinkInfo
@@ -38,7 +39,10 @@ private:
 
 	RingBufCPP<uint8_t, RADIO_POWER_BALANCER_RSSI_SAMPLE_COUNT> PartnerRSSISamples;
 	uint32_t PartnerAverageRSSI = 0;
-	uint8_t PartnerReceivedCount = 0;
+	uint16_t PartnerReceivedCount = 0;
+
+	//Rate based link quality.
+	LoLaLinkQualityEstimator QualityEstimator;
 
 	//Link session information.
 	uint8_t SessionId = INVALID_SESSION;
@@ -178,6 +182,7 @@ public:
 		}
 
 		PartnerReceivedCount = 0;
+		QualityEstimator.Reset();
 
 		ClockSyncAdjustments = 0;
 
@@ -288,21 +293,49 @@ public:
 		PartnerRSSISamples.addForce(rssiNormalized);
 	}
 
-	uint8_t GetLostCount()
+	uint16_t GetLostCount()
 	{
-		return max(PartnerReceivedCount, (Driver->GetTransmitedCount() % UINT8_MAX)) - PartnerReceivedCount;
+		return max(PartnerReceivedCount, (uint16_t)Driver->GetTransmitedCount()) - PartnerReceivedCount;
 	}
 
-	uint8_t GetPartnerReceivedCount()
+	uint16_t GetPartnerReceivedCount()
 	{
 		return PartnerReceivedCount;
 	}
 
-	void SetPartnerReceivedCount(const uint8_t partnerReceivedCount)
+	void SetPartnerReceivedCount(const uint16_t partnerReceivedCount)
 	{
 		PartnerReceivedCount = partnerReceivedCount;
 	}
 
+	//Partner counters from the link report, low 16 bits.
+	void SetPartnerCounters(const uint16_t partnerReceivedCount, const uint16_t partnerTransmitedCount)
+	{
+		SetPartnerReceivedCount(partnerReceivedCount);
+
+		if (Driver != nullptr)
+		{
+			QualityEstimator.OnReportReceived(partnerReceivedCount, partnerTransmitedCount,
+				Driver->GetTransmitedCount(), Driver->GetReceivedCount());
+		}
+	}
+
+	//Karn's rule: only acks for our last send, answered in the partner's next slot, are round trip samples.
+	//Acks for older packets are ambiguous, acks held back longer are deferred, both are skipped.
+	void StampAckReceived(const uint8_t header, const uint8_t id)
+	{
+		if (Driver != nullptr && HasLink() &&
+			Driver->IsLastValidSent(header, id))
+		{
+			QualityEstimator.AddRTTSample(Driver->GetLastValidReceivedMicros() - Driver->GetLastValidSentMicros());
+		}
+	}
+
+	LoLaLinkQualityEstimator* GetQualityEstimator()
+	{
+		return &QualityEstimator;
+	}
+
 	//Output normalized to uint8_t range.
 	uint8_t GetRSSINormalized()
 	{
@@ -0,0 +1,276 @@
+// LoLaLinkQualityEstimator.h
+
+#ifndef _LOLA_LINK_QUALITY_ESTIMATOR_h
+#define _LOLA_LINK_QUALITY_ESTIMATOR_h
+
+#include <Arduino.h>
+#include <Callback.h>
+#include <RingBufCPP.h>
+#include <LoLaDefinitions.h>
+
+#define LOLA_LINK_QUALITY_WINDOW_SIZE					(uint8_t)(8) //Link reports kept in the sliding window.
+#define LOLA_LINK_QUALITY_MAX							(uint8_t)(UINT8_MAX)
+#define LOLA_LINK_QUALITY_DEFAULT_THRESHOLD				(uint8_t)(128)
+#define LOLA_LINK_QUALITY_THRESHOLD_HYSTERESIS			(uint8_t)(16)
+#define LOLA_LINK_QUALITY_DISCONNECT_LEVEL				(uint8_t)(32) //Quality considered as lost link, for prediction.
+#define LOLA_LINK_QUALITY_FILTER_SHIFT					(uint8_t)(2)
+#define LOLA_LINK_QUALITY_JITTER_FILTER_SHIFT			(uint8_t)(4) //Same gain as RFC 3550.
+#define LOLA_LINK_QUALITY_RTT_MAX_MICROS				(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS * (uint32_t)1000) //Past the partner's next slot, the ack was deferred.
+#define LOLA_LINK_QUALITY_ETX_MAX						(uint16_t)(UINT16_MAX)
+
+//Counters are exchanged as their low 16 bits (link report payload [1..4]), so up to UINT16_MAX packets between reports.
+class LoLaLinkQualityEstimator
+{
+private:
+	struct WindowSampleType
+	{
+		uint16_t Sent = 0;
+		uint16_t Delivered = 0;
+	};
+
+	//Per direction sliding windows.
+	RingBufCPP<WindowSampleType, LOLA_LINK_QUALITY_WINDOW_SIZE> OutboundWindow;
+	RingBufCPP<WindowSampleType, LOLA_LINK_QUALITY_WINDOW_SIZE> InboundWindow;
+
+	//Counter snapshots from the last report.
+	bool HasReference = false;
+	uint64_t LastTransmitedCount = 0;
+	uint64_t LastReceivedCount = 0;
+	uint16_t LastPartnerReceivedCount = 0;
+	uint16_t LastPartnerTransmitedCount = 0;
+
+	//Cached results, updated on each report.
+	uint8_t OutboundRatio = LOLA_LINK_QUALITY_MAX;
+	uint8_t InboundRatio = LOLA_LINK_QUALITY_MAX;
+	uint8_t Quality = LOLA_LINK_QUALITY_MAX;
+	uint16_t ETX = 100;
+
+	//Trend, for disconnect prediction.
+	int16_t QualitySlope = 0;
+	uint32_t LastReportMillis = ILOLA_INVALID_MILLIS;
+	uint32_t ReportPeriodMillis = 0;
+
+	//RTT tracking, in micros.
+	uint32_t LastRTT = 0;
+	uint32_t RTTJitter = 0;
+	bool HasRTT = false;
+
+	//Threshold alarm.
+	uint8_t Threshold = LOLA_LINK_QUALITY_DEFAULT_THRESHOLD;
+	bool BelowThreshold = false;
+	Signal<const bool> ThresholdCrossed;
+
+	//Helpers.
+	WindowSampleType Sample;
+	uint16_t Lost = 0;
+
+public:
+	LoLaLinkQualityEstimator() {}
+
+	void Reset()
+	{
+		while (!OutboundWindow.isEmpty())
+		{
+			OutboundWindow.pull();
+		}
+
+		while (!InboundWindow.isEmpty())
+		{
+			InboundWindow.pull();
+		}
+
+		HasReference = false;
+		OutboundRatio = LOLA_LINK_QUALITY_MAX;
+		InboundRatio = LOLA_LINK_QUALITY_MAX;
+		Quality = LOLA_LINK_QUALITY_MAX;
+		ETX = 100;
+		QualitySlope = 0;
+		LastReportMillis = ILOLA_INVALID_MILLIS;
+		ReportPeriodMillis = 0;
+		LastRTT = 0;
+		RTTJitter = 0;
+		HasRTT = false;
+		BelowThreshold = false;
+	}
+
+	//Fires true when quality drops below the threshold, false when it recovers.
+	void AttachOnThresholdCrossed(const Slot<const bool>& slot)
+	{
+		ThresholdCrossed.attach(slot);
+	}
+
+	void SetThreshold(const uint8_t threshold)
+	{
+		Threshold = threshold;
+	}
+
+	//Called on every partner link report, with our local counters at that moment.
+	void OnReportReceived(const uint16_t partnerReceivedCount, const uint16_t partnerTransmitedCount,
+		const uint64_t transmitedCount, const uint64_t receivedCount)
+	{
+		if (HasReference)
+		{
+			//Outbound: we know exactly how many we sent, the partner tells us how many got there.
+			//Snapshots are taken at different times, a partner count ahead of ours is no loss.
+			Sample.Sent = min((uint64_t)UINT16_MAX, transmitedCount - LastTransmitedCount);
+			Lost = GetClampedLoss(Sample.Sent, GetModDelta(partnerReceivedCount, LastPartnerReceivedCount));
+			Sample.Delivered = Sample.Sent - Lost;
+			OutboundWindow.addForce(Sample);
+
+			//Inbound: we know exactly how many we got, the partner tells us how many were sent.
+			Sample.Delivered = min((uint64_t)UINT16_MAX, receivedCount - LastReceivedCount);
+			Lost = GetClampedLoss(GetModDelta(partnerTransmitedCount, LastPartnerTransmitedCount), Sample.Delivered);
+			Sample.Sent = Sample.Delivered + Lost;
+			InboundWindow.addForce(Sample);
+
+			if (LastReportMillis != ILOLA_INVALID_MILLIS)
+			{
+				ReportPeriodMillis = millis() - LastReportMillis;
+			}
+
+			UpdateEstimates();
+		}
+
+		HasReference = true;
+		LastReportMillis = millis();
+		LastTransmitedCount = transmitedCount;
+		LastReceivedCount = receivedCount;
+		LastPartnerReceivedCount = partnerReceivedCount;
+		LastPartnerTransmitedCount = partnerTransmitedCount;
+	}
+
+	void AddRTTSample(const uint32_t rttMicros)
+	{
+		if (rttMicros > LOLA_LINK_QUALITY_RTT_MAX_MICROS)
+		{
+			return;
+		}
+
+		if (HasRTT)
+		{
+			RTTJitter = RTTJitter - (RTTJitter >> LOLA_LINK_QUALITY_JITTER_FILTER_SHIFT)
+				+ ((uint32_t)abs((int32_t)(rttMicros - LastRTT)) >> LOLA_LINK_QUALITY_JITTER_FILTER_SHIFT);
+		}
+
+		LastRTT = rttMicros;
+		HasRTT = true;
+	}
+
+	///Polled API, all cheap getters.
+	uint8_t GetOutboundDeliveryRatio()
+	{
+		return OutboundRatio;
+	}
+
+	uint8_t GetInboundDeliveryRatio()
+	{
+		return InboundRatio;
+	}
+
+	//Combined bidirectional delivery, from 0 to UINT8_MAX.
+	uint8_t GetQuality()
+	{
+		return Quality;
+	}
+
+	//Expected transmissions per delivered and acked packet, x100.
+	uint16_t GetETX()
+	{
+		return ETX;
+	}
+
+	uint32_t GetRTTJitterMicros()
+	{
+		return RTTJitter;
+	}
+
+	uint32_t GetLastRTTMicros()
+	{
+		return LastRTT;
+	}
+
+	//ILOLA_INVALID_MILLIS if the link isn't degrading.
+	uint32_t GetTimeToDisconnectMillis()
+	{
+		if (QualitySlope >= 0 || ReportPeriodMillis == 0)
+		{
+			return ILOLA_INVALID_MILLIS;
+		}
+
+		if (Quality <= LOLA_LINK_QUALITY_DISCONNECT_LEVEL)
+		{
+			return 0;
+		}
+
+		return ((uint32_t)(Quality - LOLA_LINK_QUALITY_DISCONNECT_LEVEL) * ReportPeriodMillis) / (uint32_t)(-QualitySlope);
+	}
+	///
+
+private:
+	inline uint16_t GetModDelta(const uint16_t current, const uint16_t previous)
+	{
+		return (uint16_t)(current - previous);
+	}
+
+	inline uint16_t GetClampedLoss(const uint16_t sent, const uint16_t delivered)
+	{
+		if (delivered >= sent)
+		{
+			return 0;
+		}
+
+		return sent - delivered;
+	}
+
+	uint8_t GetWindowRatio(RingBufCPP<WindowSampleType, LOLA_LINK_QUALITY_WINDOW_SIZE>* window)
+	{
+		uint32_t sent = 0;
+		uint32_t delivered = 0;
+
+		for (uint8_t i = 0; i < window->numElements(); i++)
+		{
+			sent += window->peek(i)->Sent;
+			delivered += window->peek(i)->Delivered;
+		}
+
+		if (sent == 0)
+		{
+			return LOLA_LINK_QUALITY_MAX;
+		}
+
+		return (uint8_t)((delivered * LOLA_LINK_QUALITY_MAX) / sent);
+	}
+
+	void UpdateEstimates()
+	{
+		uint8_t previousQuality = Quality;
+
+		OutboundRatio = GetWindowRatio(&OutboundWindow);
+		InboundRatio = GetWindowRatio(&InboundWindow);
+		Quality = (uint8_t)(((uint16_t)OutboundRatio * InboundRatio) / LOLA_LINK_QUALITY_MAX);
+
+		if (Quality == 0)
+		{
+			ETX = LOLA_LINK_QUALITY_ETX_MAX;
+		}
+		else
+		{
+			ETX = (uint16_t)min((uint32_t)LOLA_LINK_QUALITY_ETX_MAX, ((uint32_t)100 * LOLA_LINK_QUALITY_MAX) / Quality);
+		}
+
+		QualitySlope = QualitySlope - (QualitySlope >> LOLA_LINK_QUALITY_FILTER_SHIFT)
+			+ (((int16_t)Quality - previousQuality) >> LOLA_LINK_QUALITY_FILTER_SHIFT);
+
+		if (!BelowThreshold && Quality < Threshold)
+		{
+			BelowThreshold = true;
+			ThresholdCrossed.fire(true);
+		}
+		else if (BelowThreshold && Quality >= min((uint16_t)LOLA_LINK_QUALITY_MAX, (uint16_t)(Threshold + LOLA_LINK_QUALITY_THRESHOLD_HYSTERESIS)))
+		{
+			BelowThreshold = false;
+			ThresholdCrossed.fire(false);
+		}
+	}
+};
+#endif
@@ -11,6 +11,9 @@ class ILoLaPacket
 private:
 	PacketDefinition * Definition = nullptr;
 
+	//Actual payload size, below the definition's for variable size packets.
+	uint8_t PayloadSize = 0;
+
 
 	union ArrayToUint16 {
 		byte array[sizeof(uint16_t)];
@@ -67,12 +70,56 @@ public:
 		if (definition != nullptr)
 		{
 			GetRaw()[LOLA_PACKET_HEADER_INDEX] = definition->GetHeader();
+			PayloadSize = definition->GetPayloadSize();
 		}
 		Definition = definition;
 
 		return Definition != nullptr;
 	}
 
+	//Only variable size packets can shrink, up to the definition's payload size.
+	bool SetPayloadSize(const uint8_t payloadSize)
+	{
+		if (Definition == nullptr ||
+			!Definition->HasVariableSize() ||
+			payloadSize > Definition->GetPayloadSize())
+		{
+			return false;
+		}
+
+		PayloadSize = payloadSize;
+
+		return true;
+	}
+
+	//Payload size from the received frame size, validated against the definition.
+	bool SetReceivedSize(const uint8_t frameSize)
+	{
+		if (Definition == nullptr ||
+			!Definition->HasVariableSize())
+		{
+			return true;
+		}
+
+		return frameSize >= LOLA_PACKET_MIN_PACKET_SIZE &&
+			SetPayloadSize(frameSize - LOLA_PACKET_MIN_PACKET_SIZE);
+	}
+
+	uint8_t GetPayloadSize()
+	{
+		return PayloadSize;
+	}
+
+	uint8_t GetTotalSize()
+	{
+		return LOLA_PACKET_MIN_PACKET_SIZE + PayloadSize;
+	}
+
+	uint8_t GetContentSize()
+	{
+		return GetTotalSize() - LOLA_PACKET_HEADER_INDEX;
+	}
+
 	uint8_t* GetPayload()
 	{
 		return &GetRaw()[LOLA_PACKET_PAYLOAD_INDEX];
@@ -0,0 +1,223 @@
+// LoLaPacketFec.h
+
+#ifndef _LOLA_PACKET_FEC_h
+#define _LOLA_PACKET_FEC_h
+
+#include <Packet\LoLaPacket.h>
+
+//XOR parity over a group of FEC enabled packets.
+//A single loss per group is repaired at the receiver, without a round trip.
+class LoLaPacketFec
+{
+private:
+	struct FecGroupType
+	{
+		uint8_t Xor[LOLA_PACKET_FEC_MAX_CONTENT_SIZE];
+		uint8_t SizeXor = 0;
+		uint8_t Count = 0;
+		uint8_t Tag = 0;
+		uint32_t StartMillis = 0;
+	};
+
+	FecGroupType TransmitGroup;
+	FecGroupType ReceiveGroup;
+
+	//Statistics, for residual loss against overhead.
+	uint32_t ParitySentCount = 0;
+	uint32_t ParityReceivedCount = 0;
+	uint32_t RecoveredCount = 0;
+	uint32_t UnrecoverableCount = 0;
+
+public:
+	LoLaPacketFec() {}
+
+	void Reset()
+	{
+		ClearGroup(&TransmitGroup);
+		ClearGroup(&ReceiveGroup);
+	}
+
+	///Sender.
+	uint8_t GetTransmitTag()
+	{
+		return TransmitGroup.Tag;
+	}
+
+	uint8_t GetTransmitGroupCount()
+	{
+		return TransmitGroup.Count;
+	}
+
+	bool HasTransmitGroup()
+	{
+		return TransmitGroup.Count > 0;
+	}
+
+	//Full groups hold back further FEC packets until the parity is out.
+	bool IsTransmitGroupFull()
+	{
+		return TransmitGroup.Count >= LOLA_PACKET_FEC_GROUP_SIZE;
+	}
+
+	bool IsParityDue()
+	{
+		return IsTransmitGroupFull() ||
+			(HasTransmitGroup() && (millis() - TransmitGroup.StartMillis >= LOLA_PACKET_FEC_FLUSH_MILLIS));
+	}
+
+	//Only meaningful with a transmit group, 0 if already due.
+	uint32_t GetMillisUntilParityDue()
+	{
+		if (IsParityDue())
+		{
+			return 0;
+		}
+
+		return LOLA_PACKET_FEC_FLUSH_MILLIS - (millis() - TransmitGroup.StartMillis);
+	}
+
+	//Content is [HEADER|ID|PAYLOAD|FECGROUP], in plain text.
+	void AddSent(uint8_t* content, const uint8_t contentSize)
+	{
+		if (TransmitGroup.Count == 0)
+		{
+			TransmitGroup.StartMillis = millis();
+		}
+
+		AddToGroup(&TransmitGroup, content, contentSize);
+	}
+
+	void PrepareParity(ILoLaPacket* packet, PacketDefinition* parityDefinition)
+	{
+		packet->SetDefinition(parityDefinition);
+		packet->SetId(TransmitGroup.Tag);
+		packet->GetPayload()[0] = TransmitGroup.Count;
+		packet->GetPayload()[1] = TransmitGroup.SizeXor;
+		memcpy(&packet->GetPayload()[2], TransmitGroup.Xor, LOLA_PACKET_FEC_MAX_CONTENT_SIZE);
+	}
+
+	void OnParitySent()
+	{
+		ParitySentCount++;
+		ClearGroup(&TransmitGroup);
+		TransmitGroup.Tag++;
+	}
+	///
+
+	///Receiver.
+	void AddReceived(uint8_t* content, const uint8_t contentSize)
+	{
+		if (ReceiveGroup.Count == 0 ||
+			ReceiveGroup.Tag != content[contentSize - LOLA_PACKET_FEC_TAG_SIZE])
+		{
+			//New group, whatever was left of the last one is lost.
+			ClearGroup(&ReceiveGroup);
+			ReceiveGroup.Tag = content[contentSize - LOLA_PACKET_FEC_TAG_SIZE];
+		}
+
+		AddToGroup(&ReceiveGroup, content, contentSize);
+	}
+
+	//Returns true if a missing packet was rebuilt, available in GetRecovered().
+	bool OnParityReceived(const uint8_t tag, uint8_t* payload)
+	{
+		ParityReceivedCount++;
+
+		if (ReceiveGroup.Count > 0 && ReceiveGroup.Tag != tag)
+		{
+			ClearGroup(&ReceiveGroup);
+		}
+
+		if (ReceiveGroup.Count + 1 == payload[0])
+		{
+			for (uint8_t i = 0; i < LOLA_PACKET_FEC_MAX_CONTENT_SIZE; i++)
+			{
+				ReceiveGroup.Xor[i] ^= payload[2 + i];
+			}
+			ReceiveGroup.SizeXor ^= payload[1];
+
+			//Group is consumed, the buffer holds the recovered content until the next packet.
+			ReceiveGroup.Count = 0;
+
+			if (ReceiveGroup.SizeXor > LOLA_PACKET_FEC_MAX_CONTENT_SIZE ||
+				ReceiveGroup.SizeXor < PacketDefinition::GetContentSizeQuick(LOLA_PACKET_MIN_PACKET_SIZE + LOLA_PACKET_FEC_TAG_SIZE))
+			{
+				UnrecoverableCount++;
+				return false;
+			}
+
+			RecoveredCount++;
+			return true;
+		}
+		else if (ReceiveGroup.Count + 1 < payload[0])
+		{
+			UnrecoverableCount++;
+		}
+
+		ReceiveGroup.Count = 0;
+
+		return false;
+	}
+
+	uint8_t* GetRecovered()
+	{
+		return ReceiveGroup.Xor;
+	}
+
+	uint8_t GetRecoveredSize()
+	{
+		return ReceiveGroup.SizeXor;
+	}
+	///
+
+	uint32_t GetParitySentCount()
+	{
+		return ParitySentCount;
+	}
+
+	uint32_t GetRecoveredCount()
+	{
+		return RecoveredCount;
+	}
+
+	uint32_t GetUnrecoverableCount()
+	{
+		return UnrecoverableCount;
+	}
+
+#ifdef DEBUG_LOLA
+	void Debug(Stream* serial)
+	{
+		serial->print(F("FEC parity sent: "));
+		serial->println(ParitySentCount);
+		serial->print(F("FEC parity received: "));
+		serial->println(ParityReceivedCount);
+		serial->print(F("FEC recovered: "));
+		serial->println(RecoveredCount);
+		serial->print(F("FEC unrecoverable: "));
+		serial->println(UnrecoverableCount);
+	}
+#endif
+
+private:
+	void ClearGroup(FecGroupType* group)
+	{
+		for (uint8_t i = 0; i < LOLA_PACKET_FEC_MAX_CONTENT_SIZE; i++)
+		{
+			group->Xor[i] = 0;
+		}
+		group->SizeXor = 0;
+		group->Count = 0;
+	}
+
+	void AddToGroup(FecGroupType* group, uint8_t* content, const uint8_t contentSize)
+	{
+		for (uint8_t i = 0; i < min(contentSize, LOLA_PACKET_FEC_MAX_CONTENT_SIZE); i++)
+		{
+			group->Xor[i] ^= content[i];
+		}
+		group->SizeXor ^= contentSize;
+		group->Count++;
+	}
+};
+#endif
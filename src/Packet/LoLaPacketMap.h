@@ -6,6 +6,7 @@
 #include <Packet\PacketDefinition.h>
 #include <LoLaDefinitions.h>
 
+class ILoLaService;
 
 
 class AckPacketDefinition : public PacketDefinition
@@ -24,41 +25,109 @@ public:
 #endif
 };
 
+class FecParityPacketDefinition : public PacketDefinition
+{
+public:
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+	const uint8_t GetHeader() { return PACKET_DEFINITION_FEC_HEADER; }
+	const uint8_t GetPayloadSize() { return LOLA_PACKET_FEC_PARITY_PAYLOAD_SIZE; }
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("FecParity\t"));
+	}
+#endif
+};
+
+//Sorted by header, so RAM scales with the mapped definitions and not with the highest header.
 class LoLaPacketMap
 {
 private:
 	AckPacketDefinition DefinitionACK;
+	FecParityPacketDefinition DefinitionFEC;
 protected:
 	uint8_t MappingSize = 0;
+	uint8_t Headers[LOLA_PACKET_MAP_TOTAL_SIZE];
 	PacketDefinition* Mapping[LOLA_PACKET_MAP_TOTAL_SIZE];
 
+	//Service that added each mapping, for direct dispatch by header.
+	ILoLaService* Owners[LOLA_PACKET_MAP_TOTAL_SIZE];
+	ILoLaService* MappingOwner = nullptr;
+
+private:
+	//Index of the first mapping with header >= the searched header.
+	//No helper members, lookups may come from the receive interrupt.
+	uint8_t LowerBound(const uint8_t header)
+	{
+		uint8_t low = 0;
+		uint8_t high = MappingSize;
+		uint8_t middle;
+
+		while (low < high)
+		{
+			middle = (low + high) >> 1;
+			if (Headers[middle] < header)
+			{
+				low = middle + 1;
+			}
+			else
+			{
+				high = middle;
+			}
+		}
+
+		return low;
+	}
+
 public:
 	PacketDefinition * GetAck() { return &DefinitionACK; }
 
 	bool AddMapping(PacketDefinition* packetDefinition)
 	{
-		if (MappingSize >= LOLA_PACKET_MAP_TOTAL_SIZE || Mapping[packetDefinition->GetHeader()] != nullptr)
+		if (MappingSize >= LOLA_PACKET_MAP_TOTAL_SIZE ||
+			(packetDefinition->HasFEC() && packetDefinition->HasVariableSize()) ||
+			(packetDefinition->HasFEC() && PacketDefinition::GetContentSizeQuick(packetDefinition->GetFrameSize()) > LOLA_PACKET_FEC_MAX_CONTENT_SIZE))
 		{
 			return false;
 		}
-		else
+
+		const uint8_t header = packetDefinition->GetHeader();
+		const uint8_t index = LowerBound(header);
+
+		if (index < MappingSize && Headers[index] == header)
+		{
+			return false;
+		}
+
+		//Insertion only happens on setup, keep the arrays sorted.
+		for (uint8_t i = MappingSize; i > index; i--)
 		{
-			Mapping[packetDefinition->GetHeader()] = packetDefinition;
-			MappingSize++;
-			return true;
+			Headers[i] = Headers[i - 1];
+			Mapping[i] = Mapping[i - 1];
+			Owners[i] = Owners[i - 1];
 		}
+		Headers[index] = header;
+		Mapping[index] = packetDefinition;
+		Owners[index] = MappingOwner;
+		MappingSize++;
+
+		return true;
 	}
 
 	void ClearMapping()
 	{
 		for (uint8_t i = 0; i < LOLA_PACKET_MAP_TOTAL_SIZE; i++)
 		{
+			Headers[i] = 0;
 			Mapping[i] = nullptr;
+			Owners[i] = nullptr;
 		}
 		MappingSize = 0;
+		MappingOwner = nullptr;
 
 		//Add base mappings.
 		AddMapping(&DefinitionACK);
+		AddMapping(&DefinitionFEC);
 	}
 
 	LoLaPacketMap()
@@ -66,14 +135,36 @@ public:
 		ClearMapping();
 	}
 
+	//Binary search, log2(mappings) header compares.
 	PacketDefinition* GetDefinition(const uint8_t header)
 	{
-		if (header >= LOLA_PACKET_MAP_TOTAL_SIZE)
+		const uint8_t index = LowerBound(header);
+
+		if (index < MappingSize && Headers[index] == header)
 		{
-			return nullptr;
+			return Mapping[index];
 		}
 
-		return Mapping[header];
+		return nullptr;
+	}
+
+	//Mappings added from now on belong to this service, nullptr for none.
+	void SetMappingOwner(ILoLaService* owner)
+	{
+		MappingOwner = owner;
+	}
+
+	//Same search as GetDefinition, nullptr for driver owned or unknown headers.
+	ILoLaService* GetOwner(const uint8_t header)
+	{
+		const uint8_t index = LowerBound(header);
+
+		if (index < MappingSize && Headers[index] == header)
+		{
+			return Owners[index];
+		}
+
+		return nullptr;
 	}
 
 	uint8_t GetSize()
@@ -85,27 +176,24 @@ public:
 	void Debug(Stream* serial)
 	{
 		serial->print(F("Packet map memory space: "));
-		serial->print(LOLA_PACKET_MAP_TOTAL_SIZE * sizeof(PacketDefinition*));
+		serial->print(LOLA_PACKET_MAP_TOTAL_SIZE * (sizeof(PacketDefinition*) + sizeof(ILoLaService*) + sizeof(uint8_t)));
 		serial->println(F(" bytes."));
 
 
 		serial->print(F("Packet map memory actual usage: "));
-		serial->print(GetSize() * sizeof(PacketDefinition*));
+		serial->print(GetSize() * (sizeof(PacketDefinition*) + sizeof(ILoLaService*) + sizeof(uint8_t)));
 		serial->println(F(" bytes."));
 
 		serial->print(F("Packet mappings: "));
 		serial->println(GetSize());
 
-		for (uint8_t i = 0; i < LOLA_PACKET_MAP_TOTAL_SIZE; i++)
+		for (uint8_t i = 0; i < GetSize(); i++)
 		{
-			if (Mapping[i] != nullptr)
-			{
-				serial->print(' ');
-				serial->print(i, HEX);
-				serial->print(F(": "));
-				Mapping[i]->Debug(serial);
-				serial->println();
-			}
+			serial->print(' ');
+			serial->print(Headers[i], HEX);
+			serial->print(F(": "));
+			Mapping[i]->Debug(serial);
+			serial->println();
 		}
 	}
 #endif
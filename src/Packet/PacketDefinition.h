@@ -11,8 +11,9 @@
 #define PACKET_DEFINITION_MASK_CUSTOM_5			B00000001
 #define PACKET_DEFINITION_MASK_CUSTOM_4			B00000010
 #define PACKET_DEFINITION_MASK_CUSTOM_3			B00000100
-#define PACKET_DEFINITION_MASK_CUSTOM_2			B00001000
-#define PACKET_DEFINITION_MASK_CUSTOM_1			B00010000
+#define PACKET_DEFINITION_MASK_URGENT			B00001000
+#define PACKET_DEFINITION_MASK_VARIABLE_SIZE	B00010000
+#define PACKET_DEFINITION_MASK_FEC				B00100000
 #define PACKET_DEFINITION_MASK_IS_ACK			B01000000
 #define PACKET_DEFINITION_MASK_HAS_ACK			B10000000
 #define PACKET_DEFINITION_MASK_BASIC			B00000000
@@ -29,11 +30,25 @@
 
 #define LOLA_PACKET_MAX_PACKET_SIZE				22 + LOLA_PACKET_MIN_PACKET_SIZE
 
+// Piggybacked ack, appended to any non-ack packet: [PACKET|ACKHEADER|ACKID]
+#define LOLA_PACKET_ACK_TAIL_SIZE				(2)
+#define LOLA_PACKET_MAX_FRAME_SIZE				(LOLA_PACKET_MAX_PACKET_SIZE + LOLA_PACKET_ACK_TAIL_SIZE)
+
+// FEC enabled packet: [PACKET|FECGROUP]
+// Parity: [MACCRC1|MACCRC2|HEADER|FECGROUP as ID|COUNT|SIZEXOR|XOR...], XOR covers [HEADER|ID|PAYLOAD|FECGROUP].
+#define LOLA_PACKET_FEC_TAG_SIZE				(1)
+#define LOLA_PACKET_FEC_MAX_CONTENT_SIZE		(uint8_t)(LOLA_PACKET_MAX_PACKET_SIZE - LOLA_PACKET_MIN_PACKET_SIZE - 2)
+#define LOLA_PACKET_FEC_PARITY_PAYLOAD_SIZE		(uint8_t)(LOLA_PACKET_FEC_MAX_CONTENT_SIZE + 2)
+
+// Variable size packet: [MACCRC1|MACCRC2|HEADER|ID|PAYLOAD(0..Max)], size from the received frame.
+// No FEC tag or piggybacked ack, they would make the frame size ambiguous.
+
 class PacketDefinition
 {
 public:
 	virtual const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
 	virtual const uint8_t GetHeader() { return 0; }
+	//Max payload size, for variable size packets.
 	virtual const uint8_t GetPayloadSize() { return 0; }
 
 #ifdef DEBUG_LOLA
@@ -71,6 +86,33 @@ public:
 		return GetConfiguration() & PACKET_DEFINITION_MASK_HAS_ACK;
 	}
 
+	const bool HasFEC()
+	{
+		return GetConfiguration() & PACKET_DEFINITION_MASK_FEC;
+	}
+
+	const bool HasVariableSize()
+	{
+		return GetConfiguration() & PACKET_DEFINITION_MASK_VARIABLE_SIZE;
+	}
+
+	//Handled straight from the receive callback, see UrgentPacketDispatcher.
+	const bool IsUrgent()
+	{
+		return GetConfiguration() & PACKET_DEFINITION_MASK_URGENT;
+	}
+
+	//On air size, with the FEC group tag.
+	const uint8_t GetFrameSize()
+	{
+		if (HasFEC())
+		{
+			return GetTotalSize() + LOLA_PACKET_FEC_TAG_SIZE;
+		}
+
+		return GetTotalSize();
+	}
+
 #ifdef DEBUG_LOLA
 	void Debug(Stream* serial)
 	{
@@ -87,6 +129,21 @@ public:
 		{
 			serial->print(F("ACK|"));
 		}
+
+		if (HasFEC())
+		{
+			serial->print(F("FEC|"));
+		}
+
+		if (HasVariableSize())
+		{
+			serial->print(F("VAR|"));
+		}
+
+		if (IsUrgent())
+		{
+			serial->print(F("URG|"));
+		}
 	}
 #endif
 };
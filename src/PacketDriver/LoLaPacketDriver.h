@@ -5,12 +5,16 @@
 
 #include <ILoLaDriver.h>
 #include <Packet\LoLaPacketMap.h>
+#include <Packet\LoLaPacketFec.h>
 
 #include <Services\LoLaServicesManager.h>
 #include <PacketDriver\AsyncActionCallback.h>
+#include <PacketDriver\SendSlotEventTask.h>
+#include <PacketDriver\SlotSleepTask.h>
+#include <RingBufCPP.h>
 
 
-class LoLaPacketDriver : public ILoLaDriver
+class LoLaPacketDriver : public ILoLaDriver, public ISendSlotEventSource, public ISlotSleepSource
 {
 private:
 	///Async Callback.
@@ -38,27 +42,99 @@ private:
 	//Async helpers for values.
 	volatile uint8_t LastSentHeader = 0xFF;
 	uint8_t OutgoingHeaderHelper = 0;
+	uint32_t SlotWaitMicros = 0;
+	uint32_t PendingDueMicros = 0;
+	uint32_t SlotSleepMicros = 0;
+	uint32_t SendGuardMicros = 0;
+	uint32_t QueueEndMicros = 0;
+	uint8_t QueueIndex = 0;
 
 	uint8_t LastPower = 0;
 	uint8_t LastChannel = 0;
 	bool ChannelPending = false;
+	bool ChannelSampling = false;
 
 	volatile DriverActiveStates DriverActiveState = DriverActiveStates::DriverDisabled;
 
 	PacketDefinition* AckDefinition = nullptr;
 
+	//Acks waiting for an outgoing packet to ride on.
+	struct PendingAckType
+	{
+		uint8_t Header = 0;
+		uint8_t Id = 0;
+		uint32_t Millis = 0;
+	} PendingAckGrunt;
+	RingBufCPP<PendingAckType, LOLA_PACKET_ACK_PENDING_QUEUE_SIZE> PendingAcks;
+
+	//Forward error correction.
+	PacketDefinition* FecDefinition = nullptr;
+	LoLaPacketFec Fec;
+
+	//Wakes services waiting for AllowedSend(), when the slot opens.
+	//The driver's own sends ride on it too, without waking the services.
+	SendSlotEventTask SendSlotEvents;
+	bool ServicesSlotRequested = false;
+
+	//Radio sleeps through our own slot, when there's nothing to send.
+	SlotSleepTask SlotSleep;
+	uint32_t SlotSleepCount = 0;
+
+	//Airtime saved by variable size packets, against their max size.
+	uint32_t VariableSizeBytesSaved = 0;
+
+	//Cut-through receive.
+	UrgentPacketDispatcher Urgent;
+	volatile bool IncomingCutThrough = false;
+	volatile bool IncomingDecoded = false;
+	volatile bool IncomingValid = false;
+	volatile bool IncomingDispatched = false;
+	uint32_t CutThroughStartMicros = 0;
+#ifdef LOLA_MOCK_PACKET_LOSS
+	volatile bool IncomingMockLost = false;
+#endif
+
+	//Packets waiting behind the one on air, encoded only when they go out.
+	TemplateLoLaPacket<LOLA_PACKET_MAX_PACKET_SIZE> TransmitQueue[LOLA_PACKET_DRIVER_TX_QUEUE_SIZE];
+	uint8_t TransmitQueueStart = 0;
+	uint8_t TransmitQueueCount = 0;
+	uint8_t TransmitQueueFecCount = 0;
+	uint32_t TransmitQueueAirtimeMicros = 0;
+
+	//Slot fill statistics.
+	uint32_t LastTransmitSlotIndex = 0;
+	uint8_t SlotFrameCount = 0;
+	uint8_t MaxFramesPerSlot = 0;
+	uint32_t TransmitSlotCount = 0;
+	uint32_t QueuedFrameCount = 0;
+	uint64_t TransmitedBytes = 0;
+
+	//Radio state timeline, for current estimates.
+	enum RadioStateEnum : uint8_t
+	{
+		RadioOff = 0,
+		RadioReceiving = 1,
+		RadioTransmitting = 2,
+		RadioSleeping = 3
+	} RadioState = RadioStateEnum::RadioOff;
+	uint32_t RadioStateStartMicros = 0;
+	uint64_t RadioStateMicros[RadioStateEnum::RadioSleeping + 1] = {};
+	volatile uint32_t TransmitEndMicros = 0;
+
 protected:
 	///Services that are served receiving packets.
 	LoLaServicesManager Services;
 	///
 
-	TemplateLoLaPacket<LOLA_PACKET_MAX_PACKET_SIZE> IncomingPacket;
+	TemplateLoLaPacket<LOLA_PACKET_MAX_FRAME_SIZE> IncomingPacket;
 	uint8_t IncomingPacketSize = 0;
 
-	TemplateLoLaPacket<LOLA_PACKET_MAX_PACKET_SIZE> OutgoingPacket;
+	TemplateLoLaPacket<LOLA_PACKET_MAX_FRAME_SIZE> OutgoingPacket;
 	uint8_t OutgoingPacketSize = 0;
 
-	TemplateLoLaPacket<LOLA_PACKET_MIN_PACKET_SIZE> AckPacket;
+	TemplateLoLaPacket<LOLA_PACKET_MIN_PACKET_SIZE + 1> AckPacket;
+
+	TemplateLoLaPacket<LOLA_PACKET_MIN_PACKET_SIZE + LOLA_PACKET_FEC_PARITY_PAYLOAD_SIZE> FecPacket;
 
 
 protected:
@@ -66,6 +142,9 @@ protected:
 	virtual bool SetupRadio() { return false; }
 	virtual void ReadReceived() {}
 	virtual void SetToReceiving() {}
+	virtual void SetToSampling(const uint8_t channel) {}
+	virtual void SetToSleep() {}
+	virtual int16_t ReadRSSI() { return ILOLA_INVALID_RSSI; }
 	virtual void SetRadioPower() {}
 	virtual bool Transmit() { return false; }
 	virtual bool CanTransmit() { return true; }
@@ -73,7 +152,7 @@ protected:
 	virtual void EnableInterrupts() {}
 
 public:
-	LoLaPacketDriver(Scheduler* scheduler) : ILoLaDriver(), Services(), CallbackHandler(scheduler)
+	LoLaPacketDriver(Scheduler* scheduler) : ILoLaDriver(), ISendSlotEventSource(), Services(&PacketMap), CallbackHandler(scheduler), SendSlotEvents(scheduler, this), SlotSleep(scheduler, this)
 	{
 	}
 
@@ -136,6 +215,16 @@ protected:
 		LastChannel = 0xFF;
 		LastPower = 0;
 		ChannelPending = false;
+		ChannelSampling = false;
+		while (!PendingAcks.isEmpty())
+		{
+			PendingAcks.pull();
+		}
+		Fec.Reset();
+		TransmitQueueStart = 0;
+		TransmitQueueCount = 0;
+		TransmitQueueFecCount = 0;
+		TransmitQueueAirtimeMicros = 0;
 		RestoreToReceiving();
 	}
 
@@ -187,7 +276,8 @@ public:
 	bool Setup()
 	{
 		AckDefinition = PacketMap.GetDefinition(PACKET_DEFINITION_ACK_HEADER);
-		if (AckDefinition != nullptr && SetupRadio())
+		FecDefinition = PacketMap.GetDefinition(PACKET_DEFINITION_FEC_HEADER);
+		if (AckDefinition != nullptr && FecDefinition != nullptr && SetupRadio())
 		{
 			MethodSlot<LoLaPacketDriver, ActionCallbackClass> memFunSlot(this, &LoLaPacketDriver::OnAsyncAction);
 			CallbackHandler.AttachActionCallback(memFunSlot);
@@ -201,35 +291,281 @@ public:
 	bool SendPacket(ILoLaPacket* transmitPacket)
 	{
 		if (transmitPacket->GetDefinition() == nullptr ||
-			ChannelPending ||
-			(DriverActiveState != DriverActiveStates::ReadyForAnything &&
-				DriverActiveState != DriverActiveStates::SendingAck))
+			(transmitPacket->GetDefinition()->HasFEC() && Fec.IsTransmitGroupFull()) ||
+			ChannelPending)
+		{
+			return false;
+		}
+
+		//Radio is busy with our previous frame, this one goes right behind it.
+		if (DriverActiveState == DriverActiveStates::WaitingForTransmissionEnd)
+		{
+			if (!CanQueueBehindTransmit(transmitPacket->GetTotalSize(), transmitPacket->GetDefinition()->HasFEC()))
+			{
+				return false;
+			}
+
+			QueueIndex = (TransmitQueueStart + TransmitQueueCount) % LOLA_PACKET_DRIVER_TX_QUEUE_SIZE;
+			TransmitQueue[QueueIndex].SetDefinition(transmitPacket->GetDefinition());
+			memcpy(TransmitQueue[QueueIndex].GetRawContent(), transmitPacket->GetRawContent(), transmitPacket->GetContentSize());
+			TransmitQueue[QueueIndex].SetPayloadSize(transmitPacket->GetPayloadSize());
+			TransmitQueueAirtimeMicros += GetSendGuardMicros(transmitPacket->GetTotalSize());
+			TransmitQueueCount++;
+			if (transmitPacket->GetDefinition()->HasFEC())
+			{
+				TransmitQueueFecCount++;
+			}
+			QueuedFrameCount++;
+
+			return true;
+		}
+
+		if ((DriverActiveState != DriverActiveStates::ReadyForAnything &&
+			DriverActiveState != DriverActiveStates::SendingAck) ||
+			TransmitQueueCount > 0)
 		{
 			return false;
 		}
 
 		DriverActiveState = DriverActiveStates::SendingOutgoing;
+		ChannelSampling = false;
 
 		OutgoingHeaderHelper = transmitPacket->GetDataHeader();
+		OutgoingPacketSize = EncodeFrame(transmitPacket, &OutgoingPacket);
+
+		if (TransmitOutgoing())
+		{
+			return true;
+		}
+		else
+		{
+			AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+		}
+
+		return false;
+	}
+
+private:
+	//FEC tag, piggybacked ack and MAC/CRC, returns the frame size.
+	uint8_t EncodeFrame(ILoLaPacket* transmitPacket, ILoLaPacket* frame)
+	{
+		uint8_t frameSize = transmitPacket->GetTotalSize();
+		memcpy(frame->GetRawContent(), transmitPacket->GetRawContent(), transmitPacket->GetContentSize());
+
+		if (transmitPacket->GetDefinition()->HasVariableSize())
+		{
+			VariableSizeBytesSaved += transmitPacket->GetDefinition()->GetPayloadSize() - transmitPacket->GetPayloadSize();
+		}
+
+		if (transmitPacket->GetDefinition()->HasFEC())
+		{
+			//Group tag is covered by the parity, so a recovered packet knows its group.
+			frame->GetRaw()[frameSize] = Fec.GetTransmitTag();
+			frameSize += LOLA_PACKET_FEC_TAG_SIZE;
+			Fec.AddSent(frame->GetRawContent(), PacketDefinition::GetContentSizeQuick(frameSize));
+			SendSlotEvents.Request();
+		}
+
+		if (!transmitPacket->GetDefinition()->IsAck() &&
+			!transmitPacket->GetDefinition()->HasVariableSize() &&
+			PendingAcks.pull(PendingAckGrunt))
+		{
+			//Piggyback the oldest pending ack, encoded along with the packet.
+			frame->GetRaw()[frameSize] = PendingAckGrunt.Header;
+			frame->GetRaw()[frameSize + 1] = PendingAckGrunt.Id;
+			frameSize += LOLA_PACKET_ACK_TAIL_SIZE;
+		}
 
-		OutgoingPacket.SetMACCRC(CryptoEncoder.Encode(transmitPacket->GetRawContent(), transmitPacket->GetDefinition()->GetContentSize(), OutgoingPacket.GetRawContent()));
-		OutgoingPacketSize = transmitPacket->GetDefinition()->GetTotalSize();
+		frame->SetMACCRC(CryptoEncoder.Encode(frame->GetRawContent(), PacketDefinition::GetContentSizeQuick(frameSize)));
 
+		return frameSize;
+	}
+
+	bool TransmitOutgoing()
+	{
 		if (OutgoingPacketSize > 0 && Transmit())
 		{
+			UpdateRadioState(RadioStateEnum::RadioTransmitting, micros());
 			OnTransmitted(OutgoingHeaderHelper);
 			DriverActiveState = DriverActiveStates::WaitingForTransmissionEnd;
+			UpdateSlotFillStats();
+
+			//Waiting services can queue right behind this one.
+			SendSlotEvents.Wake();
 
 			return true;
 		}
+
+		return false;
+	}
+
+	//Linked only, the whole queue has to end before our half-slot does.
+	bool CanQueueBehindTransmit(const uint8_t packetSize, const bool hasFec)
+	{
+		if (!LinkActive ||
+			TransmitQueueCount >= LOLA_PACKET_DRIVER_TX_QUEUE_SIZE)
+		{
+			return false;
+		}
+
+		//Frame on air, the queued ones and this one, each after an inter frame gap.
+		SendGuardMicros = GetAirtimeMicros(OutgoingPacketSize);
+		if ((micros() - LastSentInfo.Micros) < SendGuardMicros)
+		{
+			QueueEndMicros = SendGuardMicros - (micros() - LastSentInfo.Micros);
+		}
 		else
 		{
-			AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+			QueueEndMicros = 0;
 		}
+		QueueEndMicros += TransmitQueueAirtimeMicros +
+			(LOLA_PACKET_DRIVER_INTER_FRAME_GAP_MICROS * (TransmitQueueCount + 1)) +
+			GetSendGuardMicros(packetSize) +
+			(GetQueuedParityCount(hasFec) * (GetSendGuardMicros(FecDefinition->GetTotalSize()) + LOLA_PACKET_DRIVER_INTER_FRAME_GAP_MICROS));
+
+		return QueueEndMicros <= GetMicrosUntilHalfSlotEnd();
+	}
+
+	//Parity frames that will go out ahead of queued FEC packets, as their groups fill up.
+	uint8_t GetQueuedParityCount(const bool withFec)
+	{
+		if (TransmitQueueFecCount == 0 && !withFec)
+		{
+			return 0;
+		}
+
+		return (Fec.GetTransmitGroupCount() + TransmitQueueFecCount + (withFec ? 1 : 0) - 1) / LOLA_PACKET_FEC_GROUP_SIZE;
+	}
+
+	//Partner needs the gap to re-arm its receiver.
+	uint32_t GetMicrosUntilInterFrameGapEnd()
+	{
+		if ((micros() - TransmitEndMicros) < LOLA_PACKET_DRIVER_INTER_FRAME_GAP_MICROS)
+		{
+			return LOLA_PACKET_DRIVER_INTER_FRAME_GAP_MICROS - (micros() - TransmitEndMicros);
+		}
+
+		return 0;
+	}
+
+	//Queued frames were already let into the slot, no back off for them.
+	bool IsQueuedFrameInSlot()
+	{
+		return LinkActive &&
+			!ChannelPending &&
+			IsInSendSlot(GetSendGuardMicros(GetQueuedFrameSize()));
+	}
+
+	inline bool IsParityBeforeQueued()
+	{
+		return TransmitQueue[TransmitQueueStart].GetDefinition()->HasFEC() && Fec.IsTransmitGroupFull();
+	}
+
+	//Size of what goes out next from the queue.
+	inline uint8_t GetQueuedFrameSize()
+	{
+		if (IsParityBeforeQueued())
+		{
+			return FecDefinition->GetTotalSize();
+		}
+
+		return TransmitQueue[TransmitQueueStart].GetTotalSize();
+	}
+
+	//Head of the queue goes out, or first the parity its FEC group is waiting for.
+	//Only now is it encoded, so FEC groups and piggybacked acks only count frames that got on air.
+	bool TransmitQueuedFrame()
+	{
+		DriverActiveState = DriverActiveStates::SendingOutgoing;
+		ChannelSampling = false;
+
+		if (IsParityBeforeQueued())
+		{
+			Fec.PrepareParity(&FecPacket, FecDefinition);
+			OutgoingHeaderHelper = FecPacket.GetDataHeader();
+			OutgoingPacketSize = EncodeFrame(&FecPacket, &OutgoingPacket);
+
+			if (TransmitOutgoing())
+			{
+				Fec.OnParitySent();
+
+				return true;
+			}
+
+			return false;
+		}
+
+		QueueIndex = TransmitQueueStart;
+		TransmitQueueStart = (TransmitQueueStart + 1) % LOLA_PACKET_DRIVER_TX_QUEUE_SIZE;
+		TransmitQueueCount--;
+		if (TransmitQueue[QueueIndex].GetDefinition()->HasFEC())
+		{
+			TransmitQueueFecCount--;
+		}
+		TransmitQueueAirtimeMicros -= GetSendGuardMicros(TransmitQueue[QueueIndex].GetTotalSize());
+
+		OutgoingHeaderHelper = TransmitQueue[QueueIndex].GetDataHeader();
+		OutgoingPacketSize = EncodeFrame(&TransmitQueue[QueueIndex], &OutgoingPacket);
+
+		if (TransmitOutgoing())
+		{
+			return true;
+		}
+
+		Services.ProcessSendFailed(TransmitQueue[QueueIndex].GetDataHeader(), TransmitQueue[QueueIndex].GetId());
 
 		return false;
 	}
 
+	//Owners are told right away, instead of waiting for their time outs.
+	void FailTransmitQueue()
+	{
+		while (TransmitQueueCount > 0)
+		{
+			Services.ProcessSendFailed(TransmitQueue[TransmitQueueStart].GetDataHeader(), TransmitQueue[TransmitQueueStart].GetId());
+			TransmitQueueStart = (TransmitQueueStart + 1) % LOLA_PACKET_DRIVER_TX_QUEUE_SIZE;
+			TransmitQueueCount--;
+		}
+		TransmitQueueFecCount = 0;
+		TransmitQueueAirtimeMicros = 0;
+	}
+
+	//From the send slot event, after the partner's inter-frame gap or on our next slot.
+	void ProcessTransmitQueue()
+	{
+		if (TransmitQueueCount == 0 ||
+			DriverActiveState != DriverActiveStates::ReadyForAnything ||
+			GetMicrosUntilInterFrameGapEnd() > 0 ||
+			!IsQueuedFrameInSlot())
+		{
+			return;
+		}
+
+		if (!TransmitQueuedFrame())
+		{
+			AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+		}
+	}
+
+	void UpdateSlotFillStats()
+	{
+		TransmitedBytes += OutgoingPacketSize;
+
+		if ((SyncedClock.GetSyncMicros() / HalfDuplexPeriodMicros) != LastTransmitSlotIndex ||
+			TransmitSlotCount == 0)
+		{
+			LastTransmitSlotIndex = SyncedClock.GetSyncMicros() / HalfDuplexPeriodMicros;
+			TransmitSlotCount++;
+			SlotFrameCount = 0;
+		}
+
+		if (SlotFrameCount < UINT8_MAX)
+		{
+			SlotFrameCount++;
+		}
+		MaxFramesPerSlot = max(MaxFramesPerSlot, SlotFrameCount);
+	}
+
 private:
 	void ProcessIncoming()
 	{
@@ -243,10 +579,13 @@ private:
 
 		DriverActiveState = DriverActiveStates::ProcessingIncoming;
 
-		ReadReceived();
+		if (!IncomingCutThrough)
+		{
+			ReadReceived();
+		}
 
 		if (IncomingPacketSize < LOLA_PACKET_MIN_PACKET_SIZE ||
-			IncomingPacketSize > LOLA_PACKET_MAX_PACKET_SIZE)
+			IncomingPacketSize > LOLA_PACKET_MAX_FRAME_SIZE)
 		{
 			RestoreToReceiving();
 			EnableInterrupts();
@@ -254,8 +593,23 @@ private:
 			return;//Invalid packet size;
 		}
 
-		if (CryptoEncoder.Decode(IncomingPacket.GetRawContent(), PacketDefinition::GetContentSizeQuick(IncomingPacketSize), IncomingPacket.GetMACCRC()) &&
-			IncomingPacket.SetDefinition(PacketMap.GetDefinition(IncomingPacket.GetDataHeader())))
+#ifdef LOLA_MOCK_PACKET_LOSS
+		//Rolled once per packet, the receive callback may have already.
+		if (!IncomingCutThrough)
+		{
+			IncomingMockLost = IsMockPacketLost();
+		}
+
+		if (IncomingMockLost)
+		{
+			RestoreToReceiving();
+			EnableInterrupts();
+
+			return;
+		}
+#endif
+
+		if (IncomingDecoded ? IncomingValid : DecodeIncoming())
 		{
 			//Packet received Ok, let's commit that info really quick.
 			LastValidReceivedInfo.Micros = LastReceivedInfo.Micros;
@@ -268,50 +622,38 @@ private:
 				TimingCollisionCount++;
 			}
 
-
-			//Is Ack packet.
-			if (IncomingPacket.GetDefinition()->IsAck())
+			//Piggybacked ack, consumed before the packet itself.
+			if (!IncomingPacket.GetDefinition()->IsAck() &&
+				!IncomingPacket.GetDefinition()->HasVariableSize() &&
+				IncomingPacketSize == (IncomingPacket.GetDefinition()->GetFrameSize() + LOLA_PACKET_ACK_TAIL_SIZE))
 			{
-				Services.ProcessAck(&IncomingPacket);
-				RestoreToReceiving();
-				EnableInterrupts();
+				Services.ProcessAck(IncomingPacket.GetRaw()[IncomingPacket.GetDefinition()->GetFrameSize()],
+					IncomingPacket.GetRaw()[IncomingPacket.GetDefinition()->GetFrameSize() + 1]);
 			}
-			else if (IncomingPacket.GetDefinition()->HasACK())//If packet has ack, do service validation before sending Ack.
+
+			if (IncomingPacket.GetDefinition() == FecDefinition)
 			{
-				if (Services.ProcessAckedPacket(&IncomingPacket))
+				//Parity replaces itself with the packet it recovered, if any.
+				if (RecoverFromParity())
 				{
-					//Send Ack ASAP.
-					AckPacket.SetDefinition(AckDefinition);
-					AckPacket.GetPayload()[0] = IncomingPacket.GetDefinition()->GetHeader();
-					AckPacket.SetId(IncomingPacket.GetId());
-					DriverActiveState = DriverActiveStates::SendingAck;
-					if (SendPacket(&AckPacket))
-					{
-						EnableInterrupts();
-					}
-					else
-					{
-#ifdef DEBUG_LOLA
-						Serial.println(F("Send Ack failed."));
-#endif						
-						RestoreToReceiving();
-						EnableInterrupts();
-					}
+					DispatchIncoming();
 				}
 				else
 				{
-					//NACK.
 					RestoreToReceiving();
 					EnableInterrupts();
 				}
+
+				return;
 			}
-			else
+
+			if (IncomingPacket.GetDefinition()->HasFEC() &&
+				IncomingPacketSize >= IncomingPacket.GetDefinition()->GetFrameSize())
 			{
-				//Process packet directly, no Ack.
-				Services.ProcessPacket(&IncomingPacket);
-				RestoreToReceiving();
-				EnableInterrupts();
+				Fec.AddReceived(IncomingPacket.GetRawContent(), IncomingPacket.GetDefinition()->GetContentSize() + LOLA_PACKET_FEC_TAG_SIZE);
 			}
+
+			DispatchIncoming();
 		}
 		else
 		{
@@ -322,118 +664,451 @@ private:
 		}
 	}
 
-	void ProcessSent(const uint8_t header)
-	{
-		Services.ProcessSent(header);
-		RestoreToReceiving();
-	}
-
-	void RestoreToReceiving()
+	bool DecodeIncoming()
 	{
-		LastChannel = CurrentChannel;
-		ChannelPending = false;
-		DriverActiveState = DriverActiveStates::ReadyForAnything;
-		SetToReceiving();
+		return CryptoEncoder.Decode(IncomingPacket.GetRawContent(), PacketDefinition::GetContentSizeQuick(IncomingPacketSize), IncomingPacket.GetMACCRC()) &&
+			IncomingPacket.SetDefinition(PacketMap.GetDefinition(IncomingPacket.GetDataHeader())) &&
+			IncomingPacket.SetReceivedSize(IncomingPacketSize);
 	}
 
-public:
-	///Driver calls.
-	//When RF detects incoming packet.
-	void OnIncoming(const int16_t rssi)
+#ifdef LOLA_MOCK_PACKET_LOSS
+	bool IsMockPacketLost()
 	{
-		LastReceivedInfo.Micros = micros();
-		LastReceivedInfo.RSSI = rssi;
-
-		if (DriverActiveState == DriverActiveStates::ReadyForAnything)
-		{
-			DriverActiveState = DriverActiveStates::BlockedForIncoming;
-		}
-#ifdef DEBUG_LOLA
-		else
+#ifdef LOLA_MOCK_INTERFERENCE_CHANNEL_MASK
+		if (GetInterferenceChance())
 		{
-			Serial.print(F("Bad state OnIncoming: "));
-			Serial.println(DriverActiveState);
+			//Simulated corrupted packet.
+			RejectedCount++;
+
+			return true;
 		}
 #endif
+		//Simulated lost packet.
+		return !GetLossChance();
 	}
+#endif
 
-	//When RF has packet to read, copy content into receive buffer.
-	void OnReceiveBegin(const uint8_t length, const int16_t rssi)
+	//From the receive callback, only for frames small enough to be urgent,
+	//with no main loop crypto in progress.
+	//Anything that doesn't decode to an urgent header is left for the async path.
+	void CutThroughIncoming()
 	{
-		if (DriverActiveState == DriverActiveStates::BlockedForIncoming)
-		{
-			DisableInterrupts();
-			DriverActiveState = DriverActiveStates::AwaitingProcessing;
-			IncomingPacketSize = length;
-			LastReceivedInfo.RSSI = min(rssi, LastReceivedInfo.RSSI);
+		CutThroughStartMicros = micros();
+		ReadReceived();
+		IncomingCutThrough = true;
 
-			AddAsyncAction(DriverAsyncActions::ActionProcessIncomingPacket);
-		}
-		else
+		if (IncomingPacketSize < LOLA_PACKET_MIN_PACKET_SIZE)
 		{
-#ifdef DEBUG_LOLA
-			Serial.print(F("Bad state OnReceiveBegin: "));
-			Serial.println(DriverActiveState);
-#endif
-			AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+			return;
 		}
-	}
 
-	//When RF has received a garbled packet.
-	void OnReceivedFail(const int16_t rssi)
-	{
-#ifdef DEBUG_LOLA
-		if (DriverActiveState != DriverActiveStates::BlockedForIncoming)
+#ifdef LOLA_MOCK_PACKET_LOSS
+		IncomingMockLost = IsMockPacketLost();
+		if (IncomingMockLost)
 		{
-			Serial.print(F("Bad state OnReceivedFail: "));
-			Serial.println(DriverActiveState);
+			return;
 		}
 #endif
-		AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
-	}
 
-	void OnSentOk()
-	{
-		if (DriverActiveState == DriverActiveStates::WaitingForTransmissionEnd)
-		{
-			LastValidSentInfo.Micros = LastSentInfo.Micros;
-			TransmitedCount++;
-			AddAsyncAction(DriverAsyncActions::ActionProcessSentOk, false, LastSentHeader);
-			LastSentHeader = 0xFF;
-		}
-		else
+		if (!Urgent.CutsThrough(CryptoEncoder.DecodeHeader(IncomingPacket.GetRawContent())))
 		{
-#ifdef DEBUG_LOLA
-			Serial.print(F("Bad state OnSentOk: "));
-			Serial.println(DriverActiveState);
-#endif
-			AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+			return;
 		}
-	}
-
-	void OnBatteryAlarm()
-	{
-		//TODO: Store statistics, maybe set-up a callback?
-		AddAsyncAction(DriverAsyncActions::ActionProcessBatteryAlarm);
-	}
 
-	void OnWakeUpTimer()
-	{
-		//TODO: Can this be used as stable clock source?
+		IncomingDecoded = true;
+		IncomingValid = DecodeIncoming();
+		IncomingDispatched = IncomingValid &&
+			Urgent.Dispatch(&IncomingPacket, CutThroughStartMicros);
 	}
 
-	bool AllowedSend()
+	void DispatchIncoming()
 	{
-		if (DriverActiveState != DriverActiveStates::ReadyForAnything ||
-			ChannelPending)
+		//Missed the cut-through: busy encoder, recovered from parity, too big or demoted.
+		if (!IncomingDispatched)
 		{
-			return false;
+			IncomingDispatched = Urgent.DispatchFallback(&IncomingPacket);
 		}
 
-		if (LinkActive)
+		//Is Ack packet.
+		if (IncomingPacket.GetDefinition()->IsAck())
 		{
-			return IsInSendSlot() &&
-				(GetElapsedMillisLastValidSent() >= BackOffPeriodLinkedMillis);
+			Services.ProcessAck(&IncomingPacket);
+			RestoreToReceiving();
+			EnableInterrupts();
+		}
+		else if (IncomingPacket.GetDefinition()->HasACK())//If packet has ack, do service validation before sending Ack.
+		{
+			//Urgent handler already took it.
+			if (IncomingDispatched || Services.ProcessAckedPacket(&IncomingPacket))
+			{
+				if (LinkActive)
+				{
+					//Ack goes out with our next packet, in our own slot.
+					AddPendingAck(IncomingPacket.GetDefinition()->GetHeader(), IncomingPacket.GetId());
+					RestoreToReceiving();
+					EnableInterrupts();
+
+					return;
+				}
+
+				//Not linked, no slots yet, send Ack ASAP.
+				AckPacket.SetDefinition(AckDefinition);
+				AckPacket.GetPayload()[0] = IncomingPacket.GetDefinition()->GetHeader();
+				AckPacket.SetId(IncomingPacket.GetId());
+				DriverActiveState = DriverActiveStates::SendingAck;
+				if (SendPacket(&AckPacket))
+				{
+					EnableInterrupts();
+				}
+				else
+				{
+#ifdef DEBUG_LOLA
+					Serial.println(F("Send Ack failed."));
+#endif						
+					RestoreToReceiving();
+					EnableInterrupts();
+				}
+			}
+			else
+			{
+				//NACK.
+				RestoreToReceiving();
+				EnableInterrupts();
+			}
+		}
+		else
+		{
+			//Process packet directly, no Ack.
+			if (!IncomingDispatched)
+			{
+				Services.ProcessPacket(&IncomingPacket);
+			}
+			RestoreToReceiving();
+			EnableInterrupts();
+		}
+	}
+
+	void AddPendingAck(const uint8_t header, const uint8_t id)
+	{
+		PendingAckGrunt.Header = header;
+		PendingAckGrunt.Id = id;
+		PendingAckGrunt.Millis = millis();
+		PendingAcks.addForce(PendingAckGrunt);
+
+		SendSlotEvents.Request();
+	}
+
+	//Fallback, when there's nothing going out to carry the ack.
+	//Checked on every send slot event, until there are no acks left.
+	void ProcessPendingAck()
+	{
+		while (PendingAcks.peek(0) != nullptr &&
+			millis() - PendingAcks.peek(0)->Millis > LOLA_PACKET_ACK_PIGGYBACK_MAX_AGE_MILLIS)
+		{
+			PendingAcks.pull();
+		}
+
+		if (PendingAcks.isEmpty())
+		{
+			return;
+		}
+
+		if (millis() - PendingAcks.peek(0)->Millis >= LOLA_PACKET_ACK_PIGGYBACK_GRACE_MILLIS &&
+			AllowedSend(AckDefinition->GetTotalSize()) &&
+			PendingAcks.pull(PendingAckGrunt))
+		{
+			AckPacket.SetDefinition(AckDefinition);
+			AckPacket.GetPayload()[0] = PendingAckGrunt.Header;
+			AckPacket.SetId(PendingAckGrunt.Id);
+			if (!SendPacket(&AckPacket))
+			{
+				//Try again on the next slot event.
+				PendingAcks.addForce(PendingAckGrunt);
+			}
+		}
+	}
+
+	//Driver's own sends, served from the send slot event.
+	bool HasPendingSends()
+	{
+		return TransmitQueueCount > 0 || !PendingAcks.isEmpty() || Fec.HasTransmitGroup();
+	}
+
+	//Earliest deadline, ILOLA_INVALID_MICROS if there's nothing pending.
+	uint32_t GetMicrosUntilPendingSendsDue()
+	{
+		uint32_t dueMicros = ILOLA_INVALID_MICROS;
+
+		if (TransmitQueueCount > 0)
+		{
+			return 0;
+		}
+
+		if (!PendingAcks.isEmpty())
+		{
+			if (millis() - PendingAcks.peek(0)->Millis >= LOLA_PACKET_ACK_PIGGYBACK_GRACE_MILLIS)
+			{
+				return 0;
+			}
+
+			dueMicros = (LOLA_PACKET_ACK_PIGGYBACK_GRACE_MILLIS - (millis() - PendingAcks.peek(0)->Millis)) * 1000;
+		}
+
+		if (Fec.HasTransmitGroup())
+		{
+			dueMicros = min(dueMicros, Fec.GetMillisUntilParityDue() * 1000);
+		}
+
+		return dueMicros;
+	}
+
+	bool RecoverFromParity()
+	{
+		if (!Fec.OnParityReceived(IncomingPacket.GetId(), IncomingPacket.GetPayload()))
+		{
+			return false;
+		}
+
+		memcpy(IncomingPacket.GetRawContent(), Fec.GetRecovered(), Fec.GetRecoveredSize());
+		IncomingPacketSize = Fec.GetRecoveredSize() + LOLA_PACKET_HEADER_INDEX;
+
+		return IncomingPacket.SetDefinition(PacketMap.GetDefinition(IncomingPacket.GetDataHeader())) &&
+			IncomingPacket.GetDefinition()->HasFEC() &&
+			IncomingPacket.GetDefinition()->GetFrameSize() == IncomingPacketSize;
+	}
+
+	//Parity goes out when the group is full, or flushed on time out.
+	//Checked on every send slot event, until the group is out.
+	void ProcessFecParity()
+	{
+		if (!Fec.HasTransmitGroup())
+		{
+			return;
+		}
+
+		if (Fec.IsParityDue() &&
+			AllowedSend(FecDefinition->GetTotalSize()))
+		{
+			Fec.PrepareParity(&FecPacket, FecDefinition);
+			if (SendPacket(&FecPacket))
+			{
+				Fec.OnParitySent();
+			}
+		}
+	}
+
+	void ProcessSent(const uint8_t header)
+	{
+		//Radio goes to sleep on its own, after transmitting.
+		UpdateRadioState(RadioStateEnum::RadioSleeping, TransmitEndMicros);
+		Services.ProcessSent(header);
+
+		//Next queued frame goes right out, if the partner already had its gap.
+		if (TransmitQueueCount > 0 &&
+			GetMicrosUntilInterFrameGapEnd() == 0 &&
+			IsQueuedFrameInSlot() &&
+			TransmitQueuedFrame())
+		{
+			return;
+		}
+
+		//Otherwise the send slot event takes it, no waiting in here.
+		RestoreToReceiving();
+	}
+
+	void RestoreToReceiving()
+	{
+		LastChannel = CurrentChannel;
+		ChannelPending = false;
+		ChannelSampling = false;
+		IncomingCutThrough = false;
+		IncomingDecoded = false;
+		IncomingDispatched = false;
+		DriverActiveState = DriverActiveStates::ReadyForAnything;
+		SetToReceiving();
+		UpdateRadioState(RadioStateEnum::RadioReceiving, micros());
+		SendSlotEvents.Wake();
+
+		if (TransmitQueueCount > 0)
+		{
+			SendSlotEvents.Request();
+		}
+	}
+
+	void UpdateRadioState(const RadioStateEnum newState, const uint32_t timestamp)
+	{
+		if (RadioState != RadioStateEnum::RadioOff &&
+			(int32_t)(timestamp - RadioStateStartMicros) > 0)
+		{
+			RadioStateMicros[RadioState] += timestamp - RadioStateStartMicros;
+		}
+
+		RadioState = newState;
+		RadioStateStartMicros = timestamp;
+	}
+
+public:
+	///Driver calls.
+	//When RF detects incoming packet.
+	void OnIncoming(const int16_t rssi)
+	{
+		LastReceivedInfo.Micros = micros();
+		LastReceivedInfo.RSSI = rssi;
+
+		if (DriverActiveState == DriverActiveStates::ReadyForAnything)
+		{
+			DriverActiveState = DriverActiveStates::BlockedForIncoming;
+		}
+#ifdef DEBUG_LOLA
+		else
+		{
+			Serial.print(F("Bad state OnIncoming: "));
+			Serial.println(DriverActiveState);
+		}
+#endif
+	}
+
+	//When RF has packet to read, copy content into receive buffer.
+	void OnReceiveBegin(const uint8_t length, const int16_t rssi)
+	{
+		if (DriverActiveState == DriverActiveStates::BlockedForIncoming)
+		{
+			DisableInterrupts();
+			DriverActiveState = DriverActiveStates::AwaitingProcessing;
+			IncomingPacketSize = length;
+			LastReceivedInfo.RSSI = min(rssi, LastReceivedInfo.RSSI);
+
+			if (Urgent.Accepts(length) &&
+				!CryptoEncoder.IsBusy())
+			{
+				CutThroughIncoming();
+			}
+
+			AddAsyncAction(DriverAsyncActions::ActionProcessIncomingPacket);
+		}
+		else
+		{
+#ifdef DEBUG_LOLA
+			Serial.print(F("Bad state OnReceiveBegin: "));
+			Serial.println(DriverActiveState);
+#endif
+			AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+		}
+	}
+
+	//When RF has received a garbled packet.
+	void OnReceivedFail(const int16_t rssi)
+	{
+#ifdef DEBUG_LOLA
+		if (DriverActiveState != DriverActiveStates::BlockedForIncoming)
+		{
+			Serial.print(F("Bad state OnReceivedFail: "));
+			Serial.println(DriverActiveState);
+		}
+#endif
+		AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+	}
+
+	void OnSentOk()
+	{
+		if (DriverActiveState == DriverActiveStates::WaitingForTransmissionEnd)
+		{
+			TransmitEndMicros = micros();
+			LastValidSentInfo.Micros = LastSentInfo.Micros;
+			LastValidSentInfo.Header = LastSentHeader;
+			LastValidSentInfo.Id = OutgoingPacket.GetId();
+			TransmitedCount++;
+			AddAsyncAction(DriverAsyncActions::ActionProcessSentOk, false, LastSentHeader);
+			LastSentHeader = 0xFF;
+		}
+		else
+		{
+#ifdef DEBUG_LOLA
+			Serial.print(F("Bad state OnSentOk: "));
+			Serial.println(DriverActiveState);
+#endif
+			AddAsyncAction(DriverAsyncActions::ActionAsyncRestore, true);
+		}
+	}
+
+	void OnBatteryAlarm()
+	{
+		//TODO: Store statistics, maybe set-up a callback?
+		AddAsyncAction(DriverAsyncActions::ActionProcessBatteryAlarm);
+	}
+
+	void OnWakeUpTimer()
+	{
+		//TODO: Can this be used as stable clock source?
+	}
+
+	//Listen on another channel for a moment, only when idle.
+	bool StartChannelSample(const uint8_t channel)
+	{
+		if (DriverActiveState != DriverActiveStates::ReadyForAnything ||
+			ChannelPending ||
+			ChannelSampling)
+		{
+			return false;
+		}
+
+		ChannelSampling = true;
+		SetToSampling(channel);
+
+		return true;
+	}
+
+	int16_t EndChannelSample()
+	{
+		if (!ChannelSampling)
+		{
+			return ILOLA_INVALID_RSSI;
+		}
+
+		if (DriverActiveState != DriverActiveStates::ReadyForAnything)
+		{
+			//Something came in on the sampled channel, the driver will restore on its own.
+			ChannelSampling = false;
+
+			return ILOLA_INVALID_RSSI;
+		}
+
+		int16_t rssi = ReadRSSI();
+		RestoreToReceiving();
+
+		return rssi;
+	}
+
+	bool AllowedSend()
+	{
+		return AllowedSend(LOLA_PACKET_MAX_FRAME_SIZE);
+	}
+
+	//Short packets fit closer to the end of the slot.
+	bool AllowedSend(const uint8_t packetSize)
+	{
+		if (DriverActiveState == DriverActiveStates::WaitingForTransmissionEnd)
+		{
+			return !ChannelPending && CanQueueBehindTransmit(packetSize);
+		}
+
+		//Queued packets go first.
+		return TransmitQueueCount == 0 && IsSendSlotOpen(packetSize);
+	}
+
+private:
+	bool IsSendSlotOpen(const uint8_t packetSize)
+	{
+		if (DriverActiveState != DriverActiveStates::ReadyForAnything ||
+			ChannelPending)
+		{
+			return false;
+		}
+
+		if (LinkActive)
+		{
+			return IsInSendSlot(GetSendGuardMicros(packetSize)) &&
+				(GetElapsedMillisLastValidSent() >= BackOffPeriodLinkedMillis);
 		}
 		else
 		{
@@ -441,10 +1116,319 @@ public:
 		}
 	}
 
+public:
+	bool RequestSendSlotEvent()
+	{
+		ServicesSlotRequested = true;
+		SendSlotEvents.Request();
+
+		return true;
+	}
+
+	uint32_t GetSendSlotEventCount()
+	{
+		return SendSlotEvents.GetEventCount();
+	}
+
+	uint32_t GetSendSlotWakeCount()
+	{
+		return SendSlotEvents.GetWakeCount();
+	}
+
+	//Same rules as AllowedSend(), but how long until it's true.
+	uint32_t GetMicrosUntilSendSlot()
+	{
+		if (ServicesSlotRequested)
+		{
+			PendingDueMicros = 0;
+		}
+		else
+		{
+			//Only the driver is waiting, on its own deadline.
+			PendingDueMicros = GetMicrosUntilPendingSendsDue();
+		}
+
+		//Room behind the frame on air counts as a send slot too.
+		if (AllowedSend())
+		{
+			return PendingDueMicros;
+		}
+
+		if (TransmitQueueCount > 0 &&
+			DriverActiveState == DriverActiveStates::ReadyForAnything &&
+			IsQueuedFrameInSlot())
+		{
+			return GetMicrosUntilInterFrameGapEnd();
+		}
+
+		if (DriverActiveState != DriverActiveStates::ReadyForAnything ||
+			ChannelPending)
+		{
+			//RestoreToReceiving() will wake us up.
+			return ILOLA_INVALID_MICROS;
+		}
+
+		SlotWaitMicros = GetMicrosUntilBackOffEnd(LinkActive ? BackOffPeriodLinkedMillis : BackOffPeriodUnlinkedMillis);
+
+		if (LinkActive)
+		{
+			SlotWaitMicros = max(SlotWaitMicros, GetMicrosUntilSendSlotStart());
+		}
+
+		//Slot may be closing right now, check again soon.
+		return max(max(SlotWaitMicros, PendingDueMicros), (uint32_t)1);
+	}
+
+	void OnSendSlotEvent()
+	{
+		ProcessTransmitQueue();
+		ProcessPendingAck();
+		ProcessFecParity();
+
+		if (ServicesSlotRequested)
+		{
+			ServicesSlotRequested = false;
+			Services.NotifySendSlotOpen();
+		}
+
+		//Level triggered, stays requested while the driver has something to send.
+		if (HasPendingSends())
+		{
+			SendSlotEvents.Request();
+		}
+	}
+
+	void OnLinkStatusUpdated()
+	{
+		if (!LinkActive)
+		{
+			//Queued packets aren't encoded yet, no FEC or acks to undo.
+			FailTransmitQueue();
+		}
+
+#ifdef LOLA_LINK_USE_SLOT_SLEEP
+		if (LinkActive)
+		{
+			SlotSleep.Start();
+		}
+		else
+		{
+			SlotSleep.Stop();
+			WakeRadio();
+		}
+#endif
+	}
+
+	bool SleepRadio()
+	{
+		if (DriverActiveState != DriverActiveStates::ReadyForAnything ||
+			ChannelPending ||
+			ChannelSampling)
+		{
+			return false;
+		}
+
+		SetToSleep();
+		UpdateRadioState(RadioStateEnum::RadioSleeping, micros());
+
+		return true;
+	}
+
+	void WakeRadio()
+	{
+		if (RadioState == RadioStateEnum::RadioSleeping &&
+			DriverActiveState == DriverActiveStates::ReadyForAnything)
+		{
+			RestoreToReceiving();
+		}
+	}
+
+	//Wakes the radio up before the partner's slot, puts it back to sleep in ours.
+	uint32_t OnSlotSleepCheck()
+	{
+		if (!LinkActive)
+		{
+			return ILOLA_INVALID_MICROS;
+		}
+
+		WakeRadio();
+
+		SlotSleepMicros = GetRadioIdleBudgetMicros();
+
+		//Sending still works, the radio wakes up to transmit.
+		if (SlotSleepMicros >= (LOLA_RADIO_SLOT_SLEEP_MIN_MICROS + LOLA_RADIO_WAKE_UP_MARGIN_MICROS) &&
+			SleepRadio())
+		{
+			SlotSleepCount++;
+
+			return SlotSleepMicros - LOLA_RADIO_WAKE_UP_MARGIN_MICROS;
+		}
+
+		//Awake for this one, try again on our next slot.
+		return GetMicrosUntilNextSendSlotStart();
+	}
+
+	uint32_t GetSlotSleepCount()
+	{
+		return SlotSleepCount;
+	}
+
+	uint32_t GetVariableSizeBytesSaved()
+	{
+		return VariableSizeBytesSaved;
+	}
+
+	bool AddUrgentHandler(const uint8_t header, ILoLaUrgentHandler* handler)
+	{
+		return Urgent.Add(PacketMap.GetDefinition(header), handler);
+	}
+
+	uint32_t GetUrgentDispatchCount()
+	{
+		return Urgent.GetDispatchCount();
+	}
+
+	uint32_t GetUrgentFallbackCount()
+	{
+		return Urgent.GetFallbackCount();
+	}
+
+	uint32_t GetUrgentMaxMicros()
+	{
+		return Urgent.GetMaxDurationMicros();
+	}
+
+	uint32_t GetUrgentOverBudgetCount()
+	{
+		return Urgent.GetOverBudgetCount();
+	}
+
+	//Slot fill, how many frames go out in each of our send slots.
+	uint32_t GetTransmitSlotCount()
+	{
+		return TransmitSlotCount;
+	}
+
+	uint8_t GetMaxFramesPerSlot()
+	{
+		return MaxFramesPerSlot;
+	}
+
+	//Fixed point, 100 is one frame per slot.
+	uint32_t GetAverageFramesPerSlotX100()
+	{
+		if (TransmitSlotCount == 0)
+		{
+			return 0;
+		}
+
+		return (uint32_t)((TransmitedCount * 100) / TransmitSlotCount);
+	}
+
+	uint32_t GetQueuedFrameCount()
+	{
+		return QueuedFrameCount;
+	}
+
+	uint64_t GetTransmitedBytes()
+	{
+		return TransmitedBytes;
+	}
+
+	//How long the radio can sleep from now. Zero in the partner's slot, or with something still to send.
+	uint32_t GetRadioIdleBudgetMicros()
+	{
+		if (!LinkActive ||
+			DriverActiveState != DriverActiveStates::ReadyForAnything ||
+			ChannelPending ||
+			ChannelSampling ||
+			!PendingAcks.isEmpty() ||
+			Fec.HasTransmitGroup() ||
+			TransmitQueueCount > 0 ||
+			SendSlotEvents.IsRequested() ||
+			GetMicrosUntilSendSlotStart() > 0)
+		{
+			return 0;
+		}
+
+		return GetMicrosUntilSendSlotEnd();
+	}
+
+	//Time spent in each radio state, since the last reset.
+	uint32_t GetReceivingMillis()
+	{
+		return GetRadioStateMicros(RadioStateEnum::RadioReceiving) / 1000;
+	}
+
+	uint32_t GetTransmittingMillis()
+	{
+		return GetRadioStateMicros(RadioStateEnum::RadioTransmitting) / 1000;
+	}
+
+	uint32_t GetSleepingMillis()
+	{
+		return GetRadioStateMicros(RadioStateEnum::RadioSleeping) / 1000;
+	}
+
+	//Radio only, from the state timeline and the driver's current figures.
+	uint32_t GetEstimatedCurrentMicroAmps()
+	{
+		const uint64_t receiving = GetRadioStateMicros(RadioStateEnum::RadioReceiving);
+		const uint64_t transmitting = GetRadioStateMicros(RadioStateEnum::RadioTransmitting);
+		const uint64_t sleeping = GetRadioStateMicros(RadioStateEnum::RadioSleeping);
+
+		if ((receiving + transmitting + sleeping) == 0)
+		{
+			return 0;
+		}
+
+		return (uint32_t)(((receiving * GetReceivingCurrentMicroAmps()) +
+			(transmitting * GetTransmittingCurrentMicroAmps()) +
+			(sleeping * GetSleepingCurrentMicroAmps())) /
+			(receiving + transmitting + sleeping));
+	}
+
+	void ResetRadioStateTimes()
+	{
+		for (uint8_t i = 0; i <= RadioStateEnum::RadioSleeping; i++)
+		{
+			RadioStateMicros[i] = 0;
+		}
+		RadioStateStartMicros = micros();
+	}
+
 #ifdef DEBUG_LOLA
 	virtual void Debug(Stream* serial)
 	{
 		ILoLaDriver::Debug(serial);
+		serial->print(F("Send slot events: "));
+		serial->print(SendSlotEvents.GetEventCount());
+		serial->print(F(" wakes: "));
+		serial->println(SendSlotEvents.GetWakeCount());
+		serial->print(F("Radio RX: "));
+		serial->print(GetReceivingMillis());
+		serial->print(F(" ms TX: "));
+		serial->print(GetTransmittingMillis());
+		serial->print(F(" ms Sleep: "));
+		serial->print(GetSleepingMillis());
+		serial->print(F(" ms ~"));
+		serial->print(GetEstimatedCurrentMicroAmps());
+		serial->println(F(" uA"));
+		serial->print(F("Airtime ack: "));
+		serial->print(GetAirtimeMicros(AckDefinition->GetTotalSize()));
+		serial->print(F(" us max frame: "));
+		serial->print(GetAirtimeMicros(LOLA_PACKET_MAX_FRAME_SIZE));
+		serial->println(F(" us"));
+		serial->print(F("Slot fill: "));
+		serial->print(GetAverageFramesPerSlotX100());
+		serial->print(F("/100 max: "));
+		serial->print(MaxFramesPerSlot);
+		serial->print(F(" queued: "));
+		serial->print(QueuedFrameCount);
+		serial->print(F(" TX bytes: "));
+		serial->println((uint32_t)TransmitedBytes);
+		Urgent.Debug(serial);
+		Fec.Debug(serial);
 		Services.Debug(serial);
 	}
 #endif
@@ -483,14 +1467,96 @@ private:
 		return false;
 	}
 
-	bool IsInSendSlot()
+	uint32_t GetMicrosUntilBackOffEnd(const uint32_t backOffMillis)
+	{
+		if (LastValidSentInfo.Micros == ILOLA_INVALID_MICROS ||
+			(micros() - LastValidSentInfo.Micros) >= (backOffMillis * 1000))
+		{
+			return 0;
+		}
+
+		return (backOffMillis * 1000) - (micros() - LastValidSentInfo.Micros);
+	}
+
+	uint64_t GetRadioStateMicros(const RadioStateEnum state)
+	{
+		if (RadioState == state)
+		{
+			return RadioStateMicros[state] + (micros() - RadioStateStartMicros);
+		}
+
+		return RadioStateMicros[state];
+	}
+
+	//Worst case on air time for a packet, with the FEC tag and a piggybacked ack.
+	uint32_t GetSendGuardMicros(const uint8_t packetSize)
+	{
+		return GetAirtimeMicros(min((uint8_t)(packetSize + LOLA_PACKET_FEC_TAG_SIZE + LOLA_PACKET_ACK_TAIL_SIZE), (uint8_t)LOLA_PACKET_MAX_FRAME_SIZE));
+	}
+
+	//For the largest frame, when the next packet's size isn't known.
+	uint32_t GetMicrosUntilSendSlotEnd()
+	{
+		SendGuardMicros = GetSendGuardMicros(LOLA_PACKET_MAX_FRAME_SIZE);
+		DuplexElapsed = SyncedClock.GetSyncMicros() % DuplexPeriodMicros;
+
+		if (EvenSlot)
+		{
+			if (DuplexElapsed + SendGuardMicros <= HalfDuplexPeriodMicros)
+			{
+				return HalfDuplexPeriodMicros - SendGuardMicros - DuplexElapsed;
+			}
+		}
+		else
+		{
+			if ((DuplexElapsed >= HalfDuplexPeriodMicros) &&
+				DuplexElapsed + SendGuardMicros <= DuplexPeriodMicros)
+			{
+				return DuplexPeriodMicros - SendGuardMicros - DuplexElapsed;
+			}
+		}
+
+		return 0;
+	}
+
+	uint32_t GetMicrosUntilNextSendSlotStart()
 	{
-		DuplexElapsed = (SyncedClock.GetSyncMicros() + ETTM) % DuplexPeriodMicros;
+		DuplexElapsed = SyncedClock.GetSyncMicros() % DuplexPeriodMicros;
+
+		if (EvenSlot)
+		{
+			return DuplexPeriodMicros - DuplexElapsed;
+		}
+		else if (DuplexElapsed < HalfDuplexPeriodMicros)
+		{
+			return HalfDuplexPeriodMicros - DuplexElapsed;
+		}
+		else
+		{
+			return DuplexPeriodMicros - DuplexElapsed + HalfDuplexPeriodMicros;
+		}
+	}
+
+	//For the largest frame, when the next packet's size isn't known.
+	uint32_t GetMicrosUntilSendSlotStart()
+	{
+		if (IsInSendSlot(GetSendGuardMicros(LOLA_PACKET_MAX_FRAME_SIZE)))
+		{
+			return 0;
+		}
+
+		return GetMicrosUntilNextSendSlotStart();
+	}
+
+	//The whole frame must be out before the partner's slot starts.
+	bool IsInSendSlot(const uint32_t guardMicros)
+	{
+		DuplexElapsed = SyncedClock.GetSyncMicros() % DuplexPeriodMicros;
 
 		//Even spread of true and false across the DuplexPeriod.
 		if (EvenSlot)
 		{
-			if (DuplexElapsed <= (HalfDuplexPeriodMicros - ETTM))
+			if (DuplexElapsed + guardMicros <= HalfDuplexPeriodMicros)
 			{
 				return true;
 			}
@@ -498,7 +1564,7 @@ private:
 		else
 		{
 			if ((DuplexElapsed >= HalfDuplexPeriodMicros) &&
-				DuplexElapsed <= (DuplexPeriodMicros - ETTM))
+				DuplexElapsed + guardMicros <= DuplexPeriodMicros)
 			{
 				return true;
 			}
@@ -507,5 +1573,24 @@ private:
 		return false;
 	}
 
+	//Raw time left in our half-slot, no guard.
+	uint32_t GetMicrosUntilHalfSlotEnd()
+	{
+		DuplexElapsed = SyncedClock.GetSyncMicros() % DuplexPeriodMicros;
+
+		if (EvenSlot)
+		{
+			if (DuplexElapsed < HalfDuplexPeriodMicros)
+			{
+				return HalfDuplexPeriodMicros - DuplexElapsed;
+			}
+		}
+		else if (DuplexElapsed >= HalfDuplexPeriodMicros)
+		{
+			return DuplexPeriodMicros - DuplexElapsed;
+		}
+
+		return 0;
+	}
 };
 #endif
\ No newline at end of file
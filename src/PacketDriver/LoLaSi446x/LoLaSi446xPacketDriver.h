@@ -38,9 +38,31 @@ private:
 	static const int16_t SI4463_RSSI_MIN = -110;
 	static const int16_t SI4463_RSSI_MAX = -80;
 
+	//Approximate supply current, TX at SI4463_TRANSMIT_POWER_MAX. Sleep keeps the wake up timer running.
+	static const uint32_t SI4463_RECEIVING_CURRENT_MICRO_AMPS = 13700;
+	static const uint32_t SI4463_TRANSMITTING_CURRENT_MICRO_AMPS = 40000;
+	static const uint32_t SI4463_SLEEPING_CURRENT_MICRO_AMPS = 1;
+
+	//Physical layer of the radio_config.h generated from config_lfch_433_27_ISM.xml, update both together.
+	//Data rate is nudDataRate (100 kbps), preamble is nudPreambleTxLength (8 bytes).
+	//Overhead: preamble (8), sync word (2), length field (1), radio CRC (2).
+	static const uint32_t SI4463_DATA_RATE_BITS_PER_SECOND = 100000;
+	static const uint8_t SI4463_FRAME_OVERHEAD_BYTES = 13;
+	//SPI FIFO load and RX to TX turn around.
+	static const uint32_t SI4463_TRANSMIT_START_MICROS = 150;
+
+	//A full frame, with FEC tag, must fit in a half duplex slot at this data rate.
+	static_assert((SI4463_TRANSMIT_START_MICROS +
+		((((uint32_t)SI4463_FRAME_OVERHEAD_BYTES + LOLA_PACKET_MAX_FRAME_SIZE + LOLA_PACKET_FEC_TAG_SIZE) * 8 * (uint32_t)1000000) / SI4463_DATA_RATE_BITS_PER_SECOND))
+		< ((uint32_t)ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS * 500), "Si4463 frame airtime doesn't fit the half duplex slot, check the radio config data rate.");
+
 	//Interrupt handling helper.
 	volatile uint8_t InterruptStatus = 0xFF;
 
+#ifdef LOLA_MOCK_RADIO
+	uint8_t MockSampleChannel = 0;
+#endif
+
 protected:
 
 	void DisableInterrupts()
@@ -88,6 +110,37 @@ protected:
 #endif
 	}
 
+	void SetToSampling(const uint8_t channel)
+	{
+#ifdef LOLA_MOCK_RADIO
+		MockSampleChannel = channel;
+#else
+		Si446x_RX(channel);
+#endif
+	}
+
+	void SetToSleep()
+	{
+#ifndef LOLA_MOCK_RADIO
+		Si446x_sleep();
+#endif
+	}
+
+	int16_t ReadRSSI()
+	{
+#ifdef LOLA_MOCK_RADIO
+#ifdef LOLA_MOCK_INTERFERENCE_CHANNEL_MASK
+		if ((LOLA_MOCK_INTERFERENCE_CHANNEL_MASK >> (MockSampleChannel - SI4463_CHANNEL_MIN)) & 1)
+		{
+			return SI4463_RSSI_MAX;
+		}
+#endif
+		return SI4463_RSSI_MIN + random(0, 5);
+#else
+		return Si446x_getRSSI();
+#endif
+	}
+
 	bool SetupRadio()
 	{
 #ifdef LOLA_MOCK_RADIO
@@ -166,6 +219,36 @@ public:
 		return SI4463_RSSI_MIN;
 	}
 
+	uint32_t GetReceivingCurrentMicroAmps() const
+	{
+		return SI4463_RECEIVING_CURRENT_MICRO_AMPS;
+	}
+
+	uint32_t GetTransmittingCurrentMicroAmps() const
+	{
+		return SI4463_TRANSMITTING_CURRENT_MICRO_AMPS;
+	}
+
+	uint32_t GetSleepingCurrentMicroAmps() const
+	{
+		return SI4463_SLEEPING_CURRENT_MICRO_AMPS;
+	}
+
+	uint32_t GetDataRateBitsPerSecond() const
+	{
+		return SI4463_DATA_RATE_BITS_PER_SECOND;
+	}
+
+	uint8_t GetFrameOverheadBytes() const
+	{
+		return SI4463_FRAME_OVERHEAD_BYTES;
+	}
+
+	uint32_t GetTransmitStartMicros() const
+	{
+		return SI4463_TRANSMIT_START_MICROS;
+	}
+
 	uint8_t GetChannelMax() const
 	{
 		return SI4463_CHANNEL_MAX;
@@ -0,0 +1,128 @@
+// SendSlotEventTask.h
+
+#ifndef _SENDSLOTEVENTTASK_h
+#define _SENDSLOTEVENTTASK_h
+
+#define _TASK_OO_CALLBACKS
+#include <TaskSchedulerDeclarations.h>
+
+#include <LoLaDefinitions.h>
+
+//Fail safe, in case the driver never wakes us up after being busy.
+#define SEND_SLOT_EVENT_BUSY_CHECK_PERIOD_MILLIS	(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS)
+
+//Shorter waits (e.g. the inter-frame gap) re-check on the next scheduler pass, a 1 ms delay would be longer than the wait.
+#define SEND_SLOT_EVENT_YIELD_MAX_MICROS			(uint32_t)(LOLA_PACKET_DRIVER_INTER_FRAME_GAP_MICROS)
+
+class ISendSlotEventSource
+{
+public:
+	//0 if allowed to send now, ILOLA_INVALID_MICROS if busy until further notice.
+	virtual uint32_t GetMicrosUntilSendSlot() { return 0; }
+	virtual void OnSendSlotEvent() {}
+};
+
+//Sleeps until the next send slot opens, instead of everyone polling AllowedSend().
+class SendSlotEventTask : Task
+{
+private:
+	ISendSlotEventSource* Source = nullptr;
+	bool Requested = false;
+
+	uint32_t EventCount = 0;
+	uint32_t WakeCount = 0;
+
+	//Helper.
+	uint32_t WaitMicros = 0;
+
+public:
+	SendSlotEventTask(Scheduler* scheduler, ISendSlotEventSource* source)
+		: Task(0, TASK_FOREVER, scheduler, false)
+	{
+		Source = source;
+	}
+
+	void Request()
+	{
+		if (!Requested)
+		{
+			Requested = true;
+			enableIfNot();
+			forceNextIteration();
+		}
+	}
+
+	//Driver is ready again, re-evaluate now.
+	void Wake()
+	{
+		if (Requested)
+		{
+			forceNextIteration();
+		}
+	}
+
+	bool IsRequested()
+	{
+		return Requested;
+	}
+
+	void Clear()
+	{
+		Requested = false;
+		disable();
+	}
+
+	uint32_t GetEventCount()
+	{
+		return EventCount;
+	}
+
+	uint32_t GetWakeCount()
+	{
+		return WakeCount;
+	}
+
+	bool Callback()
+	{
+		if (!Requested)
+		{
+			disable();
+
+			return false;
+		}
+
+		WakeCount++;
+		WaitMicros = Source->GetMicrosUntilSendSlot();
+
+		if (WaitMicros == 0)
+		{
+			Requested = false;
+			EventCount++;
+			Source->OnSendSlotEvent();
+			if (!Requested)
+			{
+				disable();
+			}
+
+			return true;
+		}
+
+		if (WaitMicros == ILOLA_INVALID_MICROS)
+		{
+			Task::delay(SEND_SLOT_EVENT_BUSY_CHECK_PERIOD_MILLIS);
+		}
+		else if (WaitMicros <= SEND_SLOT_EVENT_YIELD_MAX_MICROS)
+		{
+			//Other tasks still run in between.
+			forceNextIteration();
+		}
+		else
+		{
+			//Rounded up, waking up early is a wasted run.
+			Task::delay((WaitMicros + 999) / 1000);
+		}
+
+		return false;
+	}
+};
+#endif
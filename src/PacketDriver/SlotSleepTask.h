@@ -0,0 +1,71 @@
+// SlotSleepTask.h
+
+#ifndef _SLOTSLEEPTASK_h
+#define _SLOTSLEEPTASK_h
+
+#define _TASK_OO_CALLBACKS
+#include <TaskSchedulerDeclarations.h>
+
+#include <LoLaDefinitions.h>
+
+class ISlotSleepSource
+{
+public:
+	//Puts the radio to sleep or wakes it up, returns micros until the next check.
+	virtual uint32_t OnSlotSleepCheck() { return ILOLA_INVALID_MICROS; }
+};
+
+//Runs twice per duplex period while linked: at our slot start and just before the partner's.
+class SlotSleepTask : Task
+{
+private:
+	ISlotSleepSource* Source = nullptr;
+
+	//Helper.
+	uint32_t NextCheckMicros = 0;
+
+public:
+	SlotSleepTask(Scheduler* scheduler, ISlotSleepSource* source)
+		: Task(0, TASK_FOREVER, scheduler, false)
+	{
+		Source = source;
+	}
+
+	void Start()
+	{
+		enableIfNot();
+		forceNextIteration();
+	}
+
+	void Stop()
+	{
+		disable();
+	}
+
+	//Something changed, like a service waiting to send.
+	void Wake()
+	{
+		if (isEnabled())
+		{
+			forceNextIteration();
+		}
+	}
+
+	bool Callback()
+	{
+		NextCheckMicros = Source->OnSlotSleepCheck();
+
+		if (NextCheckMicros == ILOLA_INVALID_MICROS)
+		{
+			disable();
+
+			return false;
+		}
+
+		//Rounded down, the radio must be awake in time.
+		Task::delay(max((uint32_t)1, NextCheckMicros / 1000));
+
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,183 @@
+// UrgentPacketDispatcher.h
+
+#ifndef _URGENTPACKETDISPATCHER_h
+#define _URGENTPACKETDISPATCHER_h
+
+#include <Packet\LoLaPacket.h>
+#include <LoLaDefinitions.h>
+
+class ILoLaUrgentHandler
+{
+public:
+	//Called from the radio's receive callback, with interrupts masked.
+	//Copy what's needed and return: no Serial, no sends, no blocking.
+	//Frames that missed the cut-through arrive here from the async path instead.
+	virtual void OnUrgentPacket(ILoLaPacket* packet) {}
+};
+
+//Fixed table of handlers for urgent headers, served before the async path.
+//The budget is enforced: a handler that runs over it is demoted to the async path.
+class UrgentPacketDispatcher
+{
+private:
+	ILoLaUrgentHandler* Handlers[LOLA_PACKET_DRIVER_URGENT_HANDLERS_SIZE];
+	uint8_t Headers[LOLA_PACKET_DRIVER_URGENT_HANDLERS_SIZE];
+	bool Demoted[LOLA_PACKET_DRIVER_URGENT_HANDLERS_SIZE];
+	uint8_t Count = 0;
+
+	//Largest frame worth decoding in the callback, bigger ones can't be urgent.
+	uint8_t MaxFrameSize = 0;
+
+	//Statistics.
+	volatile uint32_t DispatchCount = 0;
+	volatile uint32_t OverBudgetCount = 0;
+	volatile uint32_t MaxDurationMicros = 0;
+	uint32_t FallbackCount = 0;
+
+	//Helpers.
+	uint32_t DurationMicros = 0;
+	uint8_t Index = 0;
+
+private:
+	//Returns Count if there's no handler for the header.
+	uint8_t GetIndex(const uint8_t header)
+	{
+		for (Index = 0; Index < Count; Index++)
+		{
+			if (Headers[Index] == header)
+			{
+				break;
+			}
+		}
+
+		return Index;
+	}
+
+public:
+	UrgentPacketDispatcher()
+	{
+		for (uint8_t i = 0; i < LOLA_PACKET_DRIVER_URGENT_HANDLERS_SIZE; i++)
+		{
+			Handlers[i] = nullptr;
+			Headers[i] = 0;
+			Demoted[i] = false;
+		}
+	}
+
+	bool Add(PacketDefinition* definition, ILoLaUrgentHandler* handler)
+	{
+		if (definition == nullptr ||
+			handler == nullptr ||
+			!definition->IsUrgent() ||
+			Count >= LOLA_PACKET_DRIVER_URGENT_HANDLERS_SIZE ||
+			GetIndex(definition->GetHeader()) < Count)
+		{
+			return false;
+		}
+
+		Headers[Count] = definition->GetHeader();
+		Handlers[Count] = handler;
+		Demoted[Count] = false;
+		Count++;
+
+		//With room for a piggybacked ack.
+		MaxFrameSize = max(MaxFrameSize, (uint8_t)(definition->GetFrameSize() + LOLA_PACKET_ACK_TAIL_SIZE));
+
+		return true;
+	}
+
+	inline bool IsEmpty()
+	{
+		return Count == 0;
+	}
+
+	inline bool Accepts(const uint8_t frameSize)
+	{
+		return Count > 0 && frameSize <= MaxFrameSize;
+	}
+
+	bool Handles(const uint8_t header)
+	{
+		return GetIndex(header) < Count;
+	}
+
+	//Handled and still within budget.
+	bool CutsThrough(const uint8_t header)
+	{
+		return GetIndex(header) < Count && !Demoted[Index];
+	}
+
+	//From the receive callback, returns true if a handler took the packet.
+	bool Dispatch(ILoLaPacket* packet, const uint32_t startMicros)
+	{
+		if (!CutsThrough(packet->GetDataHeader()))
+		{
+			return false;
+		}
+
+		Handlers[Index]->OnUrgentPacket(packet);
+
+		DurationMicros = micros() - startMicros;
+		DispatchCount++;
+		MaxDurationMicros = max(MaxDurationMicros, DurationMicros);
+		if (DurationMicros > LOLA_PACKET_DRIVER_URGENT_BUDGET_MICROS)
+		{
+			//Too slow for the callback, served from the async path from now on.
+			OverBudgetCount++;
+			Demoted[Index] = true;
+		}
+
+		return true;
+	}
+
+	//From the async path, for frames that missed the cut-through.
+	bool DispatchFallback(ILoLaPacket* packet)
+	{
+		if (!Handles(packet->GetDataHeader()))
+		{
+			return false;
+		}
+
+		Handlers[Index]->OnUrgentPacket(packet);
+		FallbackCount++;
+
+		return true;
+	}
+
+	uint32_t GetDispatchCount()
+	{
+		return DispatchCount;
+	}
+
+	uint32_t GetFallbackCount()
+	{
+		return FallbackCount;
+	}
+
+	//Handlers demoted for running over budget.
+	uint32_t GetOverBudgetCount()
+	{
+		return OverBudgetCount;
+	}
+
+	//Read, decode and handler, from the receive callback.
+	uint32_t GetMaxDurationMicros()
+	{
+		return MaxDurationMicros;
+	}
+
+#ifdef DEBUG_LOLA
+	void Debug(Stream* serial)
+	{
+		serial->print(F("Urgent: "));
+		serial->print(DispatchCount);
+		serial->print(F(" fallback: "));
+		serial->print(FallbackCount);
+		serial->print(F(" max: "));
+		serial->print(MaxDurationMicros);
+		serial->print(F(" us over budget: "));
+		serial->println(OverBudgetCount);
+	}
+#endif
+};
+#endif
@@ -0,0 +1,143 @@
+// AgeOfInformation.h
+
+#ifndef _AGE_OF_INFORMATION_h
+#define _AGE_OF_INFORMATION_h
+
+#include <Arduino.h>
+#include <LoLaDefinitions.h>
+#include <LoLaClock\ILoLaClockSource.h>
+
+#define LOLA_AOI_STAMP_SIZE			2
+
+//Receiver side freshness of a remote value: how old is the newest sample we hold.
+//Senders put a synced clock stamp of when the value was sampled in the payload.
+//Age grows between updates and drops on each fresher one, the average is over time, not over packets.
+class AgeOfInformation
+{
+private:
+	uint32_t LastUpdateMillis = ILOLA_INVALID_MILLIS;
+	uint32_t LastAgeMillis = 0;
+
+	//Area under the age sawtooth, over the observed time.
+	uint64_t AgeAreaMillis = 0;
+	uint32_t ObservedMillis = 0;
+
+	//Statistics.
+	uint32_t PeakAgeMillis = 0;
+	uint32_t UpdateCount = 0;
+	uint32_t StaleCount = 0;
+
+	//Helpers.
+	uint32_t Elapsed = 0;
+	uint16_t Age = 0;
+
+public:
+	AgeOfInformation() {}
+
+	static void WriteStamp(uint8_t* target, ILoLaClockSource* syncedClock)
+	{
+		const uint16_t stamp = GetStamp(syncedClock);
+
+		target[0] = stamp & 0xFF;
+		target[1] = stamp >> 8;
+	}
+
+	void Reset()
+	{
+		LastUpdateMillis = ILOLA_INVALID_MILLIS;
+		LastAgeMillis = 0;
+		AgeAreaMillis = 0;
+		ObservedMillis = 0;
+		PeakAgeMillis = 0;
+		UpdateCount = 0;
+		StaleCount = 0;
+	}
+
+	//Returns false if the sample is older than the one we already hold.
+	bool OnReceived(const uint8_t* stamp, ILoLaClockSource* syncedClock)
+	{
+		Age = GetStamp(syncedClock) - (stamp[0] | ((uint16_t)stamp[1] << 8));
+
+		if (LastUpdateMillis == ILOLA_INVALID_MILLIS)
+		{
+			LastUpdateMillis = millis();
+			LastAgeMillis = Age;
+			UpdateCount++;
+
+			return true;
+		}
+
+		Elapsed = millis() - LastUpdateMillis;
+
+		if (Age >= LastAgeMillis + Elapsed)
+		{
+			StaleCount++;
+
+			return false;
+		}
+
+		AgeAreaMillis += ((uint64_t)LastAgeMillis * Elapsed) + (((uint64_t)Elapsed * Elapsed) / 2);
+		ObservedMillis += Elapsed;
+		PeakAgeMillis = max(PeakAgeMillis, LastAgeMillis + Elapsed);
+
+		LastUpdateMillis = millis();
+		LastAgeMillis = Age;
+		UpdateCount++;
+
+		return true;
+	}
+
+	uint32_t GetCurrentAgeMillis()
+	{
+		if (LastUpdateMillis == ILOLA_INVALID_MILLIS)
+		{
+			return ILOLA_INVALID_MILLIS;
+		}
+
+		return LastAgeMillis + (millis() - LastUpdateMillis);
+	}
+
+	uint32_t GetAverageAgeMillis()
+	{
+		if (ObservedMillis == 0)
+		{
+			return LastAgeMillis;
+		}
+
+		return (uint32_t)(AgeAreaMillis / ObservedMillis);
+	}
+
+	uint32_t GetPeakAgeMillis()
+	{
+		return PeakAgeMillis;
+	}
+
+	uint32_t GetUpdateCount()
+	{
+		return UpdateCount;
+	}
+
+	uint32_t GetStaleCount()
+	{
+		return StaleCount;
+	}
+
+#ifdef DEBUG_LOLA
+	void Debug(Stream* serial)
+	{
+		serial->print(F("AoI average: "));
+		serial->print(GetAverageAgeMillis());
+		serial->print(F(" ms peak: "));
+		serial->print(PeakAgeMillis);
+		serial->print(F(" ms stale: "));
+		serial->println(StaleCount);
+	}
+#endif
+
+private:
+	static uint16_t GetStamp(ILoLaClockSource* syncedClock)
+	{
+		return (uint16_t)(syncedClock->GetSyncMicros() / 1000);
+	}
+};
+#endif
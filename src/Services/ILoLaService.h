@@ -15,6 +15,11 @@
 #define LOLA_SERVICE_HOUR_PERIOD_MILLIS 3600000
 #define LOLA_SERVICE_LONG_SLEEP_PERIOD_MILLIS 30000
 
+//Fallback, for drivers that don't publish send slot events.
+#define LOLA_SERVICE_SEND_SLOT_POLL_PERIOD_MILLIS	(uint32_t)1
+//Fail safe, in case a send slot event never comes.
+#define LOLA_SERVICE_SEND_SLOT_WAIT_MAX_MILLIS		(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*2)
+
 class ILoLaService : Task
 {
 private:
@@ -28,6 +33,10 @@ private:
 
 	uint16_t DefaultPeriod = 0;
 
+	//Waiting for the driver's send slot event.
+	bool WaitingForSendSlot = false;
+	uint32_t SendSlotWakeCount = 0;
+
 protected:
 	ILoLaDriver* LoLaDriver;
 
@@ -79,15 +88,23 @@ public:
 
 	bool Init()
 	{
-		if (OnAddPacketMap(LoLaDriver->GetPacketMap()) && Setup())
-		{
-			return true;
-		}
-		else
+		//Headers mapped here are dispatched straight to this service.
+		LoLaDriver->GetPacketMap()->SetMappingOwner(this);
+
+		if (OnAddPacketMap(LoLaDriver->GetPacketMap()))
 		{
-			ServiceState = Failed;
-			return false;
+			LoLaDriver->GetPacketMap()->SetMappingOwner(nullptr);
+
+			if (Setup())
+			{
+				return true;
+			}
 		}
+
+		LoLaDriver->GetPacketMap()->SetMappingOwner(nullptr);
+		ServiceState = Failed;
+
+		return false;
 	}
 
 	virtual bool OnSetup() { return true; }
@@ -154,6 +171,32 @@ public:
 	virtual bool ProcessAckedPacket(ILoLaPacket* incomingPacket) { return false; }
 	virtual bool ProcessAck(const uint8_t header, const uint8_t id) { return false; }
 	virtual bool ProcessSent(const uint8_t header) { return false; }
+
+	//Accepted by SendPacket(), but dropped before it went on air.
+	virtual bool ProcessSendFailed(const uint8_t header, const uint8_t id) { return false; }
+
+	//Driver event, only wakes the service if it was waiting for it.
+	void OnSendSlotOpen()
+	{
+		if (WaitingForSendSlot)
+		{
+			WaitingForSendSlot = false;
+			SendSlotWakeCount++;
+			SetNextRunASAP();
+		}
+	}
+
+	//Scheduler runs since the service was last enabled.
+	uint32_t GetWakeCount()
+	{
+		return getRunCounter();
+	}
+
+	uint32_t GetSendSlotWakeCount()
+	{
+		return SendSlotWakeCount;
+	}
+
 	virtual void OnLinkEstablished() {}
 	virtual void OnLinkLost() {}
 	virtual bool OnEnable() { return true; }
@@ -194,6 +237,20 @@ protected:
 		forceNextIteration();
 	}
 
+	//Sleeps until the driver says AllowedSend() is worth checking again, or the time out.
+	void SetNextRunOnSendSlot(const uint32_t timeOutMillis = LOLA_SERVICE_SEND_SLOT_WAIT_MAX_MILLIS)
+	{
+		if (LoLaDriver->RequestSendSlotEvent())
+		{
+			WaitingForSendSlot = true;
+			Task::delay(constrain(timeOutMillis, (uint32_t)1, LOLA_SERVICE_SEND_SLOT_WAIT_MAX_MILLIS));
+		}
+		else
+		{
+			Task::delay(LOLA_SERVICE_SEND_SLOT_POLL_PERIOD_MILLIS);
+		}
+	}
+
 	LoLaPacketMap * GetPacketMap()
 	{
 		return LoLaDriver->GetPacketMap();
@@ -204,6 +261,11 @@ protected:
 		return LoLaDriver->AllowedSend();
 	}
 
+	inline bool AllowedSend(ILoLaPacket* outgoingPacket)
+	{
+		return LoLaDriver->AllowedSend(outgoingPacket->GetTotalSize());
+	}
+
 	inline bool SendPacket(ILoLaPacket* outgoingPacket)
 	{
 		return LoLaDriver->SendPacket(outgoingPacket);
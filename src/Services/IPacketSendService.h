@@ -12,8 +12,6 @@
 #define LOLA_SEND_SERVICE_DELAYED_MAX_DUPLEX				10 // [2 ; UINT8_MAX]
 #define LOLA_SEND_SERVICE_DENIED_MAX_FAILS					3
 
-
-#define LOLA_SEND_SERVICE_CHECK_PERIOD_MILLIS				(uint32_t)1
 #define LOLA_SEND_SERVICE_SEND_TIMEOUT_DEFAULT_MILLIS		(uint8_t)(LOLA_SEND_SERVICE_DELAYED_MAX_DUPLEX*ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS)
 #define LOLA_SEND_SERVICE_REPLY_TIMEOUT_DEFAULT_MILLIS		(uint8_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS)
 
@@ -39,6 +37,12 @@ private:
 	uint8_t SendTimeOutDuration = 0;
 	uint8_t AckTimeOutDuration = 0;
 
+	//Latest value wins, packet is rendered when the slot is granted.
+	bool RenderAtSend = false;
+	bool RenderPending = false;
+	uint32_t SupersededCount = 0;
+	uint32_t ExpiredCount = 0;
+
 protected:
 	ILoLaPacket * Packet = nullptr;
 
@@ -58,6 +62,7 @@ protected:
 	virtual void OnSendDelayed() { }
 	virtual void OnSendRetrying() { }
 	virtual void OnPreSend() { }
+	virtual void OnRenderLatest() { }
 	virtual bool OnEnable() { return true; }
 	virtual void OnDisable() { }
 	virtual bool OnSetup()
@@ -88,6 +93,22 @@ public:
 		return false;
 	}
 
+	bool ProcessSendFailed(const uint8_t header, const uint8_t id)
+	{
+		if (HasSendPendingInternal() &&
+			Packet->GetDataHeader() == header &&
+			Packet->GetId() == id &&
+			SendStatus == SendStatusEnum::WaitingForSentOk)
+		{
+			//Dropped by the driver, no need to wait for the time out.
+			SendStatus = SendStatusEnum::SendFailed;
+			SetNextRunASAP();
+			return true;
+		}
+
+		return false;
+	}
+
 	bool Callback()
 	{
 		//Ensure we only deal with sending if there's request pending, otherwise yeald back to main service.
@@ -103,19 +124,30 @@ public:
 			if (SendStartMillis == ILOLA_INVALID_MILLIS ||
 				((millis() - SendStartMillis) > SendTimeOutDuration))
 			{
+				if (RenderAtSend)
+				{
+					//Past its deadline, it's dropped rather than sent late.
+					ExpiredCount++;
+				}
 				OnSendTimedOut();
 				ClearSendRequest();
 				break;
 			}
 
-			if (!AllowedSend())
+			if (!AllowedSend(Packet))
 			{
+				//Sleep until the slot opens, or the send times out.
+				SetNextRunOnSendSlot(GetSendTimeOutRemaining());
 				//Give an opportunity for the service to update the packet, if needed.
-				SetNextRunDelay(LOLA_SEND_SERVICE_CHECK_PERIOD_MILLIS);
 				OnSendDelayed();
 				break;
 			}
 
+			if (RenderAtSend)
+			{
+				OnRenderLatest();
+			}
+
 			//Last minute fast stuff.
 			OnPreSend();
 
@@ -123,7 +155,7 @@ public:
 			if (SendPacket(Packet))
 			{
 				SendStatus = SendStatusEnum::WaitingForSentOk;
-				SetNextRunDelay(SendTimeOutDuration - constrain(millis() - SendStartMillis, 0, SendTimeOutDuration));
+				SetNextRunDelay(GetSendTimeOutRemaining());
 			}
 			else
 			{
@@ -135,7 +167,7 @@ public:
 				}
 				else
 				{
-					SetNextRunDelay(LOLA_SEND_SERVICE_CHECK_PERIOD_MILLIS);
+					SetNextRunOnSendSlot(GetSendTimeOutRemaining());
 					OnSendRetrying();
 				}
 			}
@@ -185,6 +217,9 @@ protected:
 	void RequestSendPacket(const uint8_t sendTimeOutDurationMillis = LOLA_SEND_SERVICE_SEND_TIMEOUT_DEFAULT_MILLIS,
 		const uint8_t ackReplyTimeOutDurationMillis = LOLA_SEND_SERVICE_REPLY_TIMEOUT_DEFAULT_MILLIS)
 	{
+		RenderAtSend = false;
+		RenderPending = false;
+
 		if (HasSendPendingInternal())
 		{
 			SendStartMillis = millis();
@@ -197,6 +232,51 @@ protected:
 		SetNextRunASAP();
 	}
 
+	//Packet content is rendered in OnRenderLatest(), when the slot is granted.
+	//Requests while one is pending supersede it, nothing is queued.
+	//The deadline counts from the latest request, after it the packet is dropped.
+	void RequestSendLatest(const uint8_t deadlineMillis = LOLA_SEND_SERVICE_SEND_TIMEOUT_DEFAULT_MILLIS,
+		const uint8_t ackReplyTimeOutDurationMillis = LOLA_SEND_SERVICE_REPLY_TIMEOUT_DEFAULT_MILLIS)
+	{
+		if (RenderAtSend && HasSendPendingInternal())
+		{
+			switch (SendStatus)
+			{
+			case SendStatusEnum::Done:
+				break;
+			case SendStatusEnum::SendingPacket:
+				//Still waiting for the slot, will be rendered fresh anyway.
+				SupersededCount++;
+				SendStartMillis = millis();
+				SendTimeOutDuration = deadlineMillis;
+				return;
+			default:
+				//In flight, go again as soon as it's done.
+				SupersededCount++;
+				RenderPending = true;
+				return;
+			}
+		}
+
+		RequestSendPacket(deadlineMillis, ackReplyTimeOutDurationMillis);
+		RenderAtSend = true;
+	}
+
+	uint32_t GetSupersededCount()
+	{
+		return SupersededCount;
+	}
+
+	uint32_t GetExpiredCount()
+	{
+		return ExpiredCount;
+	}
+
+	uint32_t GetSendTimeOutRemaining()
+	{
+		return SendTimeOutDuration - constrain(millis() - SendStartMillis, 0, SendTimeOutDuration);
+	}
+
 	bool HasSendPending()
 	{
 		return HasSendPendingInternal();
@@ -204,6 +284,18 @@ protected:
 
 	void ClearSendRequest()
 	{
+		if (RenderPending && HasSendPendingInternal())
+		{
+			//Superseded while in flight, the packet goes again with the latest value.
+			RenderPending = false;
+			SendStartMillis = millis();
+			SendFailures = 0;
+			SendStatus = SendStatusEnum::SendingPacket;
+			SetNextRunASAP();
+			return;
+		}
+
+		RenderPending = false;
 		Packet->ClearDefinition();
 		SendStartMillis = ILOLA_INVALID_MILLIS;
 		SendStatus = SendStatusEnum::Done;
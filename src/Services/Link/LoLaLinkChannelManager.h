@@ -6,25 +6,88 @@
 #include <ILoLaDriver.h>
 #include <Services\Link\LoLaLinkDefinitions.h>
 
+#define LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS			(uint8_t)(32) //Channel mask is 32 bits wide.
+#define LOLA_LINK_CHANNEL_MANAGER_MIN_CHANNELS			(uint8_t)(4) //Never blacklist below this count.
+
+#define LOLA_LINK_CHANNEL_QUALITY_MAX					(uint8_t)(UINT8_MAX)
+#define LOLA_LINK_CHANNEL_QUALITY_BLACKLIST_LOW			(uint8_t)(64) //Blacklist when below.
+#define LOLA_LINK_CHANNEL_QUALITY_BLACKLIST_HIGH		(uint8_t)(128) //Whitelist again when above.
+#define LOLA_LINK_CHANNEL_QUALITY_FILTER_SHIFT			(uint8_t)(2) //EWMA weight of 1/4 for each new sample.
+#define LOLA_LINK_CHANNEL_QUALITY_RECOVERY_STEP			(uint8_t)(2) //Blacklisted channels slowly recover, so they get retried.
+
+//Mask changes are scheduled ahead, so both partners switch at the same synced hop.
+#define LOLA_LINK_CHANNEL_MASK_SWITCH_OVER_HOPS			(uint8_t)(2 + ((LOLA_LINK_SERVICE_LINKED_INFO_UPDATE_PERIOD * 2) / LOLA_LINK_SERVICE_LINKED_TIMED_HOP_PERIOD_MILLIS))
+
 class LoLaLinkChannelManager
 {
 private:
-	LoLaLinkInfo* LinkInfo = nullptr;
 	ILoLaDriver* LoLaDriver = nullptr;
 
+	uint8_t ChannelCount = 0;
+
+	//Per channel tracking.
+	struct ChannelQualityType
+	{
+		uint8_t DeliveryRatio = LOLA_LINK_CHANNEL_QUALITY_MAX;
+		uint8_t Noise = 0;
+	} ChannelQuality[LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS];
+
+	//Hop sampling helpers.
+	bool HopSampleValid = false;
+	uint32_t LastReceivedCount = 0;
+	uint32_t LastRejectedCount = 0;
+	uint8_t CurrentHopNumber = 0;
+
+	//Bit set means channel is blacklisted, index 0 is ChannelMin.
+	uint32_t LocalMask = 0;
+	uint32_t PartnerMask = 0;
+	uint32_t AgreedMask = 0;
+	uint8_t AgreedMaskHop = 0;
+	uint32_t PendingMask = 0;
+	uint8_t PendingMaskHop = 0;
+	bool MaskPending = false;
+
+	//Host only switches once the remote has echoed the pending mask hop.
+	bool MaskConfirmed = false;
+
+	//Lookup for the hop mapping, rebuilt on mask change.
+	uint8_t AllowedChannels[LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS];
+	uint8_t AllowedCount = 0;
+
+	//Helpers.
+	uint32_t ReceivedDelta = 0;
+	uint32_t RejectedDelta = 0;
+
 public:
 	LoLaLinkChannelManager() {}
 
 	void ResetChannel()
 	{
+		ResetHopMask();
 		LoLaDriver->SetChannel((LoLaDriver->GetChannelMin() + LoLaDriver->GetChannelMax()) / 2);
 	}
 
-	//Hop index from 0 to UINT8_MAX
-	void SetNextHop(const uint8_t hopIndex)
+	//Token from 0 to UINT8_MAX, mapped only to non-blacklisted channels.
+	void SetNextHop(const uint8_t token, const uint8_t hopNumber)
 	{
-		LoLaDriver->SetChannel((hopIndex % (LoLaDriver->GetChannelMax() + 1 - LoLaDriver->GetChannelMin()))
-			+ LoLaDriver->GetChannelMin());
+		CurrentHopNumber = hopNumber;
+
+		if (MaskPending && ((int8_t)(CurrentHopNumber - PendingMaskHop) >= 0))
+		{
+			if (MaskConfirmed)
+			{
+				MaskPending = false;
+				AgreedMaskHop = PendingMaskHop;
+				ApplyMask(PendingMask);
+			}
+			else
+			{
+				//Remote may not have the mask, keep hopping on the old one and reschedule.
+				PendingMaskHop = GetSwitchOverHop();
+			}
+		}
+
+		LoLaDriver->SetChannel(AllowedChannels[token % AllowedCount]);
 
 #if defined(DEBUG_LOLA) && defined(DEBUG_LINK_FREQUENCY_HOP)
 		Serial.print(F("Hop: "));
@@ -32,11 +95,282 @@ public:
 #endif
 	}
 
+	//Sample the channel we are leaving, from the driver statistics accumulated during the hop.
+	void OnHopEnd(const uint32_t hopDurationMillis)
+	{
+		if (!HopSampleValid ||
+			LoLaDriver->GetReceivedCount() < LastReceivedCount ||
+			LoLaDriver->GetRejectedCount() < LastRejectedCount)
+		{
+			SnapshotCounters();
+			HopSampleValid = true;
+			return;
+		}
+
+		ReceivedDelta = LoLaDriver->GetReceivedCount() - LastReceivedCount;
+		RejectedDelta = LoLaDriver->GetRejectedCount() - LastRejectedCount;
+		SnapshotCounters();
+
+		ChannelQualityType* quality = &ChannelQuality[GetChannelIndex(LoLaDriver->GetChannel())];
+
+		if (ReceivedDelta + RejectedDelta > 0)
+		{
+			AddQualitySample(quality, (uint8_t)((ReceivedDelta * LOLA_LINK_CHANNEL_QUALITY_MAX) / (ReceivedDelta + RejectedDelta)));
+
+			if (RejectedDelta > 0)
+			{
+				//Rejected packets with strong signal are a sign of interference.
+				quality->Noise = quality->Noise - (quality->Noise >> LOLA_LINK_CHANNEL_QUALITY_FILTER_SHIFT)
+					+ (LoLaDriver->NormalizeRSSI(LoLaDriver->GetLastRSSI()) >> LOLA_LINK_CHANNEL_QUALITY_FILTER_SHIFT);
+			}
+		}
+		else if (hopDurationMillis >= LOLA_LINK_SERVICE_LINKED_INFO_UPDATE_PERIOD)
+		{
+			//The link keeps reporting at least this often, silence means a dead channel.
+			AddQualitySample(quality, 0);
+		}
+
+		UpdateLocalMask();
+	}
+
+	uint8_t GetCurrentHopNumber()
+	{
+		return CurrentHopNumber;
+	}
+
+	uint8_t GetChannelDeliveryRatio(const uint8_t channel)
+	{
+		return ChannelQuality[GetChannelIndex(channel)].DeliveryRatio;
+	}
+
+	uint8_t GetChannelNoise(const uint8_t channel)
+	{
+		return ChannelQuality[GetChannelIndex(channel)].Noise;
+	}
+
+	uint32_t GetLocalMask()
+	{
+		return LocalMask;
+	}
+
+	//Latest mask, pending or in use.
+	uint32_t GetAgreedMask()
+	{
+		if (MaskPending)
+		{
+			return PendingMask;
+		}
+
+		return AgreedMask;
+	}
+
+	uint8_t GetAgreedMaskHop()
+	{
+		if (MaskPending)
+		{
+			return PendingMaskHop;
+		}
+
+		return AgreedMaskHop;
+	}
+
+	//Host side: the remote's report echoes the mask hop it will switch on.
+	void ConfirmMask(const uint8_t echoedMaskHop)
+	{
+		if (MaskPending && echoedMaskHop == PendingMaskHop)
+		{
+			MaskConfirmed = true;
+		}
+	}
+
+	bool IsMaskUnconfirmed()
+	{
+		return MaskPending && !MaskConfirmed;
+	}
+
+	void SetPartnerMask(const uint32_t partnerMask)
+	{
+		PartnerMask = partnerMask;
+	}
+
+	//Host side: merge the partner's blacklist with our own and schedule it.
+	//Returns true if a new mask was scheduled.
+	bool ProposeMask()
+	{
+		uint32_t proposed = (LocalMask | PartnerMask) & GetFullMask();
+
+		if (proposed == GetAgreedMask() ||
+			GetAllowedCount(proposed) < LOLA_LINK_CHANNEL_MANAGER_MIN_CHANNELS)
+		{
+			return false;
+		}
+
+		SetPendingMask(proposed, GetSwitchOverHop());
+		MaskConfirmed = false;
+
+		return true;
+	}
+
+	//Remote side: follow the host's mask, at the requested hop.
+	void SetPendingMask(const uint32_t mask, const uint8_t hopNumber)
+	{
+		if ((mask & GetFullMask()) == GetAgreedMask())
+		{
+			//Same mask, the host may have rescheduled it. Echo the latest hop.
+			if (MaskPending)
+			{
+				PendingMaskHop = hopNumber;
+			}
+			else
+			{
+				AgreedMaskHop = hopNumber;
+			}
+
+			return;
+		}
+
+		if (GetAllowedCount(mask & GetFullMask()) < LOLA_LINK_CHANNEL_MANAGER_MIN_CHANNELS)
+		{
+			return;
+		}
+
+		PendingMask = mask & GetFullMask();
+		PendingMaskHop = hopNumber;
+		MaskPending = true;
+		MaskConfirmed = true;
+	}
+
 	bool Setup(ILoLaDriver* loLa)
 	{
 		LoLaDriver = loLa;
 
-		return LoLaDriver != nullptr;
+		if (LoLaDriver != nullptr)
+		{
+			ChannelCount = min(LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS, LoLaDriver->GetChannelMax() + 1 - LoLaDriver->GetChannelMin());
+
+			for (uint8_t i = 0; i < LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS; i++)
+			{
+				ChannelQuality[i].DeliveryRatio = LOLA_LINK_CHANNEL_QUALITY_MAX;
+				ChannelQuality[i].Noise = 0;
+			}
+
+			LocalMask = 0;
+			ResetHopMask();
+
+			return ChannelCount > 0;
+		}
+
+		return false;
+	}
+
+private:
+	//Channel quality is kept between links, only the shared mask is reset.
+	void ResetHopMask()
+	{
+		HopSampleValid = false;
+		PartnerMask = 0;
+		MaskPending = false;
+		MaskConfirmed = false;
+		AgreedMaskHop = 0;
+		ApplyMask(0);
+	}
+
+	void ApplyMask(const uint32_t mask)
+	{
+		AgreedMask = mask;
+		AllowedCount = 0;
+
+		for (uint8_t i = 0; i < ChannelCount; i++)
+		{
+			if (!((AgreedMask >> i) & 1))
+			{
+				AllowedChannels[AllowedCount++] = LoLaDriver->GetChannelMin() + i;
+			}
+		}
+
+		if (AllowedCount == 0)
+		{
+			//Should never happen, mask is always validated.
+			AgreedMask = 0;
+			ApplyMask(0);
+		}
+	}
+
+	void UpdateLocalMask()
+	{
+		for (uint8_t i = 0; i < ChannelCount; i++)
+		{
+			if ((LocalMask >> i) & 1)
+			{
+				//Blacklisted channels aren't visited, let them recover to be retried.
+				if (ChannelQuality[i].DeliveryRatio < (LOLA_LINK_CHANNEL_QUALITY_MAX - LOLA_LINK_CHANNEL_QUALITY_RECOVERY_STEP))
+				{
+					ChannelQuality[i].DeliveryRatio += LOLA_LINK_CHANNEL_QUALITY_RECOVERY_STEP;
+				}
+
+				if (ChannelQuality[i].DeliveryRatio > LOLA_LINK_CHANNEL_QUALITY_BLACKLIST_HIGH)
+				{
+					LocalMask &= ~((uint32_t)1 << i);
+				}
+			}
+			else if (ChannelQuality[i].DeliveryRatio < LOLA_LINK_CHANNEL_QUALITY_BLACKLIST_LOW &&
+				GetAllowedCount(LocalMask | ((uint32_t)1 << i)) >= LOLA_LINK_CHANNEL_MANAGER_MIN_CHANNELS)
+			{
+				LocalMask |= ((uint32_t)1 << i);
+			}
+		}
+	}
+
+	inline void AddQualitySample(ChannelQualityType* quality, const uint8_t sample)
+	{
+		quality->DeliveryRatio = quality->DeliveryRatio - (quality->DeliveryRatio >> LOLA_LINK_CHANNEL_QUALITY_FILTER_SHIFT)
+			+ (sample >> LOLA_LINK_CHANNEL_QUALITY_FILTER_SHIFT);
+	}
+
+	inline void SnapshotCounters()
+	{
+		LastReceivedCount = LoLaDriver->GetReceivedCount();
+		LastRejectedCount = LoLaDriver->GetRejectedCount();
+	}
+
+	inline uint8_t GetChannelIndex(const uint8_t channel)
+	{
+		return min((uint8_t)(ChannelCount - 1), (uint8_t)(channel - LoLaDriver->GetChannelMin()));
+	}
+
+	//Never reuse the current mask hop, or a stale echo would confirm the new mask.
+	inline uint8_t GetSwitchOverHop()
+	{
+		if ((uint8_t)(CurrentHopNumber + LOLA_LINK_CHANNEL_MASK_SWITCH_OVER_HOPS) == AgreedMaskHop)
+		{
+			return CurrentHopNumber + LOLA_LINK_CHANNEL_MASK_SWITCH_OVER_HOPS + 1;
+		}
+
+		return CurrentHopNumber + LOLA_LINK_CHANNEL_MASK_SWITCH_OVER_HOPS;
+	}
+
+	inline uint32_t GetFullMask()
+	{
+		if (ChannelCount >= LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS)
+		{
+			return UINT32_MAX;
+		}
+
+		return ((uint32_t)1 << ChannelCount) - 1;
+	}
+
+	uint8_t GetAllowedCount(const uint32_t mask)
+	{
+		uint8_t count = 0;
+		for (uint8_t i = 0; i < ChannelCount; i++)
+		{
+			if (!((mask >> i) & 1))
+			{
+				count++;
+			}
+		}
+
+		return count;
 	}
 };
 #endif
@@ -14,11 +14,22 @@
 
 ///Link packet sizes.
 #define LOLA_LINK_SERVICE_PAYLOAD_SIZE_PING					0 //Only payload is Id.
-#define LOLA_LINK_SERVICE_PAYLOAD_SIZE_REPORT				3
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+#define LOLA_LINK_SERVICE_PAYLOAD_SIZE_REPORT				(5 + 1 + sizeof(uint32_t)) //Report + Hop number + Channel mask.
+#else
+#define LOLA_LINK_SERVICE_PAYLOAD_SIZE_REPORT				5
+#endif
 #define LOLA_LINK_SERVICE_PAYLOAD_SIZE_SHORT				(1 + sizeof(uint32_t))  //1 byte Sub-header + 4 byte payload for uint32.
 #define LOLA_LINK_SERVICE_PAYLOAD_SIZE_SHORT_WITH_ACK		(sizeof(uint32_t))	//4 byte encoded Partner Id.
 #define LOLA_LINK_SERVICE_PAYLOAD_SIZE_LONG					(1 + LoLaCryptoKeyExchanger::KEY_MAX_SIZE)  //1 byte Sub-header + key payload size.		
 
+//Link report payload: [RSSI|ReceivedCount0|ReceivedCount1|TransmitedCount0|TransmitedCount1|MaskHop|Mask0|Mask1|Mask2|Mask3]
+//Packet counters are the low 16 bits of the driver's counters, so they only alias past UINT16_MAX packets between reports.
+#define LOLA_LINK_REPORT_RECEIVED_COUNT_INDEX				1
+#define LOLA_LINK_REPORT_TRANSMITED_COUNT_INDEX				3
+#define LOLA_LINK_REPORT_CHANNEL_MASK_HOP_INDEX				5
+#define LOLA_LINK_REPORT_CHANNEL_MASK_INDEX					(LOLA_LINK_REPORT_CHANNEL_MASK_HOP_INDEX + 1)
+
 #define LOLA_LINK_SERVICE_PACKET_MAX_SIZE					(LOLA_PACKET_MIN_PACKET_SIZE + LOLA_LINK_SERVICE_PAYLOAD_SIZE_LONG)
 
 
@@ -26,6 +37,7 @@
 //Pre-Linking headers, with space for protocol versioning.
 #define LOLA_LINK_SUBHEADER_LINK_DISCOVERY					0x00 + LOLA_LINK_PROTOCOL_VERSION
 #define LOLA_LINK_SUBHEADER_HOST_ID_BROADCAST				0x10 + LOLA_LINK_PROTOCOL_VERSION
+#define LOLA_LINK_SUBHEADER_HOST_WAKE_BEACON				0x60 + LOLA_LINK_PROTOCOL_VERSION
 
 //Public Key Cryptography (PKC) headers.
 #define LOLA_LINK_SUBHEADER_HOST_PUBLIC_KEY					0x20
@@ -80,10 +92,11 @@ public:
 #endif
 };
 
+//Sized to the content: info sync packets and unlinked reports carry no channel mask.
 class LinkReportPacketDefinition : public PacketDefinition
 {
 public:
-	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_VARIABLE_SIZE; }
 	const uint8_t GetHeader() { return LOLA_LINK_HEADER_REPORT; }
 	const uint8_t GetPayloadSize() { return LOLA_LINK_SERVICE_PAYLOAD_SIZE_REPORT; }
 
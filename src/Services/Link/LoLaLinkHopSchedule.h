@@ -0,0 +1,113 @@
+// LoLaLinkHopSchedule.h
+
+#ifndef _LOLA_LINK_HOP_SCHEDULE_h
+#define _LOLA_LINK_HOP_SCHEDULE_h
+
+#include <LoLaCrypto\LoLaCryptoTokenSource.h>
+#include <LoLaCrypto\LoLaCryptoEncoder.h>
+
+//Hops are computed ahead of time, so switching over is just a table read.
+template<const uint8_t ScheduleSize>
+class LoLaLinkHopSchedule
+{
+private:
+	struct HopEntryType
+	{
+		uint32_t HopNumber = 0;
+		uint32_t TokenHash = 0;
+		uint8_t ChannelToken = 0;
+		bool Valid = false;
+	} Entries[ScheduleSize];
+
+	LoLaCryptoTokenSource* CryptoSeed = nullptr;
+	LoLaCryptoEncoder* Encoder = nullptr;
+
+	//Next hop number to be precomputed.
+	uint32_t NextFillHop = 0;
+
+public:
+	LoLaLinkHopSchedule() {}
+
+	bool Setup(LoLaCryptoTokenSource* cryptoSeed, LoLaCryptoEncoder* encoder)
+	{
+		CryptoSeed = cryptoSeed;
+		Encoder = encoder;
+
+		return CryptoSeed != nullptr && Encoder != nullptr;
+	}
+
+	//Call on session start, fills the whole table.
+	void Reset(const uint32_t currentHop)
+	{
+		for (uint8_t i = 0; i < ScheduleSize; i++)
+		{
+			Entries[i].Valid = false;
+		}
+
+		NextFillHop = currentHop;
+		while (FillNext(currentHop));
+	}
+
+	//Computes at most one entry ahead of the current hop.
+	//Returns true if an entry was filled.
+	bool FillNext(const uint32_t currentHop)
+	{
+		//Never lag behind the current hop.
+		if ((int32_t)(NextFillHop - currentHop) < 0)
+		{
+			NextFillHop = currentHop;
+		}
+
+		if ((NextFillHop - currentHop) >= ScheduleSize)
+		{
+			return false;
+		}
+
+		Compute(&Entries[NextFillHop % ScheduleSize], NextFillHop);
+		NextFillHop++;
+
+		return true;
+	}
+
+	//O(1) if the hop was precomputed, falls back to computing it in place otherwise.
+	void ApplyHop(const uint32_t hopNumber, uint8_t &channelToken)
+	{
+		HopEntryType* entry = &Entries[hopNumber % ScheduleSize];
+
+		if (!entry->Valid || entry->HopNumber != hopNumber)
+		{
+			Compute(entry, hopNumber);
+		}
+
+#ifdef LOLA_LINK_USE_TOKEN_HOP
+		Encoder->SetTokenHashed(entry->TokenHash);
+#endif
+		channelToken = entry->ChannelToken;
+	}
+
+private:
+	void Compute(HopEntryType* entry, const uint32_t hopNumber)
+	{
+		uint32_t token = CryptoSeed->GetHopToken(hopNumber);
+
+		entry->HopNumber = hopNumber;
+#ifdef LOLA_LINK_USE_TOKEN_HOP
+		entry->TokenHash = Encoder->HashToken(token);
+#endif
+		entry->ChannelToken = (uint8_t)(Mix(token) & 0xFF);
+		entry->Valid = true;
+	}
+
+	//Cheap integer hash, spreads consecutive hops over the whole channel range.
+	inline uint32_t Mix(uint32_t value)
+	{
+		value ^= value >> 16;
+		value *= 0x7FEB352D;
+		value ^= value >> 15;
+		value *= 0x846CA68B;
+		value ^= value >> 16;
+
+		return value;
+	}
+};
+#endif
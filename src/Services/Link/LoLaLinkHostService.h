@@ -38,6 +38,19 @@ private:
 	//Session lifetime.
 	uint32_t SessionLastStarted = ILOLA_INVALID_MILLIS;
 
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+	//Wake beacons also count as sent, Id broadcasts keep their own period.
+	uint32_t LastIdBroadcastMillis = 0;
+
+	//Beacons only go out during a burst, quiet until the next one.
+	uint32_t BeaconBurstStartMillis = 0;
+#endif
+
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+	//Pending mask report resends.
+	uint32_t MaskReportMillis = 0;
+#endif
+
 public:
 	LoLaLinkHostService(Scheduler* servicesScheduler, Scheduler* driverScheduler, ILoLaDriver* driver)
 		: LoLaLinkService(servicesScheduler, driverScheduler, driver)
@@ -62,6 +75,9 @@ protected:
 		{
 		case LoLaLinkInfo::LinkStateEnum::AwaitingLink:
 			NewSession();
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+			BeaconBurstStartMillis = millis();
+#endif
 			break;
 		case LoLaLinkInfo::LinkStateEnum::AwaitingSleeping:
 			SetNextRunDelay(LOLA_LINK_SERVICE_UNLINK_HOST_SLEEP_PERIOD);
@@ -115,11 +131,32 @@ protected:
 				SessionLastStarted = millis();
 			}
 
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+			if (millis() - LastIdBroadcastMillis > LOLA_LINK_SERVICE_UNLINK_BROADCAST_PERIOD)
+#else
 			if (GetElapsedMillisSinceLastSent() > LOLA_LINK_SERVICE_UNLINK_BROADCAST_PERIOD)
+#endif
 			{
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+				//Each broadcast goes out on the next rendezvous channel.
+				SetRendezvousChannel(RendezvousIndex);
+				RendezvousIndex = SpectrumScanner.GetRendezvousIndexAfter(RendezvousIndex);
+#endif
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+				LastIdBroadcastMillis = millis();
+#endif
 				PrepareIdBroadcast();
 				RequestSendPacket();
 			}
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+			else if (IsBeaconBurstOpen() &&
+				GetElapsedMillisSinceLastSent() > LOLA_LINK_LPL_BEACON_PERIOD_MILLIS)
+			{
+				//Fill the gap, so any remote listen window during the burst catches at least one.
+				PrepareWakeBeacon();
+				RequestSendPacket();
+			}
+#endif
 			else
 			{
 				SetNextRunDelay(LOLA_LINK_SERVICE_CHECK_PERIOD);
@@ -401,6 +438,17 @@ protected:
 
 	void OnKeepingLink()
 	{
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+		//Our own blacklist may have changed since the last hop.
+		//Keep re-sending the report until the remote echoes the mask hop.
+		if (ChannelManager.ProposeMask() ||
+			(ChannelManager.IsMaskUnconfirmed() &&
+				millis() - MaskReportMillis > LOLA_LINK_SERVICE_LINKED_RESEND_PERIOD))
+		{
+			MaskReportMillis = millis();
+			RequestLinkReport();
+		}
+#endif
 		if (HostClockSyncTransaction.IsResultReady())
 		{
 			if (!ClockSyncer.OnEstimationReceived(HostClockSyncTransaction.GetResult()))
@@ -411,12 +459,40 @@ protected:
 			HostClockSyncTransaction.Reset();
 			RequestSendPacket();
 		}
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+		else if (IsLinkReportPending())
+		{
+			//Report goes out on the next run.
+			SetNextRunASAP();
+		}
+#endif
 		else
 		{
 			SetNextRunDelay(LOLA_LINK_SERVICE_IDLE_PERIOD);
 		}
 	}
 
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+	uint32_t GetReportChannelMask()
+	{
+		return ChannelManager.GetAgreedMask();
+	}
+
+	void OnLinkChannelReportReceived(const uint32_t remoteMask, const uint8_t maskHop)
+	{
+		//Remote reports the mask hop it will switch on.
+		ChannelManager.ConfirmMask(maskHop);
+
+		//Host is authoritative, merge the remote's blacklist with ours.
+		ChannelManager.SetPartnerMask(remoteMask);
+		if (ChannelManager.ProposeMask())
+		{
+			MaskReportMillis = millis();
+			RequestLinkReport();
+		}
+	}
+#endif
+
 	void OnPingAckReceived(const uint8_t id)
 	{
 		if (LinkInfo->GetLinkState() == LoLaLinkInfo::LinkStateEnum::Linking &&
@@ -471,6 +547,26 @@ private:
 		S_ArrayToPayload();
 	}
 
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+	//A burst covers one remote wake period, so it hits a listen window wherever it falls.
+	bool IsBeaconBurstOpen()
+	{
+		if (millis() - BeaconBurstStartMillis >= LOLA_LINK_LPL_BURST_PERIOD_MILLIS)
+		{
+			BeaconBurstStartMillis = millis();
+		}
+
+		return millis() - BeaconBurstStartMillis < LOLA_LINK_LPL_BURST_MILLIS;
+	}
+
+	void PrepareWakeBeacon()
+	{
+		PrepareShortPacket(LinkInfo->GetSessionId(), LOLA_LINK_SUBHEADER_HOST_WAKE_BEACON);
+		ATUI_S.uint = LinkInfo->GetLocalId();
+		S_ArrayToPayload();
+	}
+#endif
+
 	void PrepareCryptoStartRequest()
 	{
 		PrepareLinkProtocolSwitchOver();
@@ -483,19 +579,13 @@ private:
 		OutPacket.GetPayload()[0] = LinkInfo->GetRSSINormalized();
 		OutPacket.GetPayload()[1] = LinkInfo->GetRTT() & 0xFF; //MSB 16 bit unsigned.
 		OutPacket.GetPayload()[2] = (LinkInfo->GetRTT() >> 8) & 0xFF;
-		for (uint8_t i = 3; i < DefinitionReport.GetPayloadSize(); i++)
-		{
-			OutPacket.GetPayload()[i] = UINT8_MAX; //Padding
-		}
+		OutPacket.SetPayloadSize(3);
 	}
 
 	void PrepareInfoSyncRequest()
 	{
 		PrepareReportPacket(LOLA_LINK_SUBHEADER_INFO_SYNC_REQUEST);
-		for (uint8_t i = 0; i < DefinitionReport.GetPayloadSize(); i++)
-		{
-			OutPacket.GetPayload()[i] = UINT8_MAX; //Padding
-		}
+		OutPacket.SetPayloadSize(0);
 	}
 
 	void PrepareClockSyncResponse(const uint8_t requestId, const int32_t estimationErrorMicros)
@@ -5,96 +5,117 @@
 
 #include <ILoLaDriver.h>
 #include <Services\Link\LoLaLinkDefinitions.h>
+#include <Services\Link\LoLaLinkChannelManager.h>
 
-#define RADIO_POWER_BALANCER_UPDATE_PERIOD				(uint32_t)(500)
-#define RADIO_POWER_BALANCER_RSSI_TARGET_MARGIN			(uint8_t)(15)
-#define RADIO_POWER_BALANCER_ADJUST_UP_LONG				(uint8_t)(20)
-#define RADIO_POWER_BALANCER_ADJUST_DOWN_LONG			(uint8_t)(10)
-#define RADIO_POWER_BALANCER_POWER_MIN					(uint8_t)(13) // ~5% 
+#define RADIO_POWER_BALANCER_POWER_MIN					(uint8_t)(13) // ~5%
 #define RADIO_POWER_BALANCER_POWER_MAX					100//(uint8_t)(UINT8_MAX)
 #define RADIO_POWER_BALANCER_RSSI_TARGET				(uint8_t)(140)
 
+//PI controller, gains are fixed point with RADIO_POWER_BALANCER_GAIN_SHIFT.
+#define RADIO_POWER_BALANCER_GAIN_SHIFT					(uint8_t)(4)
+#define RADIO_POWER_BALANCER_KP							(int16_t)(6)	// ~0.4
+#define RADIO_POWER_BALANCER_KI							(int16_t)(3)	// ~0.2
+#define RADIO_POWER_BALANCER_RSSI_FILTER_SHIFT			(uint8_t)(1)	//EWMA over partner reports, smooths fading.
 
+//Raise the target when the partner is missing our packets.
+#define RADIO_POWER_BALANCER_DELIVERY_GOOD				(uint8_t)(243)	// ~95%
+#define RADIO_POWER_BALANCER_DELIVERY_BOOST_SHIFT		(uint8_t)(1)
+
+//Noisy channels need a stronger signal for the same delivery.
+#define RADIO_POWER_BALANCER_NOISE_TARGET_SHIFT			(uint8_t)(2)
+
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+#define RADIO_POWER_BALANCER_CHANNEL_COUNT				LOLA_LINK_CHANNEL_MANAGER_MAX_CHANNELS
+#else
+#define RADIO_POWER_BALANCER_CHANNEL_COUNT				1
+#endif
 
 class LoLaLinkPowerBalancer
 {
 private:
 	LoLaLinkInfo* LinkInfo = nullptr;
 	ILoLaDriver* LoLaDriver = nullptr;
+	LoLaLinkChannelManager* ChannelManager = nullptr;
 
-	uint8_t CurrentPartnerRSSI = 0;
+	//Per channel controller state.
+	struct ChannelControlType
+	{
+		int16_t FilteredRSSI = -1; //Negative until the first sample.
+		int16_t Integral = 0; //Operating point, shifted by RADIO_POWER_BALANCER_GAIN_SHIFT.
+	} ChannelControl[RADIO_POWER_BALANCER_CHANNEL_COUNT];
 
 	uint8_t TransmitPowerNormalized = 0;
 	uint8_t NextTransmitPower = 0;
+	uint8_t LastChannelIndex = 0;
 
 	uint32_t LastUpdated = ILOLA_INVALID_MILLIS;
 
+	//Helpers.
+	ChannelControlType* Control = nullptr;
+	int16_t Target = 0;
+	int16_t Error = 0;
+
 public:
 	LoLaLinkPowerBalancer() {}
 
-	bool Setup(ILoLaDriver* driver, LoLaLinkInfo* linkInfo)
+	bool Setup(ILoLaDriver* driver, LoLaLinkInfo* linkInfo, LoLaLinkChannelManager* channelManager)
 	{
 		LoLaDriver = driver;
 		LinkInfo = linkInfo;
+		ChannelManager = channelManager;
 		TransmitPowerNormalized = 0;
 
 		LastUpdated = ILOLA_INVALID_MILLIS;
 
-		return LoLaDriver != nullptr && LinkInfo != nullptr;
+		return LoLaDriver != nullptr && LinkInfo != nullptr && ChannelManager != nullptr;
 	}
 
 	bool Update()
 	{
-		if (LastUpdated == ILOLA_INVALID_MILLIS || 
+		if (LastUpdated == ILOLA_INVALID_MILLIS ||
 			LoLaDriver->GetElapsedMillisLastValidReceived() >= LOLA_LINK_SERVICE_LINKED_MAX_PANIC)
 		{
 			LastUpdated = millis();
 			SetMaxPower();
+
+			return false;
 		}
-		else if (millis() - LastUpdated > LOLA_LINK_SERVICE_LINKED_POWER_UPDATE_PERIOD)
-		{
-			LastUpdated = millis();
 
-			CurrentPartnerRSSI = LinkInfo->GetPartnerRSSINormalized();
+		Control = &ChannelControl[GetChannelIndex()];
 
+		if (GetChannelIndex() != LastChannelIndex)
+		{
+			//Hopped, resume from the operating point of this channel.
+			LastChannelIndex = GetChannelIndex();
+
+			return ApplyPower(Control->Integral >> RADIO_POWER_BALANCER_GAIN_SHIFT);
+		}
 
-			NextTransmitPower = TransmitPowerNormalized;
+		//Only act on fresh partner reports.
+		if (millis() - LastUpdated > LOLA_LINK_SERVICE_LINKED_POWER_UPDATE_PERIOD &&
+			LinkInfo->HasPartnerRSSI() &&
+			LinkInfo->GetPartnerLastReportElapsed() < (millis() - LastUpdated))
+		{
+			LastUpdated = millis();
 
-			if ((CurrentPartnerRSSI > RADIO_POWER_BALANCER_RSSI_TARGET) &&
-				(NextTransmitPower > RADIO_POWER_BALANCER_POWER_MIN))
+			if (Control->FilteredRSSI < 0)
 			{
-				//Down.
-				if (CurrentPartnerRSSI > (RADIO_POWER_BALANCER_RSSI_TARGET + RADIO_POWER_BALANCER_RSSI_TARGET_MARGIN))
-				{
-					NextTransmitPower = max(RADIO_POWER_BALANCER_POWER_MIN, NextTransmitPower - RADIO_POWER_BALANCER_ADJUST_DOWN_LONG);
-				}
-				else if (NextTransmitPower > RADIO_POWER_BALANCER_POWER_MIN)
-				{
-					NextTransmitPower--;
-				}
+				Control->FilteredRSSI = LinkInfo->GetPartnerRSSINormalized();
 			}
-			else if ((CurrentPartnerRSSI < RADIO_POWER_BALANCER_RSSI_TARGET) &&
-				(NextTransmitPower < RADIO_POWER_BALANCER_POWER_MAX))
+			else
 			{
-				//Up.
-				if (CurrentPartnerRSSI < (RADIO_POWER_BALANCER_RSSI_TARGET - RADIO_POWER_BALANCER_RSSI_TARGET_MARGIN))
-				{
-					NextTransmitPower = min(RADIO_POWER_BALANCER_POWER_MAX, NextTransmitPower + RADIO_POWER_BALANCER_ADJUST_UP_LONG);
-
-				}
-				else if (NextTransmitPower < RADIO_POWER_BALANCER_POWER_MAX)
-				{
-					NextTransmitPower++;
-				}
+				Control->FilteredRSSI += ((int16_t)LinkInfo->GetPartnerRSSINormalized() - Control->FilteredRSSI) >> RADIO_POWER_BALANCER_RSSI_FILTER_SHIFT;
 			}
 
-			if (NextTransmitPower != TransmitPowerNormalized)
-			{
-				TransmitPowerNormalized = NextTransmitPower;
-				LoLaDriver->SetTransmitPower(TransmitPowerNormalized);
+			Target = GetTarget();
+			Error = Target - Control->FilteredRSSI;
 
-				return true;
-			}
+			//Integral with anti-windup, clamped to the power range.
+			Control->Integral = constrain(Control->Integral + (Error * RADIO_POWER_BALANCER_KI),
+				(int16_t)RADIO_POWER_BALANCER_POWER_MIN << RADIO_POWER_BALANCER_GAIN_SHIFT,
+				(int16_t)RADIO_POWER_BALANCER_POWER_MAX << RADIO_POWER_BALANCER_GAIN_SHIFT);
+
+			return ApplyPower((Control->Integral + (Error * RADIO_POWER_BALANCER_KP)) >> RADIO_POWER_BALANCER_GAIN_SHIFT);
 		}
 
 		return false;
@@ -104,7 +125,54 @@ public:
 	{
 		TransmitPowerNormalized = RADIO_POWER_BALANCER_POWER_MAX;
 		LoLaDriver->SetTransmitPower(TransmitPowerNormalized);
+
+		//Controller starts from max power on every channel, and converges down.
+		for (uint8_t i = 0; i < RADIO_POWER_BALANCER_CHANNEL_COUNT; i++)
+		{
+			ChannelControl[i].FilteredRSSI = -1;
+			ChannelControl[i].Integral = (int16_t)RADIO_POWER_BALANCER_POWER_MAX << RADIO_POWER_BALANCER_GAIN_SHIFT;
+		}
 	}
-};
+
+private:
+	bool ApplyPower(const int16_t power)
+	{
+		NextTransmitPower = constrain(power, RADIO_POWER_BALANCER_POWER_MIN, RADIO_POWER_BALANCER_POWER_MAX);
+
+		if (NextTransmitPower != TransmitPowerNormalized)
+		{
+			TransmitPowerNormalized = NextTransmitPower;
+			LoLaDriver->SetTransmitPower(TransmitPowerNormalized);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	int16_t GetTarget()
+	{
+		int16_t target = RADIO_POWER_BALANCER_RSSI_TARGET;
+
+		if (LinkInfo->GetQualityEstimator()->GetOutboundDeliveryRatio() < RADIO_POWER_BALANCER_DELIVERY_GOOD)
+		{
+			target += (RADIO_POWER_BALANCER_DELIVERY_GOOD - LinkInfo->GetQualityEstimator()->GetOutboundDeliveryRatio()) >> RADIO_POWER_BALANCER_DELIVERY_BOOST_SHIFT;
+		}
+
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+		target += ChannelManager->GetChannelNoise(LoLaDriver->GetChannel()) >> RADIO_POWER_BALANCER_NOISE_TARGET_SHIFT;
 #endif
 
+		return min(target, (int16_t)UINT8_MAX);
+	}
+
+	inline uint8_t GetChannelIndex()
+	{
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+		return min((uint8_t)(RADIO_POWER_BALANCER_CHANNEL_COUNT - 1), (uint8_t)(LoLaDriver->GetChannel() - LoLaDriver->GetChannelMin()));
+#else
+		return 0;
+#endif
+	}
+};
+#endif
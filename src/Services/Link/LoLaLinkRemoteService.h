@@ -28,6 +28,16 @@ private:
 	LinkRemoteClockSyncer ClockSyncer;
 	ClockSyncRequestTransaction RemoteClockSyncTransaction;
 
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+	uint32_t RendezvousLastSwitched = ILOLA_INVALID_MILLIS;
+#endif
+
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+	bool ListenWindowOpen = false;
+	uint32_t ListenWakeCount = 0;
+	uint32_t WakeBeaconCount = 0;
+#endif
+
 public:
 	LoLaLinkRemoteService(Scheduler* servicesScheduler, Scheduler* driverScheduler, ILoLaDriver* driver)
 		: LoLaLinkService(servicesScheduler, driverScheduler, driver)
@@ -39,6 +49,25 @@ public:
 		driver->SetDuplexSlot(false);
 	}
 
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+	uint32_t GetListenWakeCount()
+	{
+		return ListenWakeCount;
+	}
+
+	uint32_t GetWakeBeaconCount()
+	{
+		return WakeBeaconCount;
+	}
+
+	//Radio on time while sleeping, in parts per thousand.
+	//Average current ~= duty * RX current, worst case added reconnect latency = wake period.
+	static uint16_t GetListenDutyPerMil()
+	{
+		return (uint16_t)((LOLA_LINK_LPL_LISTEN_MILLIS * 1000) / LOLA_LINK_LPL_WAKE_PERIOD_MILLIS);
+	}
+#endif
+
 protected:
 #ifdef DEBUG_LOLA
 	void PrintName(Stream* serial)
@@ -53,9 +82,21 @@ protected:
 		{
 		case LoLaLinkInfo::LinkStateEnum::AwaitingLink:
 			KeyExchanger.GenerateNewKeyPair();
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+			RendezvousLastSwitched = millis();
+#endif
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+			LoLaDriver->WakeRadio();
+#endif
 			break;
 		case LoLaLinkInfo::LinkStateEnum::AwaitingSleeping:
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+			ListenWindowOpen = false;
+			LoLaDriver->SleepRadio();
+			SetNextRunDelay(LOLA_LINK_LPL_WAKE_PERIOD_MILLIS - LOLA_LINK_LPL_LISTEN_MILLIS);
+#else
 			SetNextRunDelay(LOLA_LINK_SERVICE_UNLINK_REMOTE_SLEEP_PERIOD);
+#endif
 			break;
 		case LoLaLinkInfo::LinkStateEnum::Linking:
 			InfoSyncStage = InfoSyncStagesEnum::AwaitingHostRequest;
@@ -92,6 +133,15 @@ protected:
 			switch (LinkingState)
 			{
 			case AwaitingLinkEnum::SearchingForHost:
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+				if (millis() - RendezvousLastSwitched > SpectrumScanner.GetRemoteDwellMillis())
+				{
+					RendezvousLastSwitched = millis();
+					RendezvousIndex = SpectrumScanner.GetRendezvousIndexAfter(RendezvousIndex);
+					SetRendezvousChannel(RendezvousIndex);
+					ResetLastSentTimeStamp(); //Announce ourselves on the new channel.
+				}
+#endif
 				if (GetElapsedMillisSinceLastSent() > LOLA_LINK_SERVICE_UNLINK_REMOTE_SEARCH_PERIOD)
 				{
 					//Send an Hello to wake up potential hosts.
@@ -179,6 +229,42 @@ protected:
 
 		return true;
 	}
+#ifdef LOLA_LINK_USE_LOW_POWER_LISTEN
+	//Short listen windows on a fixed schedule, the host beacons often enough to hit one.
+	bool OnAwaitingSleeping()
+	{
+		if (GetElapsedMillisSinceStateStart() > LOLA_LINK_LPL_REMOTE_MAX_SLEEP_MILLIS)
+		{
+			return false;
+		}
+
+		if (ListenWindowOpen)
+		{
+			ListenWindowOpen = false;
+			LoLaDriver->SleepRadio();
+			SetNextRunDelay(LOLA_LINK_LPL_WAKE_PERIOD_MILLIS - LOLA_LINK_LPL_LISTEN_MILLIS);
+		}
+		else
+		{
+			ListenWindowOpen = true;
+			ListenWakeCount++;
+			LoLaDriver->WakeRadio();
+			SetNextRunDelay(LOLA_LINK_LPL_LISTEN_MILLIS);
+		}
+
+		return true;
+	}
+
+	void OnWakeBeaconReceived()
+	{
+		if (LinkInfo->GetLinkState() == LoLaLinkInfo::LinkStateEnum::AwaitingSleeping)
+		{
+			WakeBeaconCount++;
+			UpdateLinkState(LoLaLinkInfo::LinkStateEnum::AwaitingLink);
+		}
+	}
+#endif
+
 	void OnIdBroadcastReceived(const uint8_t sessionId, const uint32_t hostId)
 	{
 		switch (LinkInfo->GetLinkState())
@@ -425,6 +511,14 @@ protected:
 		}
 	}
 
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+	void OnLinkChannelReportReceived(const uint32_t hostMask, const uint8_t maskHop)
+	{
+		//Remote follows the host's mask.
+		ChannelManager.SetPendingMask(hostMask, maskHop);
+	}
+#endif
+
 	bool OnAckedPacketReceived(ILoLaPacket* receivedPacket)
 	{
 		if (receivedPacket->GetDataHeader() == LOLA_LINK_HEADER_SHORT_WITH_ACK)
@@ -472,10 +566,7 @@ private:
 	{
 		PrepareReportPacket(LOLA_LINK_SUBHEADER_INFO_SYNC_REMOTE);
 		OutPacket.GetPayload()[0] = LinkInfo->GetRSSINormalized();
-		for (uint8_t i = 1; i < DefinitionReport.GetPayloadSize(); i++)
-		{
-			OutPacket.GetPayload()[i] = UINT8_MAX; //Padding
-		}
+		OutPacket.SetPayloadSize(1);
 	}
 
 	void PrepareClockSyncRequest(const uint8_t requestId)
@@ -17,6 +17,10 @@
 
 #include <Services\Link\LoLaLinkTimedHopper.h>
 
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+#include <Services\Link\LoLaLinkSpectrumScanner.h>
+#endif
+
 class LoLaLinkService : public AbstractLinkService
 {
 #ifdef DEBUG_LOLA
@@ -33,9 +37,6 @@ private:
 	//Sub-services.
 	LoLaLinkTimedHopper TimedHopper;
 
-	//Channel management.
-	LoLaLinkChannelManager ChannelManager;
-
 	//Power balancer.
 	LoLaLinkPowerBalancer PowerBalancer;
 
@@ -46,6 +47,15 @@ private:
 	bool ReportPending = false;
 
 protected:
+	//Channel management.
+	LoLaLinkChannelManager ChannelManager;
+
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+	//Background noise floor, for discovery rendezvous.
+	LoLaLinkSpectrumScanner SpectrumScanner;
+	uint8_t RendezvousIndex = 0;
+#endif
+
 	//Crypto key exchanger.
 	LoLaCryptoKeyExchanger	KeyExchanger;
 	uint32_t KeysLastGenerated = ILOLA_INVALID_MILLIS;
@@ -77,6 +87,7 @@ protected:
 	///Remote packet handling.
 	//Unlinked packets.
 	virtual void OnIdBroadcastReceived(const uint8_t sessionId, const uint32_t hostMACHash) {}
+	virtual void OnWakeBeaconReceived() {}
 	virtual void OnHostPublicKeyReceived(const uint8_t sessionId, uint8_t* hostPublicKey) {}
 
 	//Linked packets.
@@ -85,6 +96,12 @@ protected:
 	virtual void OnClockSyncTuneResponseReceived(const uint8_t requestId, const int32_t estimatedErrorMicros) {}
 	///
 
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+	///Channel mask agreement.
+	virtual void OnLinkChannelReportReceived(const uint32_t channelMask, const uint8_t maskHop) {}
+	///
+#endif
+
 	//Internal housekeeping.
 	virtual void OnClearSession() {};
 	virtual void OnLinkStateChanged(const LoLaLinkInfo::LinkStateEnum newState) {}
@@ -92,6 +109,7 @@ protected:
 	//Runtime handlers.
 	virtual void OnLinking() { SetNextRunDelay(LOLA_LINK_SERVICE_CHECK_PERIOD); }
 	virtual bool OnAwaitingLink() { return false; }
+	virtual bool OnAwaitingSleeping() { return false; }
 	virtual void OnKeepingLink() { SetNextRunDelay(LOLA_LINK_SERVICE_IDLE_PERIOD); }
 
 
@@ -100,6 +118,9 @@ public:
 		: AbstractLinkService(servicesScheduler, driver)
 		, TimedHopper(driverScheduler, driver)
 		, ChannelManager()
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+		, SpectrumScanner(servicesScheduler)
+#endif
 		, PowerBalancer()
 		, KeyExchanger()
 	{
@@ -132,6 +153,9 @@ protected:
 			KeyExchanger.Setup() &&
 			ClockSyncerPointer->Setup(LoLaDriver->GetClockSource()) &&
 			ChannelManager.Setup(LoLaDriver) &&
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+			SpectrumScanner.Setup(LoLaDriver) &&
+#endif
 			TimedHopper.Setup(&ChannelManager))
 		{
 			LinkInfo = ServicesManager->GetLinkInfo();
@@ -146,7 +170,7 @@ protected:
 				//Make sure to lazy load the local MAC on startup.
 				LinkInfo->GetLocalId();
 
-				if (PowerBalancer.Setup(LoLaDriver, LinkInfo))
+				if (PowerBalancer.Setup(LoLaDriver, LinkInfo, &ChannelManager))
 				{
 					ClearSession();
 #ifdef DEBUG_LOLA
@@ -207,13 +231,13 @@ protected:
 #endif
 	}
 
-	void OnLinkInfoReportReceived(const uint8_t rssi, const uint8_t partnerReceivedCount)
+	void OnLinkInfoReportReceived(const uint8_t rssi, const uint16_t partnerReceivedCount, const uint16_t partnerTransmitedCount)
 	{
 		if (LinkInfo->HasLink())
 		{
 			LinkInfo->StampPartnerInfoUpdated();
 			LinkInfo->SetPartnerRSSINormalized(rssi);
-			LinkInfo->SetPartnerReceivedCount(partnerReceivedCount);
+			LinkInfo->SetPartnerCounters(partnerReceivedCount, partnerTransmitedCount);
 
 			SetNextRunASAP();
 		}
@@ -243,6 +267,10 @@ protected:
 			}
 			else
 			{
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+				//Only scan while searching for a partner, not during a session.
+				SpectrumScanner.SetActive(LinkingState == 0);
+#endif
 				if (!OnAwaitingLink())//Time out is different for host/remote.
 				{
 					UpdateLinkState(LoLaLinkInfo::LinkStateEnum::AwaitingSleeping);
@@ -250,7 +278,10 @@ protected:
 			}
 			break;
 		case LoLaLinkInfo::LinkStateEnum::AwaitingSleeping:
-			UpdateLinkState(LoLaLinkInfo::LinkStateEnum::AwaitingLink);
+			if (!OnAwaitingSleeping())
+			{
+				UpdateLinkState(LoLaLinkInfo::LinkStateEnum::AwaitingLink);
+			}
 			break;
 		case LoLaLinkInfo::LinkStateEnum::Linking:
 			if (GetElapsedMillisSinceStateStart() > LOLA_LINK_SERVICE_UNLINK_MAX_BEFORE_LINKING_CANCEL)
@@ -290,7 +321,7 @@ private:
 		{
 			if (GetElapsedMillisSinceLastSent() > LOLA_LINK_SERVICE_LINKED_RESEND_PERIOD)
 			{
-				PrepareLinkReport(LinkInfo->GetPartnerLastReportElapsed() > LOLA_LINK_SERVICE_LINKED_INFO_STALE_PERIOD);
+				PrepareLinkReport(IsLinkReportReplyNeeded());
 				RequestSendPacket();
 			}
 			else
@@ -390,6 +421,12 @@ protected:
 			ResetStateStartTime();
 			ResetLastSentTimeStamp();
 
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+			//Scanning resumes on the next AwaitingLink run.
+			SpectrumScanner.SetActive(false);
+			RendezvousIndex = 0;
+#endif
+
 			//Previous state.
 			if (LinkInfo->GetLinkState() == LoLaLinkInfo::LinkStateEnum::Linked)
 			{
@@ -500,6 +537,10 @@ protected:
 				ArrayToR_Array(&receivedPacket->GetPayload()[1]);
 				OnIdBroadcastReceived(receivedPacket->GetId(), ATUI_R.uint);
 				break;
+
+			case LOLA_LINK_SUBHEADER_HOST_WAKE_BEACON:
+				OnWakeBeaconReceived();
+				break;
 				///
 
 				///Linking Packets
@@ -553,7 +594,17 @@ protected:
 			case LOLA_LINK_SUBHEADER_LINK_REPORT_WITH_REPLY:
 				ReportPending = true;
 			case LOLA_LINK_SUBHEADER_LINK_REPORT:
-				OnLinkInfoReportReceived(receivedPacket->GetPayload()[0], receivedPacket->GetPayload()[1]);
+				OnLinkInfoReportReceived(receivedPacket->GetPayload()[0],
+					(uint16_t)(receivedPacket->GetPayload()[LOLA_LINK_REPORT_RECEIVED_COUNT_INDEX] + (receivedPacket->GetPayload()[LOLA_LINK_REPORT_RECEIVED_COUNT_INDEX + 1] << 8)),
+					(uint16_t)(receivedPacket->GetPayload()[LOLA_LINK_REPORT_TRANSMITED_COUNT_INDEX] + (receivedPacket->GetPayload()[LOLA_LINK_REPORT_TRANSMITED_COUNT_INDEX + 1] << 8)));
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+				if (LinkInfo->HasLink() &&
+					receivedPacket->GetPayloadSize() >= LOLA_LINK_SERVICE_PAYLOAD_SIZE_REPORT)
+				{
+					ArrayToR_Array(&receivedPacket->GetPayload()[LOLA_LINK_REPORT_CHANNEL_MASK_INDEX]);
+					OnLinkChannelReportReceived(ATUI_R.uint, receivedPacket->GetPayload()[LOLA_LINK_REPORT_CHANNEL_MASK_HOP_INDEX]);
+				}
+#endif
 				break;
 
 				//To Host.
@@ -595,6 +646,18 @@ protected:
 	}
 
 	/////Linking time packets.
+	bool IsLinkReportReplyNeeded()
+	{
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+		//Pending mask waits for the partner's echo.
+		if (ChannelManager.IsMaskUnconfirmed())
+		{
+			return true;
+		}
+#endif
+		return LinkInfo->GetPartnerLastReportElapsed() > LOLA_LINK_SERVICE_LINKED_INFO_STALE_PERIOD;
+	}
+
 	void PrepareLinkReport(const bool requestReply)
 	{
 		if (requestReply)
@@ -607,9 +670,52 @@ protected:
 		}
 
 		OutPacket.GetPayload()[0] = LinkInfo->GetRSSINormalized();
-		OutPacket.GetPayload()[1] = LoLaDriver->GetReceivedCount() % UINT8_MAX;
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_RECEIVED_COUNT_INDEX] = LoLaDriver->GetReceivedCount() & 0xFF;
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_RECEIVED_COUNT_INDEX + 1] = (LoLaDriver->GetReceivedCount() >> 8) & 0xFF;
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_TRANSMITED_COUNT_INDEX] = LoLaDriver->GetTransmitedCount() & 0xFF;
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_TRANSMITED_COUNT_INDEX + 1] = (LoLaDriver->GetTransmitedCount() >> 8) & 0xFF;
+
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+		if (!LinkInfo->HasLink())
+		{
+			//Channel mask is only read once linked.
+			OutPacket.SetPayloadSize(LOLA_LINK_REPORT_CHANNEL_MASK_HOP_INDEX);
+
+			return;
+		}
+
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_CHANNEL_MASK_HOP_INDEX] = ChannelManager.GetAgreedMaskHop();
+		ATUI_S.uint = GetReportChannelMask();
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_CHANNEL_MASK_INDEX] = ATUI_S.array[0];
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_CHANNEL_MASK_INDEX + 1] = ATUI_S.array[1];
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_CHANNEL_MASK_INDEX + 2] = ATUI_S.array[2];
+		OutPacket.GetPayload()[LOLA_LINK_REPORT_CHANNEL_MASK_INDEX + 3] = ATUI_S.array[3];
+#endif
 	}
 
+#ifdef LOLA_LINK_USE_CHANNEL_SCAN
+	void SetRendezvousChannel(const uint8_t index)
+	{
+		LoLaDriver->SetChannel(SpectrumScanner.GetRendezvousChannel(index));
+	}
+#endif
+
+#ifdef LOLA_LINK_USE_FREQUENCY_HOP
+	//Host reports the agreed mask, remote reports its local blacklist.
+	virtual uint32_t GetReportChannelMask() { return ChannelManager.GetLocalMask(); }
+
+	void RequestLinkReport()
+	{
+		ReportPending = true;
+		SetNextRunASAP();
+	}
+
+	bool IsLinkReportPending()
+	{
+		return ReportPending;
+	}
+#endif
+
 
 #ifdef DEBUG_LOLA
 private:
@@ -680,6 +786,14 @@ private:
 		{
 			serial->println(F("0 %)"));
 		}
+		serial->print(F("Link Quality: "));
+		serial->print((float)(((LinkInfo->GetQualityEstimator()->GetQuality() * 100) / UINT8_MAX)), 0);
+		serial->print(F(" %\tETX: "));
+		serial->print((float)LinkInfo->GetQualityEstimator()->GetETX() / 100.0f, 2);
+		serial->print(F("\tJitter: "));
+		serial->print(LinkInfo->GetQualityEstimator()->GetRTTJitterMicros());
+		serial->println(F(" us"));
+
 		serial->print(F("Timming Collision: "));
 		serial->println(LoLaDriver->GetTimingCollisionCount());
 
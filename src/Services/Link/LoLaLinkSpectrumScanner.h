@@ -0,0 +1,212 @@
+// LoLaLinkSpectrumScanner.h
+
+#ifndef _LOLA_LINK_SPECTRUM_SCANNER_h
+#define _LOLA_LINK_SPECTRUM_SCANNER_h
+
+#define _TASK_OO_CALLBACKS
+#include <TaskSchedulerDeclarations.h>
+
+#include <ILoLaDriver.h>
+#include <Services\Link\LoLaLinkDefinitions.h>
+
+#define LOLA_LINK_SPECTRUM_SCANNER_MAX_CHANNELS			(uint8_t)(32)
+#define LOLA_LINK_SPECTRUM_SCAN_PERIOD_MILLIS			(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS/2) //Between samples, keeps the radio mostly listening.
+#define LOLA_LINK_SPECTRUM_SETTLE_MILLIS				(uint32_t)(1) //RSSI settle time after tuning.
+#define LOLA_LINK_SPECTRUM_NOISE_FILTER_SHIFT			(uint8_t)(2)
+
+//Rendezvous set, the middle channel followed by the quietest ones.
+//The middle channel is common to both sides, the quiet ones overlap on a clean band.
+//Host hops the set on every broadcast, the Remote dwells on each channel for a full Host cycle.
+#define LOLA_LINK_RENDEZVOUS_SET_SIZE					(uint8_t)(4)
+
+class LoLaLinkSpectrumScanner : public Task
+{
+private:
+	ILoLaDriver* LoLaDriver = nullptr;
+
+	uint8_t ChannelCount = 0;
+
+	//Normalized noise floor, per channel.
+	uint8_t NoiseFloor[LOLA_LINK_SPECTRUM_SCANNER_MAX_CHANNELS];
+
+	//Channel indexes, refreshed after each full sweep.
+	uint8_t RendezvousSet[LOLA_LINK_RENDEZVOUS_SET_SIZE];
+	uint8_t RendezvousCount = 0;
+
+	uint8_t ScanIndex = 0;
+	bool SamplePending = false;
+	bool Active = false;
+
+	//Helpers.
+	int16_t SampleRSSI = 0;
+	uint8_t QuietestIndex = 0;
+
+public:
+	LoLaLinkSpectrumScanner(Scheduler* scheduler)
+		: Task(0, TASK_FOREVER, scheduler, false)
+	{
+	}
+
+	bool Setup(ILoLaDriver* driver)
+	{
+		LoLaDriver = driver;
+
+		if (LoLaDriver != nullptr)
+		{
+			ChannelCount = min(LOLA_LINK_SPECTRUM_SCANNER_MAX_CHANNELS, LoLaDriver->GetChannelMax() + 1 - LoLaDriver->GetChannelMin());
+
+			for (uint8_t i = 0; i < LOLA_LINK_SPECTRUM_SCANNER_MAX_CHANNELS; i++)
+			{
+				NoiseFloor[i] = 0;
+			}
+
+			if (ChannelCount == 0)
+			{
+				return false;
+			}
+
+			UpdateRendezvousSet();
+
+			return true;
+		}
+
+		return false;
+	}
+
+	//Only scan while searching for a partner.
+	void SetActive(const bool active)
+	{
+		if (Active == active)
+		{
+			return;
+		}
+
+		Active = active;
+
+		if (Active)
+		{
+			enable();
+			forceNextIteration();
+		}
+		else
+		{
+			if (SamplePending)
+			{
+				SamplePending = false;
+				LoLaDriver->EndChannelSample();
+			}
+			disable();
+		}
+	}
+
+	uint8_t GetNoiseFloor(const uint8_t channel)
+	{
+		return NoiseFloor[GetChannelIndex(channel)];
+	}
+
+	uint8_t GetMiddleChannel()
+	{
+		return (LoLaDriver->GetChannelMin() + LoLaDriver->GetChannelMax()) / 2;
+	}
+
+	uint8_t GetRendezvousChannel(const uint8_t index)
+	{
+		return LoLaDriver->GetChannelMin() + RendezvousSet[index % RendezvousCount];
+	}
+
+	//Wrapped to the set size, so the sequence never jumps on overflow.
+	uint8_t GetRendezvousIndexAfter(const uint8_t index)
+	{
+		return (index + 1) % RendezvousCount;
+	}
+
+	//Long enough for the Host to broadcast on every channel of the set once.
+	uint32_t GetRemoteDwellMillis()
+	{
+		return (uint32_t)(RendezvousCount + 1) * LOLA_LINK_SERVICE_UNLINK_BROADCAST_PERIOD;
+	}
+
+protected:
+	bool Callback()
+	{
+		if (SamplePending)
+		{
+			SamplePending = false;
+			SampleRSSI = LoLaDriver->EndChannelSample();
+
+			if (SampleRSSI != ILOLA_INVALID_RSSI)
+			{
+				AddNoiseSample(ScanIndex, LoLaDriver->NormalizeRSSI(SampleRSSI));
+
+				ScanIndex++;
+				if (ScanIndex >= ChannelCount)
+				{
+					ScanIndex = 0;
+					UpdateRendezvousSet();
+				}
+			}
+
+			Task::delay(LOLA_LINK_SPECTRUM_SCAN_PERIOD_MILLIS);
+		}
+		else if (LoLaDriver->StartChannelSample(LoLaDriver->GetChannelMin() + ScanIndex))
+		{
+			SamplePending = true;
+			Task::delay(LOLA_LINK_SPECTRUM_SETTLE_MILLIS);
+		}
+		else
+		{
+			//Driver is busy, try again later.
+			Task::delay(LOLA_LINK_SPECTRUM_SCAN_PERIOD_MILLIS);
+		}
+
+		return true;
+	}
+
+private:
+	inline void AddNoiseSample(const uint8_t index, const uint8_t sample)
+	{
+		NoiseFloor[index] = NoiseFloor[index] - (NoiseFloor[index] >> LOLA_LINK_SPECTRUM_NOISE_FILTER_SHIFT)
+			+ (sample >> LOLA_LINK_SPECTRUM_NOISE_FILTER_SHIFT);
+	}
+
+	inline uint8_t GetChannelIndex(const uint8_t channel)
+	{
+		return min((uint8_t)(ChannelCount - 1), (uint8_t)(channel - LoLaDriver->GetChannelMin()));
+	}
+
+	bool IsInRendezvousSet(const uint8_t index)
+	{
+		for (uint8_t i = 0; i < RendezvousCount; i++)
+		{
+			if (RendezvousSet[i] == index)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	//Middle channel first, then the quietest ones, lowest channel on ties.
+	void UpdateRendezvousSet()
+	{
+		RendezvousSet[0] = GetChannelIndex(GetMiddleChannel());
+		RendezvousCount = 1;
+
+		while (RendezvousCount < min(LOLA_LINK_RENDEZVOUS_SET_SIZE, ChannelCount))
+		{
+			QuietestIndex = UINT8_MAX;
+			for (uint8_t i = 0; i < ChannelCount; i++)
+			{
+				if (!IsInRendezvousSet(i) &&
+					(QuietestIndex == UINT8_MAX || NoiseFloor[i] < NoiseFloor[QuietestIndex]))
+				{
+					QuietestIndex = i;
+				}
+			}
+
+			RendezvousSet[RendezvousCount++] = QuietestIndex;
+		}
+	}
+};
+#endif
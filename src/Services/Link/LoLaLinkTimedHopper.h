@@ -9,6 +9,7 @@
 
 #include <LoLaCrypto\LoLaCryptoTokenSource.h>
 #include <Services\Link\LoLaLinkChannelManager.h>
+#include <Services\Link\LoLaLinkHopSchedule.h>
 
 
 class LoLaTimeDebugTask : public Task
@@ -84,8 +85,16 @@ private:
 	//Crypto Encoder.
 	LoLaCryptoEncoder* Encoder = nullptr;
 
+	//Precomputed hops.
+	LoLaLinkHopSchedule<LOLA_LINK_HOP_SCHEDULE_SIZE> Schedule;
+
 	const uint32_t HopPeriod = LOLA_LINK_SERVICE_LINKED_TIMED_HOP_PERIOD_MILLIS;
 
+	//Helpers.
+	uint32_t LastHopNumber = 0;
+	uint32_t HopNumber = 0;
+	uint8_t ChannelToken = 0;
+
 public:
 	LoLaLinkTimedHopper(Scheduler* scheduler, ILoLaDriver* driver)
 		: ILoLaService(scheduler, 0, driver)
@@ -100,7 +109,8 @@ public:
 		Encoder = LoLaDriver->GetCryptoEncoder();
 		if (SyncedClock != nullptr &&
 			Encoder != nullptr &&
-			ChannelManager != nullptr)
+			ChannelManager != nullptr &&
+			Schedule.Setup(&CryptoSeed, Encoder))
 		{
 			CryptoSeed.SetTOTPPeriod(HopPeriod);
 
@@ -136,6 +146,10 @@ protected:
 #ifndef LOLA_LINK_USE_TOKEN_HOP
 			Encoder->SetToken(CryptoSeed.GetSeed());
 #endif
+			//Session seed is set, precompute the first hops.
+			LastHopNumber = GetHopNumber();
+			Schedule.Reset(LastHopNumber);
+			SetCurrent(LastHopNumber);
 			Enable();
 			SetNextRunASAP();
 		}
@@ -146,10 +160,26 @@ protected:
 		Disable();
 	}
 
+	//Hop switch-over happens first, schedule is filled after.
 	bool Callback()
 	{
-		SetCurrent(CryptoSeed.GetToken(GetSyncMillis()));
-		SetNextRunDelay(HopPeriod - (GetSyncMillis() % HopPeriod));
+		HopNumber = GetHopNumber();
+
+		if (HopNumber != LastHopNumber)
+		{
+			LastHopNumber = HopNumber;
+			SetCurrent(HopNumber);
+		}
+
+		if (Schedule.FillNext(HopNumber))
+		{
+			//One entry per run, don't hog the scheduler.
+			SetNextRunASAP();
+		}
+		else
+		{
+			SetNextRunDelay(HopPeriod - (GetSyncMillis() % HopPeriod));
+		}
 
 		return true;
 	}
@@ -160,15 +190,22 @@ private:
 		return SyncedClock->GetSyncMicros() / (uint32_t)1000;
 	}
 
-	void SetCurrent(const uint32_t token)
+	inline uint32_t GetHopNumber()
 	{
-#ifdef LOLA_LINK_USE_TOKEN_HOP
-		Encoder->SetToken(token);
-#endif
+		return GetSyncMillis() / HopPeriod;
+	}
+
+	void SetCurrent(const uint32_t hopNumber)
+	{
+		//Token is set by the schedule.
+		Schedule.ApplyHop(hopNumber, ChannelToken);
 
 #ifdef LOLA_LINK_USE_FREQUENCY_HOP
-		//Use last 8 bits of crypto token to generate a pseudo-random channel distribution.
-		ChannelManager->SetNextHop((uint8_t)(token & 0xFF));
+		//Track the quality of the channel we are leaving.
+		ChannelManager->OnHopEnd(HopPeriod);
+
+		//Session keyed pseudo-random channel distribution.
+		ChannelManager->SetNextHop(ChannelToken, (uint8_t)(hopNumber & 0xFF));
 #endif
 	}
 };
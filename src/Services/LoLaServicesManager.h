@@ -14,6 +14,24 @@
 #define MAX_RADIO_SERVICES_COUNT 10
 #endif
 
+//Statically composed services, see TemplateServicesManager.
+class ILoLaServicesGroup
+{
+public:
+	virtual bool ProcessPacket(ILoLaPacket* receivedPacket) { return false; }
+	virtual bool ProcessAckedPacket(ILoLaPacket* receivedPacket) { return false; }
+	virtual bool ProcessAck(const uint8_t header, const uint8_t id) { return false; }
+	virtual bool ProcessSent(const uint8_t header) { return false; }
+	virtual bool ProcessSendFailed(const uint8_t header, const uint8_t id) { return false; }
+	virtual void NotifySendSlotOpen() {}
+	virtual void NotifyLinkUpdated(const bool connected) {}
+	virtual uint32_t GetWakeCount() { return 0; }
+	virtual uint8_t GetCount() { return 0; }
+#ifdef DEBUG_LOLA
+	virtual void Debug(Stream* serial) {}
+#endif
+};
+
 class LoLaServicesManager
 {
 private:
@@ -21,13 +39,19 @@ private:
 	uint8_t ServicesCount = 0;
 	bool Error = false;
 
+	//Header to owner service, straight dispatch for mapped headers.
+	//Only headers without an owner walk the services.
+	LoLaPacketMap* PacketMap = nullptr;
+
+	//Served after the dynamic services, one indirect call per event.
+	ILoLaServicesGroup* ServicesGroup = nullptr;
 
 	///Link Info Source
 	LoLaLinkInfo LinkInfo;
 	///
 
 public:
-	LoLaServicesManager() : LinkInfo()
+	LoLaServicesManager(LoLaPacketMap* packetMap) : PacketMap(packetMap), LinkInfo()
 	{
 		for (uint8_t i = 0; i < MAX_RADIO_SERVICES_COUNT; i++)
 		{
@@ -37,6 +61,14 @@ public:
 	
 	void ProcessPacket(ILoLaPacket* receivedPacket)
 	{
+		ILoLaService* owner = PacketMap->GetOwner(receivedPacket->GetDataHeader());
+
+		if (owner != nullptr)
+		{
+			owner->ReceivedPacket(receivedPacket);
+			return;
+		}
+
 		for (uint8_t i = 0; i < ServicesCount; i++)
 		{
 			if (Services[i] != nullptr && Services[i]->ReceivedPacket(receivedPacket))
@@ -44,10 +76,22 @@ public:
 				return;
 			}
 		}
+
+		if (ServicesGroup != nullptr)
+		{
+			ServicesGroup->ProcessPacket(receivedPacket);
+		}
 	}
 
 	bool ProcessAckedPacket(ILoLaPacket* receivedPacket)
 	{
+		ILoLaService* owner = PacketMap->GetOwner(receivedPacket->GetDataHeader());
+
+		if (owner != nullptr)
+		{
+			return owner->ReceivedAckedPacket(receivedPacket);
+		}
+
 		for (uint8_t i = 0; i < ServicesCount; i++)
 		{
 			if (Services[i] != nullptr && Services[i]->ReceivedAckedPacket(receivedPacket))
@@ -56,13 +100,21 @@ public:
 			}
 		}
 
-		return false;
+		return ServicesGroup != nullptr && ServicesGroup->ProcessAckedPacket(receivedPacket);
 	}
 
 	void ProcessSent(const uint8_t header)
 	{
 		if (header != PACKET_DEFINITION_ACK_HEADER)
 		{
+			ILoLaService* owner = PacketMap->GetOwner(header);
+
+			if (owner != nullptr)
+			{
+				owner->ProcessSent(header);
+				return;
+			}
+
 			for (uint8_t i = 0; i < ServicesCount; i++)
 			{
 				if (Services[i] != nullptr && Services[i]->ProcessSent(header))
@@ -70,9 +122,75 @@ public:
 					return;
 				}
 			}
+
+			if (ServicesGroup != nullptr)
+			{
+				ServicesGroup->ProcessSent(header);
+			}
+		}
+	}
+
+	void ProcessSendFailed(const uint8_t header, const uint8_t id)
+	{
+		ILoLaService* owner = PacketMap->GetOwner(header);
+
+		if (owner != nullptr)
+		{
+			owner->ProcessSendFailed(header, id);
+			return;
+		}
+
+		for (uint8_t i = 0; i < ServicesCount; i++)
+		{
+			if (Services[i] != nullptr && Services[i]->ProcessSendFailed(header, id))
+			{
+				return;
+			}
+		}
+
+		if (ServicesGroup != nullptr)
+		{
+			ServicesGroup->ProcessSendFailed(header, id);
+		}
+	}
+
+	void NotifySendSlotOpen()
+	{
+		for (uint8_t i = 0; i < ServicesCount; i++)
+		{
+			if (Services[i] != nullptr)
+			{
+				Services[i]->OnSendSlotOpen();
+			}
+		}
+
+		if (ServicesGroup != nullptr)
+		{
+			ServicesGroup->NotifySendSlotOpen();
 		}
 	}
 
+	//Sum of scheduler runs, for wake ups per second.
+	uint32_t GetWakeCount()
+	{
+		uint32_t wakeCount = 0;
+
+		for (uint8_t i = 0; i < ServicesCount; i++)
+		{
+			if (Services[i] != nullptr)
+			{
+				wakeCount += Services[i]->GetWakeCount();
+			}
+		}
+
+		if (ServicesGroup != nullptr)
+		{
+			wakeCount += ServicesGroup->GetWakeCount();
+		}
+
+		return wakeCount;
+	}
+
 	void NotifyServicesLinkUpdated(const bool connected)
 	{
 		for (uint8_t i = 0; i < ServicesCount; i++)
@@ -89,17 +207,43 @@ public:
 				}
 			}
 		}
+
+		if (ServicesGroup != nullptr)
+		{
+			ServicesGroup->NotifyLinkUpdated(connected);
+		}
 	}
 
 	void ProcessAck(ILoLaPacket* receivedPacket)
 	{
+		ProcessAck(receivedPacket->GetPayload()[0], receivedPacket->GetId());
+	}
+
+	//Standalone or piggybacked ack.
+	void ProcessAck(const uint8_t header, const uint8_t id)
+	{
+		LinkInfo.StampAckReceived(header, id);
+
+		ILoLaService* owner = PacketMap->GetOwner(header);
+
+		if (owner != nullptr)
+		{
+			owner->ReceivedAck(header, id);
+			return;
+		}
+
 		for (uint8_t i = 0; i < ServicesCount; i++)
 		{
-			if (Services[i] != nullptr && Services[i]->ReceivedAck(receivedPacket->GetPayload()[0], receivedPacket->GetId()))
+			if (Services[i] != nullptr && Services[i]->ReceivedAck(header, id))
 			{
 				return;
 			}
-		}		
+		}
+
+		if (ServicesGroup != nullptr)
+		{
+			ServicesGroup->ProcessAck(header, id);
+		}
 	}
 
 	ILoLaService* Get(uint8_t index)
@@ -143,6 +287,20 @@ public:
 		return true;
 	}
 
+	//Services are already initialized by the group.
+	bool SetServicesGroup(ILoLaServicesGroup* servicesGroup)
+	{
+		if (ServicesGroup != nullptr ||
+			servicesGroup == nullptr)
+		{
+			return false;
+		}
+
+		ServicesGroup = servicesGroup;
+
+		return true;
+	}
+
 #ifdef DEBUG_LOLA
 	void Debug(Stream* serial)
 	{
@@ -161,6 +319,13 @@ public:
 				serial->println();
 			}
 		}
+
+		if (ServicesGroup != nullptr)
+		{
+			serial->print(F("Static Services: "));
+			serial->println(ServicesGroup->GetCount());
+			ServicesGroup->Debug(serial);
+		}
 	}
 #endif
 };
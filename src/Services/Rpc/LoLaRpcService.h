@@ -0,0 +1,547 @@
+// LoLaRpcService.h
+
+#ifndef _LOLA_RPC_SERVICE_h
+#define _LOLA_RPC_SERVICE_h
+
+#include <Services\ILoLaService.h>
+#include <Services\Rpc\RpcPacketDefinitions.h>
+
+#define LOLA_RPC_DEFAULT_MAX_CALLS					(uint8_t)(8)
+#define LOLA_RPC_CHECK_PERIOD_MILLIS				(uint32_t)1
+#define LOLA_RPC_DEFAULT_DEADLINE_MILLIS			(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*10)
+
+//Requests without a reply are sent again after this, until the deadline.
+#define LOLA_RPC_RETRY_MILLIS						(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*2)
+
+//Latency histogram, last bucket takes everything above.
+#define LOLA_RPC_HISTOGRAM_BUCKET_MILLIS			(uint32_t)2
+#define LOLA_RPC_HISTOGRAM_BUCKET_COUNT				(uint8_t)32
+
+//Call status, as seen by the caller.
+#define LOLA_RPC_STATUS_OK							(uint8_t)0
+#define LOLA_RPC_STATUS_UNKNOWN_METHOD				(uint8_t)1
+#define LOLA_RPC_STATUS_ERROR						(uint8_t)2
+#define LOLA_RPC_STATUS_TIMED_OUT					(uint8_t)0xFF
+
+//Request/response calls, several in flight at once.
+//Both partners run the same service with the same BaseHeader, each is caller and callee.
+//Lost requests or replies are retried until the call's deadline.
+//The callee keeps its last replies, so a retried request is answered again without running twice.
+template<const uint8_t BaseHeader, const uint8_t MaxCalls = LOLA_RPC_DEFAULT_MAX_CALLS>
+class LoLaRpcService : public ILoLaService
+{
+	static_assert(MaxCalls > 0 && MaxCalls <= 32, "RPC max calls out of range.");
+
+public:
+	struct RpcStatsType
+	{
+		uint32_t StartMillis = 0;
+		uint32_t Calls = 0;
+		uint32_t Completed = 0;
+		uint32_t TimedOut = 0;
+		uint32_t Retries = 0;
+		uint32_t Served = 0;
+		uint32_t ServedAgain = 0;
+		uint16_t LatencyHistogram[LOLA_RPC_HISTOGRAM_BUCKET_COUNT] = {};
+	};
+
+private:
+	RpcRequestPacketDefinition<BaseHeader> RequestDefinition;
+	RpcReplyPacketDefinition<BaseHeader> ReplyDefinition;
+
+	TemplateLoLaPacket<LOLA_PACKET_MIN_PACKET_SIZE + PACKET_DEFINITION_RPC_PAYLOAD_SIZE> PacketHolder;
+
+	//Caller.
+	struct CallSlotType
+	{
+		uint8_t Arguments[LOLA_RPC_DATA_SIZE];
+		uint8_t MethodId = 0;
+		uint8_t RequestId = 0;
+		uint8_t Transmissions = 0;
+		uint32_t StartMillis = 0;
+		uint32_t DeadlineMillis = 0;
+		uint32_t SentMillis = 0;
+		bool Active = false;
+	} Calls[MaxCalls];
+
+	uint8_t NextRequestId = 0;
+
+	//Callee.
+	struct ReplySlotType
+	{
+		uint8_t Result[LOLA_RPC_DATA_SIZE];
+		uint8_t Status = 0;
+		uint8_t RequestId = 0;
+		bool Valid = false;
+		bool Pending = false;
+	} Replies[MaxCalls];
+
+	uint8_t NextReplySlot = 0;
+
+	RpcStatsType Stats;
+
+	//Helpers.
+	CallSlotType* CallSlot = nullptr;
+	ReplySlotType* ReplySlot = nullptr;
+	uint32_t NextTimeout = 0;
+	uint32_t Elapsed = 0;
+
+public:
+	LoLaRpcService(Scheduler* scheduler, ILoLaDriver* driver)
+		: ILoLaService(scheduler, LOLA_RPC_CHECK_PERIOD_MILLIS, driver)
+	{
+		PacketHolder.ClearDefinition();
+	}
+
+	//Returns false if the table is full. Arguments are zero padded.
+	bool Call(const uint8_t methodId, const uint8_t* arguments, const uint8_t length,
+		uint8_t &requestId, const uint32_t deadlineMillis = LOLA_RPC_DEFAULT_DEADLINE_MILLIS)
+	{
+		if (!IsSetupOk() || !LoLaDriver->HasLink() || length > LOLA_RPC_DATA_SIZE)
+		{
+			return false;
+		}
+
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (!Calls[i].Active)
+			{
+				CallSlot = &Calls[i];
+				CallSlot->Active = true;
+				CallSlot->MethodId = methodId;
+				CallSlot->RequestId = NextRequestId++;
+				CallSlot->Transmissions = 0;
+				CallSlot->StartMillis = millis();
+				CallSlot->DeadlineMillis = deadlineMillis;
+
+				memset(CallSlot->Arguments, 0, LOLA_RPC_DATA_SIZE);
+				if (length > 0)
+				{
+					memcpy(CallSlot->Arguments, arguments, length);
+				}
+
+				requestId = CallSlot->RequestId;
+				Stats.Calls++;
+
+				SetNextRunASAP();
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	uint8_t GetOutstandingCount()
+	{
+		uint8_t count = 0;
+
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (Calls[i].Active)
+			{
+				count++;
+			}
+		}
+
+		return count;
+	}
+
+	RpcStatsType* GetStats()
+	{
+		return &Stats;
+	}
+
+	//Benchmarks start here.
+	void ResetStats()
+	{
+		Stats = RpcStatsType();
+		Stats.StartMillis = millis();
+	}
+
+	uint32_t GetCallsPerSecond()
+	{
+		Elapsed = millis() - Stats.StartMillis;
+
+		if (Elapsed == 0)
+		{
+			return 0;
+		}
+
+		return (uint32_t)(((uint64_t)Stats.Completed * 1000) / Elapsed);
+	}
+
+	//Upper bound of the bucket holding the percentile, e.g. 99 for p99.
+	uint32_t GetLatencyPercentileMillis(const uint8_t percentile)
+	{
+		uint32_t total = 0;
+
+		for (uint8_t i = 0; i < LOLA_RPC_HISTOGRAM_BUCKET_COUNT; i++)
+		{
+			total += Stats.LatencyHistogram[i];
+		}
+
+		if (total == 0)
+		{
+			return 0;
+		}
+
+		const uint32_t target = ((total * percentile) + 99) / 100;
+		uint32_t count = 0;
+
+		for (uint8_t i = 0; i < LOLA_RPC_HISTOGRAM_BUCKET_COUNT; i++)
+		{
+			count += Stats.LatencyHistogram[i];
+			if (count >= target)
+			{
+				return (uint32_t)(i + 1) * LOLA_RPC_HISTOGRAM_BUCKET_MILLIS;
+			}
+		}
+
+		return LOLA_RPC_HISTOGRAM_BUCKET_COUNT * LOLA_RPC_HISTOGRAM_BUCKET_MILLIS;
+	}
+
+#ifdef DEBUG_LOLA
+	void DebugStats(Stream* serial)
+	{
+		serial->print(F("Calls/s: "));
+		serial->println(GetCallsPerSecond());
+		serial->print(F("Calls: "));
+		serial->print(Stats.Calls);
+		serial->print(F(" Completed: "));
+		serial->print(Stats.Completed);
+		serial->print(F(" Timed out: "));
+		serial->print(Stats.TimedOut);
+		serial->print(F(" Retries: "));
+		serial->println(Stats.Retries);
+		serial->print(F("p50: "));
+		serial->print(GetLatencyPercentileMillis(50));
+		serial->print(F(" ms p99: "));
+		serial->print(GetLatencyPercentileMillis(99));
+		serial->println(F(" ms"));
+	}
+#endif
+
+	void OnLinkEstablished()
+	{
+		ResetSession();
+		Enable();
+		SetNextRunASAP();
+	}
+
+	void OnLinkLost()
+	{
+		//Outstanding calls fail right away, no point in waiting for the deadline.
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (Calls[i].Active)
+			{
+				CompleteCall(&Calls[i], LOLA_RPC_STATUS_TIMED_OUT, nullptr);
+			}
+		}
+
+		ResetSession();
+		Disable();
+	}
+
+	//Dropped by the driver, goes again without waiting for the retry period.
+	bool ProcessSendFailed(const uint8_t header, const uint8_t id)
+	{
+		if (header == RequestDefinition.GetHeader())
+		{
+			for (uint8_t i = 0; i < MaxCalls; i++)
+			{
+				if (Calls[i].Active && Calls[i].RequestId == id)
+				{
+					Calls[i].SentMillis = millis() - LOLA_RPC_RETRY_MILLIS;
+					SetNextRunASAP();
+				}
+			}
+
+			return true;
+		}
+		else if (header == ReplyDefinition.GetHeader())
+		{
+			for (uint8_t i = 0; i < MaxCalls; i++)
+			{
+				if (Replies[i].Valid && Replies[i].RequestId == id)
+				{
+					Replies[i].Pending = true;
+					SetNextRunASAP();
+				}
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool ProcessPacket(ILoLaPacket* incomingPacket)
+	{
+		if (incomingPacket->GetDataHeader() == RequestDefinition.GetHeader())
+		{
+			OnRequestReceived(incomingPacket->GetId(), incomingPacket->GetPayload());
+
+			return true;
+		}
+		else if (incomingPacket->GetDataHeader() == ReplyDefinition.GetHeader())
+		{
+			OnReplyReceived(incomingPacket->GetId(), incomingPacket->GetPayload());
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Callback()
+	{
+		if (!LoLaDriver->HasLink())
+		{
+			SetNextRunLong();
+
+			return false;
+		}
+
+		CheckDeadlines();
+
+		//Replies first, someone is waiting on them.
+		ReplySlot = GetPendingReply();
+		CallSlot = GetNextToSend();
+
+		if (ReplySlot == nullptr && CallSlot == nullptr)
+		{
+			SetNextRunDelay(NextTimeout);
+
+			return false;
+		}
+
+		if (!AllowedSend())
+		{
+			SetNextRunOnSendSlot(NextTimeout);
+
+			return false;
+		}
+
+		if (ReplySlot != nullptr ? SendReply(ReplySlot) : SendRequest(CallSlot))
+		{
+			SetNextRunASAP();
+		}
+		else
+		{
+			SetNextRunOnSendSlot(NextTimeout);
+		}
+
+		return true;
+	}
+
+protected:
+	//Callee side, result is zero filled. Returns the call status.
+	virtual uint8_t OnCallReceived(const uint8_t methodId, uint8_t* arguments, uint8_t* result) { return LOLA_RPC_STATUS_UNKNOWN_METHOD; }
+
+	//Caller side, result is nullptr on time out.
+	virtual void OnCallCompleted(const uint8_t requestId, const uint8_t methodId, const uint8_t status, uint8_t* result) {}
+
+#ifdef DEBUG_LOLA
+	virtual void PrintName(Stream* serial)
+	{
+		serial->print(F("Rpc"));
+	}
+#endif
+
+	bool OnAddPacketMap(LoLaPacketMap* packetMap)
+	{
+		if (!packetMap->AddMapping(&RequestDefinition) ||
+			!packetMap->AddMapping(&ReplyDefinition))
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	void ResetSession()
+	{
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			Calls[i].Active = false;
+			Replies[i].Valid = false;
+			Replies[i].Pending = false;
+		}
+
+		NextRequestId = 0;
+		NextReplySlot = 0;
+	}
+
+	///Caller.
+	void CheckDeadlines()
+	{
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (Calls[i].Active &&
+				millis() - Calls[i].StartMillis >= Calls[i].DeadlineMillis)
+			{
+				CompleteCall(&Calls[i], LOLA_RPC_STATUS_TIMED_OUT, nullptr);
+			}
+		}
+	}
+
+	//Oldest call first, new requests and due retries alike.
+	CallSlotType* GetNextToSend()
+	{
+		CallSlotType* next = nullptr;
+
+		NextTimeout = LOLA_SERVICE_LONG_SLEEP_PERIOD_MILLIS;
+
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (!Calls[i].Active)
+			{
+				continue;
+			}
+
+			Elapsed = millis() - Calls[i].StartMillis;
+			if (Elapsed < Calls[i].DeadlineMillis)
+			{
+				NextTimeout = min(NextTimeout, Calls[i].DeadlineMillis - Elapsed);
+			}
+
+			if (Calls[i].Transmissions == 0 ||
+				millis() - Calls[i].SentMillis >= LOLA_RPC_RETRY_MILLIS)
+			{
+				if (next == nullptr || (int32_t)(Calls[i].StartMillis - next->StartMillis) < 0)
+				{
+					next = &Calls[i];
+				}
+			}
+			else
+			{
+				NextTimeout = min(NextTimeout, LOLA_RPC_RETRY_MILLIS - (millis() - Calls[i].SentMillis));
+			}
+		}
+
+		return next;
+	}
+
+	bool SendRequest(CallSlotType* call)
+	{
+		PacketHolder.SetDefinition(&RequestDefinition);
+		PacketHolder.SetId(call->RequestId);
+		PacketHolder.GetPayload()[0] = call->MethodId;
+		memcpy(&PacketHolder.GetPayload()[1], call->Arguments, LOLA_RPC_DATA_SIZE);
+
+		if (SendPacket(&PacketHolder))
+		{
+			if (call->Transmissions > 0)
+			{
+				Stats.Retries++;
+			}
+
+			if (call->Transmissions < UINT8_MAX)
+			{
+				call->Transmissions++;
+			}
+			call->SentMillis = millis();
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void OnReplyReceived(const uint8_t requestId, uint8_t* payload)
+	{
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (Calls[i].Active && Calls[i].RequestId == requestId)
+			{
+				Elapsed = millis() - Calls[i].StartMillis;
+				Stats.LatencyHistogram[min((uint32_t)(Elapsed / LOLA_RPC_HISTOGRAM_BUCKET_MILLIS), (uint32_t)(LOLA_RPC_HISTOGRAM_BUCKET_COUNT - 1))]++;
+				Stats.Completed++;
+
+				CompleteCall(&Calls[i], payload[0], &payload[1]);
+				SetNextRunASAP();
+
+				return;
+			}
+		}
+
+		//Late or duplicate reply, call is already done.
+	}
+
+	void CompleteCall(CallSlotType* call, const uint8_t status, uint8_t* result)
+	{
+		call->Active = false;
+
+		if (status == LOLA_RPC_STATUS_TIMED_OUT)
+		{
+			Stats.TimedOut++;
+		}
+
+		OnCallCompleted(call->RequestId, call->MethodId, status, result);
+	}
+	///
+
+	///Callee.
+	void OnRequestReceived(const uint8_t requestId, uint8_t* payload)
+	{
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (Replies[i].Valid && Replies[i].RequestId == requestId)
+			{
+				//Our reply got lost, send it again without running the call.
+				Replies[i].Pending = true;
+				Stats.ServedAgain++;
+				SetNextRunASAP();
+
+				return;
+			}
+		}
+
+		ReplySlot = &Replies[NextReplySlot];
+		NextReplySlot = (NextReplySlot + 1) % MaxCalls;
+
+		memset(ReplySlot->Result, 0, LOLA_RPC_DATA_SIZE);
+		ReplySlot->RequestId = requestId;
+		ReplySlot->Status = OnCallReceived(payload[0], &payload[1], ReplySlot->Result);
+		ReplySlot->Valid = true;
+		ReplySlot->Pending = true;
+		Stats.Served++;
+
+		SetNextRunASAP();
+	}
+
+	ReplySlotType* GetPendingReply()
+	{
+		for (uint8_t i = 0; i < MaxCalls; i++)
+		{
+			if (Replies[i].Pending)
+			{
+				return &Replies[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	bool SendReply(ReplySlotType* reply)
+	{
+		PacketHolder.SetDefinition(&ReplyDefinition);
+		PacketHolder.SetId(reply->RequestId);
+		PacketHolder.GetPayload()[0] = reply->Status;
+		memcpy(&PacketHolder.GetPayload()[1], reply->Result, LOLA_RPC_DATA_SIZE);
+
+		if (SendPacket(&PacketHolder))
+		{
+			reply->Pending = false;
+
+			return true;
+		}
+
+		return false;
+	}
+	///
+};
+#endif
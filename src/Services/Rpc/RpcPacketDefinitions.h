@@ -0,0 +1,49 @@
+// RpcPacketDefinitions.h
+
+#ifndef _RPCPACKETDEFINITIONS_h
+#define _RPCPACKETDEFINITIONS_h
+
+#include <Packet\PacketDefinition.h>
+
+// Request: [RequestId as Id|MethodId|Arguments(8)].
+// Reply: [RequestId as Id|Status|Result(8)].
+#define PACKET_DEFINITION_RPC_REQUEST_HEADER_OFFSET		0
+#define PACKET_DEFINITION_RPC_REPLY_HEADER_OFFSET		1
+#define PACKET_DEFINITION_RPC_PAYLOAD_SIZE				9
+
+#define RPC_SERVICE_PACKET_DEFINITION_COUNT				2
+
+#define LOLA_RPC_DATA_SIZE								(uint8_t)(PACKET_DEFINITION_RPC_PAYLOAD_SIZE - 1)
+
+template <const uint8_t BaseHeader>
+class RpcRequestPacketDefinition : public PacketDefinition
+{
+public:
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_RPC_REQUEST_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_RPC_PAYLOAD_SIZE; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("RpcRequest"));
+	}
+#endif
+};
+
+template <const uint8_t BaseHeader>
+class RpcReplyPacketDefinition : public PacketDefinition
+{
+public:
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_RPC_REPLY_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_RPC_PAYLOAD_SIZE; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("RpcReply"));
+	}
+#endif
+};
+#endif
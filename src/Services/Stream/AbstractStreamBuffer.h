@@ -1,29 +1,47 @@
-// AbstractStream.h
+// AbstractStreamBuffer.h
 
 #ifndef _ABSTRACT_STREAM_h
 #define _ABSTRACT_STREAM_h
 
-#define STREAM_RETRANSMIT
-
 #include <Arduino.h>
 #include <Services\IPacketSendService.h>
-#include <RingBufCPP.h>
 #include <Services\Stream\ITrackedStream.h>
+#include <Services\Stream\StreamPacketDefinitions.h>
+
+#define ABSTRACT_STREAM_RETRY_PERIOD					((uint32_t)50)
+#define ABSTRACT_STREAM_IDLE_CHECK_PERIOD				((uint32_t)1000)
+#define ABSTRACT_STREAM_CHECK_PERIOD_MILLIS				((uint32_t)1)
+
+//Reader waits a bit for the gap to grow, so one NACK covers a burst.
+#define ABSTRACT_STREAM_NACK_BATCH_MILLIS				((uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS/2))
+#define ABSTRACT_STREAM_NACK_RETRY_MILLIS				((uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*2))
+//Gaps are given up after this, stream latency stays bounded.
+#define ABSTRACT_STREAM_REORDER_TIMEOUT_MILLIS			((uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*8))
 
-#define ABSTRACT_STREAM_RETRY_PERIDO					((uint32_t)50)
-#define ABSTRACT_STREAM_REPLY_CHECK_PERIOD				(ABSTRACT_STREAM_RETRY_PERIDO*2)
+#define ABSTRACT_STREAM_DEFAULT_CACHE_SIZE				(uint8_t)(16)
+#define ABSTRACT_STREAM_DEFAULT_REORDER_SIZE			(uint8_t)(8)
+#define ABSTRACT_STREAM_MAX_WINDOW_SIZE					(uint8_t)(32) //NACK bitmap is 32 bits wide.
 
-template <class DataType, const uint8_t BufferSize>
 class AbstractStreamBuffer : public IPacketSendService
 {
 private:
-	uint32_t LastSent = ILOLA_INVALID_MILLIS;
-	TemplateTrackedStreamBuffer <DataType, BufferSize> TrackedBuffer;
+	PacketDefinition* MetaDefinition = nullptr;
+	PacketDefinition* DataDefinition = nullptr;
 
-	DataType* Grunt;
-protected:
-	ITrackedStream * TrackedStream = nullptr;
+	static const uint8_t STREAM_META_SUB_HEADER_SERVICE_DISCOVERY = 0;
+	static const uint8_t STREAM_META_SUB_HEADER_NACK = 1;
+
+	union ArrayToUint32 {
+		byte array[4];
+		uint32_t uint;
+	} ATUI;
 
+	//Helper.
+	uint8_t MetaSizeHelper = 0;
+
+	TemplateLoLaPacket<LOLA_PACKET_MAX_PACKET_SIZE> PacketHolder;
+
+protected:
 	enum StreamStateEnum : uint8_t
 	{
 		WaitingForServiceDiscovery = 0,
@@ -32,73 +50,95 @@ protected:
 	} StreamState = StreamStateEnum::Disabled;
 
 protected:
-	virtual void OnWaitingForServiceDiscovery() {}
-	virtual void OnNewDataAvailable() {}
-	virtual void Clear() {};
-
-	virtual void OnStreamActive() {}
-
-public:
-	AbstractStream(Scheduler* scheduler, ILoLa* loLa, ITrackedStream* trackedStream, ILoLaPacket* packetHolder)
-		: IPacketSendService(scheduler, 0, loLa, packetHolder)
-	{
-		TrackedStream = trackedStream;
+	virtual void OnWaitingForServiceDiscovery() { SetNextRunDelay(ABSTRACT_STREAM_IDLE_CHECK_PERIOD); }
+	virtual void OnStreamActive() { SetNextRunDelay(ABSTRACT_STREAM_IDLE_CHECK_PERIOD); }
+	virtual void OnStateUpdated(const StreamStateEnum newState) {}
 
-		StreamState = StreamStateEnum::Disabled;
-	}
+	//Reader.
+	virtual void OnDataPacketReceived(const uint8_t id, uint8_t* payload) {}
 
-	bool OnEnable()
-	{
-		return true;
-	}
+	//Writer.
+	virtual void OnServiceDiscoveryReceived() {}
+	virtual void OnNackReceived(const uint8_t firstId, const uint32_t bitmap) {}
 
-	ITrackedStream* GetStream()
+public:
+	AbstractStreamBuffer(Scheduler* scheduler, ILoLaDriver* driver, PacketDefinition* metaDefinition, PacketDefinition* dataDefinition)
+		: IPacketSendService(scheduler, ABSTRACT_STREAM_CHECK_PERIOD_MILLIS, driver, &PacketHolder)
 	{
-		return TrackedStream;
+		MetaDefinition = metaDefinition;
+		DataDefinition = dataDefinition;
 	}
 
 	void OnLinkEstablished()
 	{
-		Enable();
-		StreamState = StreamStateEnum::WaitingForServiceDiscovery;
-		SetNextRunASAP();
+		UpdateStreamState(StreamStateEnum::WaitingForServiceDiscovery);
 	}
 
 	void OnLinkLost()
 	{
-		Disable();
-		StreamState = StreamStateEnum::Disabled;
+		UpdateStreamState(StreamStateEnum::Disabled);
 	}
 
-	void OnNewDataAvailableEvent(uint8_t param)
+	bool IsActive()
 	{
-		OnNewDataAvailable();
+		return StreamState == StreamStateEnum::Active;
 	}
 
 protected:
-	virtual bool OnSetup()
+	bool OnAddPacketMap(LoLaPacketMap* packetMap)
 	{
-		if (IPacketSendService::OnSetup() && TrackedStream != nullptr)
+		if (!packetMap->AddMapping(MetaDefinition) ||
+			!packetMap->AddMapping(DataDefinition))
 		{
-			MethodSlot<AbstractSync, uint8_t> memFunSlot(this, &AbstractStreamBuffer::OnNewDataAvailableEvent);
-			TrackedStream->AttachOnNewDataAvailableCallback(memFunSlot);
-			return true;
+			return false;
 		}
 
-		return false;
+		return true;
 	}
 
-	inline void NotifyDataChanged()
+	bool ProcessPacket(ILoLaPacket* incomingPacket)
 	{
-		if (TrackedStream != nullptr)
+		if (incomingPacket->GetDataHeader() == DataDefinition->GetHeader())
 		{
-			TrackedStream->NotifyDataChanged();
+			OnDataPacketReceived(incomingPacket->GetId(), incomingPacket->GetPayload());
+
+			return true;
 		}
-	}
+		else if (incomingPacket->GetDataHeader() == MetaDefinition->GetHeader())
+		{
+			switch (incomingPacket->GetId())
+			{
+			case STREAM_META_SUB_HEADER_SERVICE_DISCOVERY:
+				OnServiceDiscoveryReceived();
+				break;
+			case STREAM_META_SUB_HEADER_NACK:
+				if (incomingPacket->GetPayloadSize() < 1)
+				{
+					break;
+				}
 
-	void Clear()
-	{
-		TrackedStream->Clear();
+				//Trimmed bitmap bytes are zero.
+				for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+				{
+					if ((uint8_t)(1 + i) < incomingPacket->GetPayloadSize())
+					{
+						ATUI.array[i] = incomingPacket->GetPayload()[1 + i];
+					}
+					else
+					{
+						ATUI.array[i] = 0;
+					}
+				}
+				OnNackReceived(incomingPacket->GetPayload()[0], ATUI.uint);
+				break;
+			default:
+				break;
+			}
+
+			return true;
+		}
+
+		return false;
 	}
 
 	void OnService()
@@ -117,244 +157,54 @@ protected:
 			break;
 		}
 	}
-};
-
-template <class DataType, const uint8_t BufferSize, const uint8_t CacheSize>
-class AbstractStreamReader : public AbstractStreamBuffer<DataType, BufferSize>
-{
-private:
-	RingBufCPP<DataType, CacheSize> SideBuffer;
-
-	DataType ReaderGrunt;
-
-public:
-	AbstractStreamReader(Scheduler* scheduler, ILoLa* loLa, const uint8_t baseHeader, ITrackedStream* trackedStream)
-		: AbstractStream(scheduler, loLa, baseHeader, trackedStream)
-	{
-	}
-
-private:
-	bool IsStreamContinuous()
-	{
-		return true;//TODO:
-	}
-
-	uint8_t GetMissingStreamId()
-	{
-		return 0;//TODO:
-	}
 
-	void PrepareRequestRetransmitPacket(const uint8_t id)
-	{
-		//TODO:
-	}
-
-protected:
-	virtual bool DecodePayload(DataType * target, uint8_t[] payload)
+	void UpdateStreamState(const StreamStateEnum newState)
 	{
-		return false;//TODO:
-	}
-
-
-protected:
-
-	void ProcessStreamPacket(uint8_t[] payload)
-	{
-		switch (StreamState)
+		if (StreamState != newState)
 		{
-		case StreamStateEnum::WaitingForServiceDiscovery:
-			StreamState = StreamStateEnum::Active;
-			Enable();
-			SetNextRunASAP();
-		case StreamStateEnum::Active:
-			if (DecodePayload(&ReaderGrunt, payload))
-			{
-				TrackedStream.AddNew(ReaderGrunt);
-			}
-			else
+			StreamState = newState;
+
+			if (StreamState != StreamStateEnum::Disabled)
 			{
-				//TODO:
+				Enable(); //Make sure we are running.
+				SetNextRunASAP();
 			}
-			break;
-		case SyncStateEnum::Disabled:
-			break;
-		default:
-			break;
-		}
-	}
-
-	void OnWaitingForServiceDiscovery()
-	{
-		if (LastSent != ILOLA_INVALID_MILLIS ||
-			Millis() - LastSent > ABSTRACT_STREAM_RETRY_PERIDO)
-		{
-			PrepareServiceDiscoveryPacket();
-			RequestSendPacket();
-		}
-		else
-		{
-			SetNextRunDelay(ABSTRACT_STREAM_REPLY_CHECK_PERIOD);
-		}
-	}
 
-	void OnStreamActive()
-	{
-		if (IsStreamContinuous())
-		{
-			SetNextRunDelay(1000);
-		}
-		else
-		{
-			uint8_t MissingId = GetMissingStreamId();
-			PrepareRequestRetransmitPacket(MissingId);
-			RequestSendPacket();
+			OnStateUpdated(StreamState);
 		}
 	}
-};
-
 
-template <class DataType, const uint8_t BufferSize, const uint8_t CacheSize>
-class AbstractStreamWriter : public AbstractStreamBuffer<DataType, BufferSize>
-{
-public:
-	AbstractStreamReader(Scheduler* scheduler, ILoLa* loLa, const uint8_t baseHeader, ITrackedStream* trackedStream)
-		: AbstractStream(scheduler, loLa, baseHeader, trackedStream)
+	void PrepareDataPacket(const uint8_t id, const uint8_t* data)
 	{
+		Packet->SetDefinition(DataDefinition);
+		Packet->SetId(id);
+		memcpy(Packet->GetPayload(), data, DataDefinition->GetPayloadSize());
 	}
-private:
-#ifdef STREAM_RETRANSMIT
-
-	template <class DataType, const uint8_t CacheSize>
-	class SearcheableRingBufCPP
-	{
-	private:
-		RingBufCPP<DataType, CacheSize> DataList;
-
-	public:
-
-		inline void AddNew(DataType * newData)
-		{
-			DataList.forcePush(*newData);
-		}
-		//TODO: Doesn't work unless DataType has explicit GetId()
-		DataType * FindCached(const uint8_t id)
-		{
-			/*	for (uint8_t i = 0; i < DataList.numElements(); i++)
-				{
-					if (DataList.peek(i)->GetId() == id)
-					{
-						return DataList.peek(i);
-					}
-				}*/
-
-			return nullptr;
-		}
-	};
-
-
-	SearcheableRingBufCPP<DataType, CacheSize> RetransmitCache;
-
-	RingBufCPP<uint8_t, CacheSize> RetransmitRequests;
 
-	uint8_t RetransmitRequestId;
-#endif
-
-protected:
-	virtual void ProcessStreamPacket(DataType * newData);
-
-private:
-#ifdef STREAM_RETRANSMIT
-
-	bool AllowedRetransmit()
+	void PrepareServiceDiscoveryPacket()
 	{
-		return TrackedStream.GetCount() < (BufferSize / 2);
+		Packet->SetDefinition(MetaDefinition);
+		Packet->SetId(STREAM_META_SUB_HEADER_SERVICE_DISCOVERY);
+		Packet->SetPayloadSize(0);
 	}
-#endif
 
-protected:
-	void OnServiceDiscoveryReceived()
+	void PrepareNackPacket(const uint8_t firstId, const uint32_t bitmap)
 	{
-		switch (StreamState)
-		{
-		case StreamStateEnum::WaitingForServiceDiscovery:
-			StreamState = StreamStateEnum::Active;
-			Enable();
-			SetNextRunASAP();
-			break;
-		case StreamStateEnum::Active:
-			break;
-		case SyncStateEnum::Disabled:
-			break;
-		default:
-			break;
-		}
-	}
+		Packet->SetDefinition(MetaDefinition);
+		Packet->SetId(STREAM_META_SUB_HEADER_NACK);
+		Packet->GetPayload()[0] = firstId;
 
-#ifdef STREAM_RETRANSMIT
-	void OnRetransmitRequestReceived(const uint8_t requestedId)
-	{
-		switch (StreamState)
+		ATUI.uint = bitmap;
+		MetaSizeHelper = 1;
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
 		{
-		case StreamStateEnum::WaitingForServiceDiscovery:
-			StreamState = StreamStateEnum::Active;
-			Enable();
-			SetNextRunASAP();
-			break;
-		case StreamStateEnum::Active:
-			RetransmitRequests.forcePush(requestedId);
-			Enable();
-			SetNextRunASAP();
-			break;
-		case SyncStateEnum::Disabled:
-			break;
-		default:
-			break;
-		}
-	}
-#endif
-
-	void OnStreamActive()
-	{
-#ifdef STREAM_RETRANSMIT
-		if(!RetransmitRequests.isEmpty())
-		{
-			if (AllowedRetransmit())
+			Packet->GetPayload()[1 + i] = ATUI.array[i];
+			if (ATUI.array[i] != 0)
 			{
-				RetransmitRequests.pull(RetransmitRequestId);
-
-				Grunt = RetransmitCache.FindCached(RetransmitRequestId);
-
-				if (Grunt != nullptr)
-				{
-					PrepareStreamPacket(Grunt);
-					RequestSendPacket();
-				}
+				MetaSizeHelper = 2 + i;
 			}
-			else
-			{
-				//Clear requests;
-				while (!RetransmitRequests.isEmpty())
-				{
-					RetransmitRequests.pull();
-				}
-			}
-		}
-		else 
-#endif
-		if (TrackedStream.HasData())
-		{
-			Grunt = TrackedStream->PullOldest();
-			PrepareStreamPacket(Grunt);
-			RequestSendPacket();
-			RetransmitCache.AddNew(Grunt);
 		}
-		else
-		{
-			SetNextRunDelay(1000);
-		}
-		//TODO:
+		Packet->SetPayloadSize(MetaSizeHelper);
 	}
 };
-
 #endif
-
@@ -0,0 +1,281 @@
+// AbstractStreamReader.h
+
+#ifndef _ABSTRACT_STREAM_READER_h
+#define _ABSTRACT_STREAM_READER_h
+
+#include <Services\Stream\AbstractStreamBuffer.h>
+
+template <const uint8_t BaseHeader, class DataType, const uint8_t BufferSize, const uint8_t ReorderSize = ABSTRACT_STREAM_DEFAULT_REORDER_SIZE>
+class AbstractStreamReader : public AbstractStreamBuffer
+{
+	static_assert(ReorderSize > 1 && ReorderSize <= ABSTRACT_STREAM_MAX_WINDOW_SIZE, "Stream reorder size out of range.");
+	static_assert((ReorderSize & (ReorderSize - 1)) == 0, "Stream reorder size must be a power of 2.");
+	static_assert(sizeof(DataType) <= (LOLA_PACKET_MAX_PACKET_SIZE - LOLA_PACKET_MIN_PACKET_SIZE), "Stream chunk doesn't fit in a packet.");
+
+private:
+	StreamMetaPacketDefinition<BaseHeader> MetaDefinition;
+	StreamDataPacketDefinition<BaseHeader, sizeof(DataType)> DataDefinition;
+
+	TemplateTrackedStreamBuffer<DataType, BufferSize> TrackedBuffer;
+
+	//Out of order chunks, waiting for the gap to be filled.
+	struct ReorderSlotType
+	{
+		DataType Data;
+		bool Valid = false;
+	} ReorderBuffer[ReorderSize];
+
+	uint8_t NextId = 0;
+	uint8_t ReorderCount = 0;
+
+	uint32_t GapStartMillis = ILOLA_INVALID_MILLIS;
+	uint32_t LastNackMillis = ILOLA_INVALID_MILLIS;
+	uint32_t LastSent = ILOLA_INVALID_MILLIS;
+
+	//Statistics.
+	uint32_t DeliveredCount = 0;
+	uint32_t LostCount = 0;
+	uint32_t DuplicateCount = 0;
+	uint32_t NackCount = 0;
+	uint32_t MaxGapMillis = 0;
+
+	//Helpers.
+	ReorderSlotType* Slot = nullptr;
+	uint8_t Offset = 0;
+
+public:
+	AbstractStreamReader(Scheduler* scheduler, ILoLaDriver* driver)
+		: AbstractStreamBuffer(scheduler, driver, &MetaDefinition, &DataDefinition)
+	{
+	}
+
+	//Application side, PullOldest() to consume the stream, in order.
+	TemplateTrackedStreamBuffer<DataType, BufferSize>* GetStream()
+	{
+		return &TrackedBuffer;
+	}
+
+	uint32_t GetDeliveredCount()
+	{
+		return DeliveredCount;
+	}
+
+	uint32_t GetLostCount()
+	{
+		return LostCount;
+	}
+
+	uint32_t GetDuplicateCount()
+	{
+		return DuplicateCount;
+	}
+
+	uint32_t GetNackCount()
+	{
+		return NackCount;
+	}
+
+	//Longest time a gap held back the stream, for latency.
+	uint32_t GetMaxGapMillis()
+	{
+		return MaxGapMillis;
+	}
+
+protected:
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("StreamReader"));
+	}
+#endif
+
+	void OnStateUpdated(const StreamStateEnum newState)
+	{
+		if (newState != StreamStateEnum::Active)
+		{
+			for (uint8_t i = 0; i < ReorderSize; i++)
+			{
+				ReorderBuffer[i].Valid = false;
+			}
+			ReorderCount = 0;
+			GapStartMillis = ILOLA_INVALID_MILLIS;
+			LastNackMillis = ILOLA_INVALID_MILLIS;
+			LastSent = ILOLA_INVALID_MILLIS;
+		}
+	}
+
+	void OnWaitingForServiceDiscovery()
+	{
+		if (LastSent == ILOLA_INVALID_MILLIS ||
+			millis() - LastSent > ABSTRACT_STREAM_RETRY_PERIOD)
+		{
+			LastSent = millis();
+			PrepareServiceDiscoveryPacket();
+			RequestSendPacket();
+		}
+		else
+		{
+			SetNextRunDelay(ABSTRACT_STREAM_RETRY_PERIOD);
+		}
+	}
+
+	void OnDataPacketReceived(const uint8_t id, uint8_t* payload)
+	{
+		switch (StreamState)
+		{
+		case StreamStateEnum::WaitingForServiceDiscovery:
+			//Stream starts wherever the writer is.
+			NextId = id;
+			UpdateStreamState(StreamStateEnum::Active);
+			//Fall through.
+		case StreamStateEnum::Active:
+			break;
+		case StreamStateEnum::Disabled:
+		default:
+			return;
+		}
+
+		Offset = id - NextId;
+
+		if (Offset != 0 && (uint8_t)(NextId - id) <= ReorderSize)
+		{
+			//Just behind, already delivered or given up.
+			DuplicateCount++;
+			return;
+		}
+
+		//Too far ahead, make room by giving up on the oldest.
+		while (ReorderCount > 0 && (uint8_t)(id - NextId) >= ReorderSize)
+		{
+			AdvanceOne();
+		}
+
+		if ((uint8_t)(id - NextId) >= ReorderSize)
+		{
+			//Nothing left to wait for, resync to the writer and count the gap as lost.
+			LostCount += (uint8_t)(id - NextId);
+			NextId = id;
+		}
+
+		Slot = &ReorderBuffer[id % ReorderSize];
+		if (Slot->Valid)
+		{
+			DuplicateCount++;
+		}
+		else
+		{
+			memcpy((uint8_t*)&Slot->Data, payload, sizeof(DataType));
+			Slot->Valid = true;
+			ReorderCount++;
+		}
+
+		DeliverInOrder();
+		UpdateGap();
+
+		SetNextRunASAP();
+	}
+
+	void OnStreamActive()
+	{
+		if (ReorderCount == 0)
+		{
+			SetNextRunDelay(ABSTRACT_STREAM_IDLE_CHECK_PERIOD);
+			return;
+		}
+
+		if (millis() - GapStartMillis >= ABSTRACT_STREAM_REORDER_TIMEOUT_MILLIS)
+		{
+			//Give up on the oldest gap, deliver what comes after it.
+			while (!ReorderBuffer[NextId % ReorderSize].Valid)
+			{
+				AdvanceOne();
+			}
+			DeliverInOrder();
+			MaxGapMillis = max(MaxGapMillis, millis() - GapStartMillis);
+			GapStartMillis = ILOLA_INVALID_MILLIS;
+			LastNackMillis = ILOLA_INVALID_MILLIS;
+			UpdateGap();
+			SetNextRunASAP();
+		}
+		else if (millis() - GapStartMillis >= ABSTRACT_STREAM_NACK_BATCH_MILLIS &&
+			(LastNackMillis == ILOLA_INVALID_MILLIS || millis() - LastNackMillis >= ABSTRACT_STREAM_NACK_RETRY_MILLIS))
+		{
+			LastNackMillis = millis();
+			NackCount++;
+			PrepareNackPacket(NextId, GetMissingBitmap());
+			RequestSendPacket();
+		}
+		else
+		{
+			SetNextRunDelay(ABSTRACT_STREAM_CHECK_PERIOD_MILLIS);
+		}
+	}
+
+private:
+	void AdvanceOne()
+	{
+		Slot = &ReorderBuffer[NextId % ReorderSize];
+
+		if (Slot->Valid)
+		{
+			Slot->Valid = false;
+			ReorderCount--;
+			DeliveredCount++;
+			TrackedBuffer.AddNew(Slot->Data);
+		}
+		else
+		{
+			LostCount++;
+		}
+
+		NextId++;
+	}
+
+	void DeliverInOrder()
+	{
+		while (ReorderBuffer[NextId % ReorderSize].Valid)
+		{
+			AdvanceOne();
+		}
+	}
+
+	void UpdateGap()
+	{
+		if (ReorderCount > 0)
+		{
+			if (GapStartMillis == ILOLA_INVALID_MILLIS)
+			{
+				GapStartMillis = millis();
+			}
+		}
+		else if (GapStartMillis != ILOLA_INVALID_MILLIS)
+		{
+			MaxGapMillis = max(MaxGapMillis, millis() - GapStartMillis);
+			GapStartMillis = ILOLA_INVALID_MILLIS;
+			LastNackMillis = ILOLA_INVALID_MILLIS;
+		}
+	}
+
+	//All missing Ids up to the newest received, in one NACK.
+	uint32_t GetMissingBitmap()
+	{
+		uint32_t bitmap = 0;
+		uint32_t missing = 0;
+
+		for (uint8_t i = 0; i < ReorderSize; i++)
+		{
+			if (ReorderBuffer[(uint8_t)(NextId + i) % ReorderSize].Valid)
+			{
+				bitmap |= missing;
+				missing = 0;
+			}
+			else
+			{
+				missing |= (uint32_t)1 << i;
+			}
+		}
+
+		return bitmap;
+	}
+};
+#endif
@@ -0,0 +1,205 @@
+// AbstractStreamWriter.h
+
+#ifndef _ABSTRACT_STREAM_WRITER_h
+#define _ABSTRACT_STREAM_WRITER_h
+
+#include <Services\Stream\AbstractStreamBuffer.h>
+
+template <const uint8_t BaseHeader, class DataType, const uint8_t BufferSize, const uint8_t CacheSize = ABSTRACT_STREAM_DEFAULT_CACHE_SIZE>
+class AbstractStreamWriter : public AbstractStreamBuffer
+{
+	static_assert(CacheSize > 0 && CacheSize <= ABSTRACT_STREAM_MAX_WINDOW_SIZE, "Stream cache size out of range.");
+	static_assert((CacheSize & (CacheSize - 1)) == 0, "Stream cache size must be a power of 2.");
+	static_assert(sizeof(DataType) <= (LOLA_PACKET_MAX_PACKET_SIZE - LOLA_PACKET_MIN_PACKET_SIZE), "Stream chunk doesn't fit in a packet.");
+
+private:
+	StreamMetaPacketDefinition<BaseHeader> MetaDefinition;
+	StreamDataPacketDefinition<BaseHeader, sizeof(DataType)> DataDefinition;
+
+	TemplateTrackedStreamBuffer<DataType, BufferSize> TrackedBuffer;
+
+	//Sent chunks, indexed by Id, so a NACK lookup is a single read.
+	struct CacheEntryType
+	{
+		DataType Data;
+		uint8_t Id = 0;
+		bool Valid = false;
+	} RetransmitCache[CacheSize];
+
+	//Bit set per cache entry requested by the reader.
+	uint32_t RetransmitPending = 0;
+
+	uint8_t NextId = 0;
+
+	//Statistics.
+	uint32_t SentCount = 0;
+	uint32_t RetransmitCount = 0;
+	uint32_t CacheMissCount = 0;
+
+	//Helpers.
+	CacheEntryType* Entry = nullptr;
+
+public:
+	AbstractStreamWriter(Scheduler* scheduler, ILoLaDriver* driver)
+		: AbstractStreamBuffer(scheduler, driver, &MetaDefinition, &DataDefinition)
+	{
+	}
+
+	//Application side, AddNew() to stream out.
+	TemplateTrackedStreamBuffer<DataType, BufferSize>* GetStream()
+	{
+		return &TrackedBuffer;
+	}
+
+	uint32_t GetSentCount()
+	{
+		return SentCount;
+	}
+
+	uint32_t GetRetransmitCount()
+	{
+		return RetransmitCount;
+	}
+
+	uint32_t GetCacheMissCount()
+	{
+		return CacheMissCount;
+	}
+
+	void OnNewDataAvailableEvent(uint8_t param)
+	{
+		if (StreamState == StreamStateEnum::Active)
+		{
+			SetNextRunASAP();
+		}
+	}
+
+protected:
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("StreamWriter"));
+	}
+#endif
+
+	bool OnSetup()
+	{
+		if (IPacketSendService::OnSetup())
+		{
+			MethodSlot<AbstractStreamWriter, uint8_t> memFunSlot(this, &AbstractStreamWriter::OnNewDataAvailableEvent);
+			TrackedBuffer.AttachOnNewDataAvailableCallback(memFunSlot);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void OnStateUpdated(const StreamStateEnum newState)
+	{
+		if (newState != StreamStateEnum::Active)
+		{
+			for (uint8_t i = 0; i < CacheSize; i++)
+			{
+				RetransmitCache[i].Valid = false;
+			}
+			RetransmitPending = 0;
+		}
+	}
+
+	void OnServiceDiscoveryReceived()
+	{
+		if (StreamState == StreamStateEnum::WaitingForServiceDiscovery)
+		{
+			UpdateStreamState(StreamStateEnum::Active);
+		}
+	}
+
+	void OnNackReceived(const uint8_t firstId, const uint32_t bitmap)
+	{
+		if (StreamState != StreamStateEnum::Active)
+		{
+			return;
+		}
+
+		for (uint8_t i = 0; i < ABSTRACT_STREAM_MAX_WINDOW_SIZE; i++)
+		{
+			if ((bitmap >> i) & 1)
+			{
+				Entry = &RetransmitCache[(uint8_t)(firstId + i) % CacheSize];
+
+				if (Entry->Valid && Entry->Id == (uint8_t)(firstId + i))
+				{
+					RetransmitPending |= (uint32_t)1 << ((uint8_t)(firstId + i) % CacheSize);
+				}
+				else
+				{
+					//Too old, already overwritten.
+					CacheMissCount++;
+				}
+			}
+		}
+
+		SetNextRunASAP();
+	}
+
+	void OnStreamActive()
+	{
+		if (RetransmitPending != 0)
+		{
+			if (TrackedBuffer.GetCount() < (BufferSize / 2) &&
+				PullOldestRetransmit())
+			{
+				PrepareDataPacket(Entry->Id, (uint8_t*)&Entry->Data);
+				RequestSendPacket();
+				RetransmitCount++;
+
+				return;
+			}
+
+			//Falling behind, fresh data goes first.
+			RetransmitPending = 0;
+		}
+
+		if (TrackedBuffer.HasData())
+		{
+			Entry = &RetransmitCache[NextId % CacheSize];
+			Entry->Data = *TrackedBuffer.PullOldest();
+			Entry->Id = NextId;
+			Entry->Valid = true;
+			RetransmitPending &= ~((uint32_t)1 << (NextId % CacheSize));
+
+			PrepareDataPacket(NextId, (uint8_t*)&Entry->Data);
+			RequestSendPacket();
+			NextId++;
+			SentCount++;
+		}
+		else
+		{
+			SetNextRunDelay(ABSTRACT_STREAM_IDLE_CHECK_PERIOD);
+		}
+	}
+
+private:
+	//Oldest first, the entry at NextId is the next to be overwritten.
+	bool PullOldestRetransmit()
+	{
+		uint8_t index;
+
+		for (uint8_t i = 0; i < CacheSize; i++)
+		{
+			index = (uint8_t)(NextId + i) % CacheSize;
+
+			if ((RetransmitPending >> index) & 1)
+			{
+				RetransmitPending &= ~((uint32_t)1 << index);
+				Entry = &RetransmitCache[index];
+
+				return Entry->Valid;
+			}
+		}
+
+		return false;
+	}
+};
+#endif
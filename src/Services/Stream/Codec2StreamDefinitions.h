@@ -0,0 +1,95 @@
+// Codec2StreamDefinitions.h
+
+#ifndef _CODEC2_STREAM_DEFINITIONS_h
+#define _CODEC2_STREAM_DEFINITIONS_h
+
+#include <Services\Stream\AbstractStreamBuffer.h>
+
+//Chunk is [CaptureStamp(2)|Frame 0|..|Frame N-1], packed to fit a single packet.
+#define CODEC2_STREAM_STAMP_SIZE						2
+#ifdef LOLA_STREAM_USE_FEC
+#define CODEC2_STREAM_MAX_CHUNK_SIZE					(uint8_t)(LOLA_PACKET_FEC_MAX_CONTENT_SIZE - (LOLA_PACKET_PAYLOAD_INDEX - LOLA_PACKET_HEADER_INDEX) - LOLA_PACKET_FEC_TAG_SIZE)
+#else
+#define CODEC2_STREAM_MAX_CHUNK_SIZE					(uint8_t)(LOLA_PACKET_MAX_PACKET_SIZE - LOLA_PACKET_MIN_PACKET_SIZE)
+#endif
+
+//Packing more frames per chunk saves airtime but every frame waits for the last one.
+#define CODEC2_STREAM_MAX_PACKING_MILLIS				40
+
+//End-to-end, from capture to playout.
+#define CODEC2_STREAM_DEFAULT_TARGET_LATENCY_MILLIS		150
+
+//Playout gives up after this many concealed frames in a row, and waits for the next talk spurt.
+#define CODEC2_STREAM_MAX_CONCEAL_FRAMES				10
+
+#define CODEC2_STREAM_DEFAULT_BUFFER_SIZE				8
+
+//Codec2 modes, frame size in bytes and frame duration.
+struct Codec2Mode3200
+{
+	static const uint8_t FrameSize = 8;
+	static const uint8_t FrameMillis = 20;
+};
+
+struct Codec2Mode2400
+{
+	static const uint8_t FrameSize = 6;
+	static const uint8_t FrameMillis = 20;
+};
+
+struct Codec2Mode1600
+{
+	static const uint8_t FrameSize = 8;
+	static const uint8_t FrameMillis = 40;
+};
+
+struct Codec2Mode1400
+{
+	static const uint8_t FrameSize = 7;
+	static const uint8_t FrameMillis = 40;
+};
+
+struct Codec2Mode1300
+{
+	static const uint8_t FrameSize = 7;
+	static const uint8_t FrameMillis = 40;
+};
+
+struct Codec2Mode1200
+{
+	static const uint8_t FrameSize = 6;
+	static const uint8_t FrameMillis = 40;
+};
+
+template <class Codec2Mode>
+struct Codec2ChunkType
+{
+	static const uint8_t FramesFit = (CODEC2_STREAM_MAX_CHUNK_SIZE - CODEC2_STREAM_STAMP_SIZE) / Codec2Mode::FrameSize;
+	static const uint8_t FramesLatency = (CODEC2_STREAM_MAX_PACKING_MILLIS / Codec2Mode::FrameMillis) > 0 ? (CODEC2_STREAM_MAX_PACKING_MILLIS / Codec2Mode::FrameMillis) : 1;
+	static const uint8_t FramesPerChunk = FramesFit < FramesLatency ? FramesFit : FramesLatency;
+	static const uint32_t ChunkMillis = (uint32_t)FramesPerChunk * Codec2Mode::FrameMillis;
+
+	static_assert(FramesFit > 0, "Codec2 frame doesn't fit in a packet.");
+
+	//Synced clock millis of the first frame, low bits only.
+	uint8_t CaptureStamp[CODEC2_STREAM_STAMP_SIZE];
+	uint8_t Frames[FramesPerChunk * Codec2Mode::FrameSize];
+
+	void SetCaptureStamp(const uint16_t stamp)
+	{
+		CaptureStamp[0] = stamp & 0xFF;
+		CaptureStamp[1] = stamp >> 8;
+	}
+
+	uint16_t GetCaptureStamp()
+	{
+		return CaptureStamp[0] | ((uint16_t)CaptureStamp[1] << 8);
+	}
+
+	//Both ends share the synced clock, so the stamp age is the one-way latency.
+	static uint16_t GetStamp(const uint32_t syncMicros)
+	{
+		return (uint16_t)(syncMicros / 1000);
+	}
+};
+#endif
@@ -0,0 +1,420 @@
+// Codec2StreamReader.h
+
+#ifndef _CODEC2STREAMREADER_h
+#define _CODEC2STREAMREADER_h
+
+#include <Services\Stream\AbstractStreamReader.h>
+#include <Services\Stream\Codec2StreamDefinitions.h>
+
+//Playout delay shrinks slowly, one step per chunk, so a short quiet period doesn't cost an underrun.
+#define CODEC2_STREAM_DELAY_DECAY_MICROS				((uint32_t)500)
+
+class ICodec2Playout
+{
+public:
+	//Returns the delay until the next tick, in millis.
+	virtual uint32_t OnPlayoutTick() { return ABSTRACT_STREAM_IDLE_CHECK_PERIOD; }
+};
+
+class Codec2PlayoutTask : public Task
+{
+private:
+	ICodec2Playout* Playout = nullptr;
+
+public:
+	Codec2PlayoutTask(Scheduler* scheduler, ICodec2Playout* playout)
+		: Task(0, TASK_FOREVER, scheduler, false)
+	{
+		Playout = playout;
+	}
+
+	void Start()
+	{
+		enableIfNot();
+		forceNextIteration();
+	}
+
+	void Stop()
+	{
+		disable();
+	}
+
+	void Wake()
+	{
+		if (isEnabled())
+		{
+			forceNextIteration();
+		}
+	}
+
+protected:
+	bool Callback()
+	{
+		Task::delay(Playout->OnPlayoutTick());
+
+		return true;
+	}
+};
+
+template <const uint8_t BaseHeader, class Codec2Mode,
+	const uint8_t BufferSize = CODEC2_STREAM_DEFAULT_BUFFER_SIZE,
+	const uint8_t ReorderSize = ABSTRACT_STREAM_DEFAULT_REORDER_SIZE,
+	const uint16_t TargetLatencyMillis = CODEC2_STREAM_DEFAULT_TARGET_LATENCY_MILLIS>
+class Codec2StreamReader : public AbstractStreamReader<BaseHeader, Codec2ChunkType<Codec2Mode>, BufferSize, ReorderSize>, public ICodec2Playout
+{
+private:
+	typedef Codec2ChunkType<Codec2Mode> ChunkType;
+	typedef AbstractStreamReader<BaseHeader, ChunkType, BufferSize, ReorderSize> BaseReader;
+
+	static const uint32_t FrameMicros = (uint32_t)Codec2Mode::FrameMillis * 1000;
+	static const uint32_t TargetLatencyMicros = (uint32_t)TargetLatencyMillis * 1000;
+
+	//Worst case without jitter: wait for the chunk to fill, then for the send slot.
+	static_assert(ChunkType::ChunkMillis + ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS + Codec2Mode::FrameMillis <= TargetLatencyMillis,
+		"Codec2 chunk packing and duplex period don't fit the latency target.");
+
+	Codec2PlayoutTask PlayoutTask;
+
+	//Jitter buffer head.
+	ChunkType CurrentChunk;
+	bool HasChunk = false;
+	uint8_t FrameIndex = 0;
+	uint32_t ChunkCaptureMicros = 0;
+	uint32_t ChunkDueMicros = 0;
+
+	//Playout clock, on synced time.
+	bool Playing = false;
+	uint32_t NextPlayoutMicros = 0;
+	uint32_t PlayoutDelayMicros = 0;
+	uint8_t ConcealRun = 0;
+
+	//Arrival latency estimation, smoothed like RTP jitter.
+	uint32_t ArrivalLatencyMicros = 0;
+	uint32_t ArrivalJitterMicros = 0;
+
+	//Statistics.
+	uint32_t PlayedCount = 0;
+	uint32_t ConcealedCount = 0;
+	uint32_t UnderrunCount = 0;
+	uint32_t LateCount = 0;
+	uint32_t OverTargetCount = 0;
+	uint32_t LatencyMillis = 0;
+	uint32_t MaxLatencyMillis = 0;
+
+	//Helpers.
+	uint32_t NowMicros = 0;
+	uint32_t Sample = 0;
+
+public:
+	Codec2StreamReader(Scheduler* scheduler, ILoLaDriver* driver)
+		: BaseReader(scheduler, driver)
+		, PlayoutTask(scheduler, this)
+	{
+		ResetPlayoutDelay();
+	}
+
+	void OnNewDataAvailableEvent(uint8_t param)
+	{
+		if (!Playing)
+		{
+			PlayoutTask.Wake();
+		}
+	}
+
+	uint32_t GetPlayedCount()
+	{
+		return PlayedCount;
+	}
+
+	uint32_t GetConcealedCount()
+	{
+		return ConcealedCount;
+	}
+
+	uint32_t GetUnderrunCount()
+	{
+		return UnderrunCount;
+	}
+
+	uint32_t GetLateCount()
+	{
+		return LateCount;
+	}
+
+	//Frames played later than the latency target.
+	uint32_t GetOverTargetCount()
+	{
+		return OverTargetCount;
+	}
+
+	//Capture to playout, smoothed.
+	uint32_t GetLatencyMillis()
+	{
+		return LatencyMillis;
+	}
+
+	uint32_t GetMaxLatencyMillis()
+	{
+		return MaxLatencyMillis;
+	}
+
+	uint32_t GetPlayoutDelayMillis()
+	{
+		return PlayoutDelayMicros / 1000;
+	}
+
+	uint32_t GetJitterMillis()
+	{
+		return ArrivalJitterMicros / 1000;
+	}
+
+	uint32_t OnPlayoutTick()
+	{
+		NowMicros = GetSyncMicros();
+
+		//Drop what is already too late to be played.
+		while (HasChunk || PullChunk())
+		{
+			if (!Playing)
+			{
+				if ((int32_t)(NowMicros - GetFrameDueMicros()) < 0)
+				{
+					return GetMillisUntil(GetFrameDueMicros());
+				}
+
+				//Talk spurt starts now, timeline is anchored to the first frame.
+				ChunkDueMicros += NowMicros - GetFrameDueMicros();
+				NextPlayoutMicros = NowMicros;
+				ConcealRun = 0;
+				Playing = true;
+			}
+
+			if ((int32_t)(GetFrameDueMicros() - NextPlayoutMicros) < -(int32_t)(FrameMicros / 2))
+			{
+				LateCount++;
+				AdvanceFrame();
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (!Playing)
+		{
+			//Woken up on new data.
+			return ABSTRACT_STREAM_IDLE_CHECK_PERIOD;
+		}
+
+		if (!HasChunk)
+		{
+			UnderrunCount++;
+			PlayoutDelayMicros += FrameMicros;
+			if (PlayoutDelayMicros > TargetLatencyMicros)
+			{
+				PlayoutDelayMicros = TargetLatencyMicros;
+			}
+			ConcealFrame();
+		}
+		else if ((int32_t)(GetFrameDueMicros() - NextPlayoutMicros) > (int32_t)(FrameMicros / 2))
+		{
+			//Lost chunk or a longer delay, fill the gap.
+			ConcealFrame();
+		}
+		else
+		{
+			PlayFrame();
+		}
+
+		if (Playing)
+		{
+			NextPlayoutMicros += FrameMicros;
+
+			return GetMillisUntil(NextPlayoutMicros);
+		}
+
+		return ABSTRACT_STREAM_IDLE_CHECK_PERIOD;
+	}
+
+protected:
+	//Decoder side.
+	virtual void OnPlayFrame(const uint8_t* frame) {}
+
+	//Loss concealment, e.g. repeat and fade the last frame.
+	virtual void OnConcealFrame() {}
+
+	//Talk spurt is over, or given up on.
+	virtual void OnPlayoutStopped() {}
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("Codec2Reader"));
+	}
+#endif
+
+	bool OnSetup()
+	{
+		if (BaseReader::OnSetup())
+		{
+			MethodSlot<Codec2StreamReader, uint8_t> memFunSlot(this, &Codec2StreamReader::OnNewDataAvailableEvent);
+			this->GetStream()->AttachOnNewDataAvailableCallback(memFunSlot);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void OnStateUpdated(const AbstractStreamBuffer::StreamStateEnum newState)
+	{
+		BaseReader::OnStateUpdated(newState);
+
+		HasChunk = false;
+		Playing = false;
+		ConcealRun = 0;
+		this->GetStream()->Clear();
+
+		if (newState == AbstractStreamBuffer::StreamStateEnum::Active)
+		{
+			ArrivalLatencyMicros = 0;
+			ArrivalJitterMicros = 0;
+			ResetPlayoutDelay();
+			PlayoutTask.Start();
+		}
+		else
+		{
+			PlayoutTask.Stop();
+		}
+	}
+
+	void OnDataPacketReceived(const uint8_t id, uint8_t* payload)
+	{
+		NowMicros = GetSyncMicros();
+		Sample = (uint32_t)((uint16_t)(ChunkType::GetStamp(NowMicros) - ((ChunkType*)payload)->GetCaptureStamp())) * 1000;
+
+		//Stale stamps, from before the clock sync settled, are ignored.
+		if (Sample <= (TargetLatencyMicros * 4))
+		{
+			if (ArrivalLatencyMicros == 0)
+			{
+				ArrivalLatencyMicros = Sample;
+			}
+			else
+			{
+				ArrivalJitterMicros = (uint32_t)((int32_t)ArrivalJitterMicros +
+					((int32_t)(Sample > ArrivalLatencyMicros ? Sample - ArrivalLatencyMicros : ArrivalLatencyMicros - Sample) - (int32_t)ArrivalJitterMicros) / 16);
+				ArrivalLatencyMicros = (uint32_t)((int32_t)ArrivalLatencyMicros + ((int32_t)Sample - (int32_t)ArrivalLatencyMicros) / 8);
+			}
+		}
+
+		BaseReader::OnDataPacketReceived(id, payload);
+	}
+
+private:
+	inline uint32_t GetSyncMicros()
+	{
+		return this->LoLaDriver->GetClockSource()->GetSyncMicros();
+	}
+
+	inline uint32_t GetFrameDueMicros()
+	{
+		return ChunkDueMicros + ((uint32_t)FrameIndex * FrameMicros);
+	}
+
+	uint32_t GetMillisUntil(const uint32_t targetMicros)
+	{
+		if ((int32_t)(targetMicros - NowMicros) > 0)
+		{
+			return (targetMicros - NowMicros) / 1000;
+		}
+
+		return 0;
+	}
+
+	void ResetPlayoutDelay()
+	{
+		PlayoutDelayMicros = (ChunkType::ChunkMillis + ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS) * 1000;
+	}
+
+	bool PullChunk()
+	{
+		if (!this->GetStream()->HasData())
+		{
+			return false;
+		}
+
+		CurrentChunk = *this->GetStream()->PullOldest();
+		FrameIndex = 0;
+		HasChunk = true;
+
+		//Capture time on the local synced clock.
+		ChunkCaptureMicros = NowMicros - ((uint32_t)((uint16_t)(ChunkType::GetStamp(NowMicros) - CurrentChunk.GetCaptureStamp())) * 1000);
+
+		//Adapt the delay to the jitter, never beyond the target.
+		Sample = ArrivalLatencyMicros + (4 * ArrivalJitterMicros);
+		if (Sample > TargetLatencyMicros)
+		{
+			Sample = TargetLatencyMicros;
+		}
+
+		if (Sample > PlayoutDelayMicros)
+		{
+			PlayoutDelayMicros = Sample;
+		}
+		else if (PlayoutDelayMicros - Sample > CODEC2_STREAM_DELAY_DECAY_MICROS)
+		{
+			PlayoutDelayMicros -= CODEC2_STREAM_DELAY_DECAY_MICROS;
+		}
+
+		ChunkDueMicros = ChunkCaptureMicros + PlayoutDelayMicros;
+
+		return true;
+	}
+
+	void AdvanceFrame()
+	{
+		FrameIndex++;
+		if (FrameIndex >= ChunkType::FramesPerChunk)
+		{
+			HasChunk = false;
+		}
+	}
+
+	void PlayFrame()
+	{
+		Sample = (NowMicros - (ChunkCaptureMicros + ((uint32_t)FrameIndex * FrameMicros))) / 1000;
+		LatencyMillis = LatencyMillis == 0 ? Sample : (((LatencyMillis * 7) + Sample) / 8);
+		if (Sample > MaxLatencyMillis)
+		{
+			MaxLatencyMillis = Sample;
+		}
+		if (Sample > TargetLatencyMillis)
+		{
+			OverTargetCount++;
+		}
+
+		PlayedCount++;
+		ConcealRun = 0;
+		OnPlayFrame(&CurrentChunk.Frames[FrameIndex * Codec2Mode::FrameSize]);
+		AdvanceFrame();
+	}
+
+	void ConcealFrame()
+	{
+		ConcealedCount++;
+		ConcealRun++;
+
+		if (ConcealRun > CODEC2_STREAM_MAX_CONCEAL_FRAMES)
+		{
+			Playing = false;
+			ConcealRun = 0;
+			OnPlayoutStopped();
+		}
+		else
+		{
+			OnConcealFrame();
+		}
+	}
+};
+#endif
@@ -3,22 +3,78 @@
 #ifndef _CODEC2STREAMWRITER_h
 #define _CODEC2STREAMWRITER_h
 
-class Codec2StreamWriter
+#include <Services\Stream\AbstractStreamWriter.h>
+#include <Services\Stream\Codec2StreamDefinitions.h>
+
+template <const uint8_t BaseHeader, class Codec2Mode, const uint8_t BufferSize = CODEC2_STREAM_DEFAULT_BUFFER_SIZE>
+class Codec2StreamWriter : public AbstractStreamWriter<BaseHeader, Codec2ChunkType<Codec2Mode>, BufferSize>
 {
 private:
-	struct StreamChunkCodec2Mode3200
+	typedef Codec2ChunkType<Codec2Mode> ChunkType;
+
+	ChunkType PendingChunk;
+	uint8_t PendingCount = 0;
+
+	//Statistics.
+	uint32_t FrameCount = 0;
+	uint32_t DroppedFrameCount = 0;
+
+public:
+	Codec2StreamWriter(Scheduler* scheduler, ILoLaDriver* driver)
+		: AbstractStreamWriter<BaseHeader, ChunkType, BufferSize>(scheduler, driver)
+	{
+	}
+
+	//Encoder side, one Codec2 frame at a time, as they come out of the encoder.
+	bool AddFrame(const uint8_t* frame)
 	{
-		uint8_t Data[64];
+		if (!this->IsActive())
+		{
+			PendingCount = 0;
+			DroppedFrameCount++;
+
+			return false;
+		}
+
+		if (PendingCount == 0)
+		{
+			PendingChunk.SetCaptureStamp(ChunkType::GetStamp(this->LoLaDriver->GetClockSource()->GetSyncMicros()));
+		}
+
+		memcpy(&PendingChunk.Frames[PendingCount * Codec2Mode::FrameSize], frame, Codec2Mode::FrameSize);
+		PendingCount++;
+		FrameCount++;
+
+		if (PendingCount >= ChunkType::FramesPerChunk)
+		{
+			PendingCount = 0;
+			this->GetStream()->AddNew(PendingChunk);
+		}
+
+		return true;
 	}
 
-	struct StreamChunkCodec2Mode2200
+	uint8_t GetFramesPerChunk()
 	{
-		uint8_t Data[56];
+		return ChunkType::FramesPerChunk;
 	}
 
+	uint32_t GetFrameCount()
+	{
+		return FrameCount;
+	}
 
-	TemplateTrackedStreamBuffer <10, StreamChunkCodec2Mode3200> ExperimentalTrackedBuffer;
-}
+	uint32_t GetDroppedFrameCount()
+	{
+		return DroppedFrameCount;
+	}
 
+protected:
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("Codec2Writer"));
+	}
+#endif
+};
 #endif
-
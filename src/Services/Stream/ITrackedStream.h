@@ -70,7 +70,7 @@ public:
 		return &Grunt;
 	}
 
-	uint8_t GetChunckSize() const
+	uint8_t GetChunckSize()
 	{
 		return sizeof(DataType);
 	}
@@ -0,0 +1,53 @@
+// StreamPacketDefinitions.h
+
+#ifndef _STREAMPACKETDEFINITIONS_h
+#define _STREAMPACKETDEFINITIONS_h
+
+#include <Packet\PacketDefinition.h>
+
+// Data: [Stream Id as Id|Chunk].
+// Meta: [SubHeader as Id|FirstId|Bitmap(4)]. NACK bit i is set if (FirstId + i) is missing.
+// Meta is variable size: discovery has no payload, NACK bitmaps drop their trailing zero bytes.
+// Data chunks are fixed size structs, and may use FEC, so they stay fixed.
+#define PACKET_DEFINITION_STREAM_META_HEADER_OFFSET		0
+#define PACKET_DEFINITION_STREAM_META_PAYLOAD_SIZE		5
+#define PACKET_DEFINITION_STREAM_DATA_HEADER_OFFSET		1
+
+#define STREAM_SERVICE_PACKET_DEFINITION_COUNT			2
+
+template <const uint8_t BaseHeader, const uint8_t ChunkSize>
+class StreamDataPacketDefinition : public PacketDefinition
+{
+public:
+#ifdef LOLA_STREAM_USE_FEC
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_FEC; }
+#else
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+#endif
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_STREAM_DATA_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return ChunkSize; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("StreamData"));
+	}
+#endif
+};
+
+template <const uint8_t BaseHeader>
+class StreamMetaPacketDefinition : public PacketDefinition
+{
+public:
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_VARIABLE_SIZE; }
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_STREAM_META_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_STREAM_META_PAYLOAD_SIZE; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("StreamMeta"));
+	}
+#endif
+};
+#endif
@@ -13,7 +13,6 @@
 
 #define ABSTRACT_SURFACE_MAX_ELAPSED_NO_DISCOVERY_MILLIS	(uint32_t)500
 
-#define ABSTRACT_SURFACE_FAST_CHECK_PERIOD_MILLIS			(uint32_t)1
 #define ABSTRACT_SURFACE_SLOW_CHECK_PERIOD_MILLIS			(uint32_t)200
 
 #define ABSTRACT_SURFACE_SERVICE_DISCOVERY_SEND_PERIOD		(uint32_t)50
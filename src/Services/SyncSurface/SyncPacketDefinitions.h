@@ -30,7 +30,11 @@ template <const uint8_t BaseHeader>
 class SyncDataPacketDefinition : public SyncAbstractPacketDefinition
 {
 public:
+#ifdef LOLA_SYNC_SURFACE_USE_FEC
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_FEC; }
+#else
 	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+#endif
 	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_SYNC_DATA_HEADER_OFFSET; }
 	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_SYNC_DATA_PAYLOAD_SIZE; }
 
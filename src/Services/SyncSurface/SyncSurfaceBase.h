@@ -31,7 +31,7 @@ private:
 public:
 	SyncSurfaceBase(Scheduler* scheduler, ILoLaDriver* driver, ITrackedSurface* trackedSurface,
 		SyncAbstractPacketDefinition* metaDefinition, SyncAbstractPacketDefinition* dataDefinition)
-		: AbstractSync(scheduler, ABSTRACT_SURFACE_FAST_CHECK_PERIOD_MILLIS, driver, trackedSurface, &PacketHolder)
+		: AbstractSync(scheduler, ABSTRACT_SURFACE_SLOW_CHECK_PERIOD_MILLIS, driver, trackedSurface, &PacketHolder)
 	{
 		SyncMetaDefinition = metaDefinition;
 		DataPacketDefinition = dataDefinition;
@@ -190,7 +190,8 @@ protected:
 		}
 	}
 
-	void OnSendDelayed()
+	//Slot waits are event driven now, so refresh right before sending.
+	void OnPreSend()
 	{
 		if (SyncState == SyncStateEnum::Syncing && WriterState == SyncWriterState::SendingBlock)
 		{
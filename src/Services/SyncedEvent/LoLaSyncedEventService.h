@@ -0,0 +1,553 @@
+// LoLaSyncedEventService.h
+
+#ifndef _LOLA_SYNCED_EVENT_SERVICE_h
+#define _LOLA_SYNCED_EVENT_SERVICE_h
+
+#include <Services\ILoLaService.h>
+#include <Services\SyncedEvent\SyncedEventPacketDefinitions.h>
+#include <Services\SyncedEvent\SyncedEventTimer.h>
+
+#define LOLA_SYNCED_EVENT_DEFAULT_MAX_EVENTS		(uint8_t)(8)
+
+//Each event is sent this many times, one duplex period apart, so a burst loss doesn't take all copies.
+#define LOLA_SYNCED_EVENT_REDUNDANCY				(uint8_t)(3)
+#define LOLA_SYNCED_EVENT_RESEND_MILLIS				(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS)
+
+//Shortest lead time that still gets one copy out in time.
+#define LOLA_SYNCED_EVENT_MIN_LEAD_MICROS			(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*1000)
+//Copies too close to the fire time aren't worth sending.
+#define LOLA_SYNCED_EVENT_SEND_MARGIN_MICROS		(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*500)
+
+//The scheduler wakes up this early and arms the fire timer for the exact instant.
+#define LOLA_SYNCED_EVENT_WAKE_EARLY_MICROS			(uint32_t)2000
+//Events received this late still fire, beyond it they're dropped.
+#define LOLA_SYNCED_EVENT_LATE_TOLERANCE_MICROS		(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*1000)
+
+//Recently fired remote events, so late copies are ignored.
+#define LOLA_SYNCED_EVENT_RECENT_SIZE				(uint8_t)(8)
+
+//Actions scheduled at a synced clock instant, fired on both ends at the same time.
+//Application latency becomes the chosen lead time, not whatever slot the packet landed in.
+//The final approach is on a hardware timer where available, otherwise the task fires on its next run.
+template<const uint8_t BaseHeader, const uint8_t MaxEvents = LOLA_SYNCED_EVENT_DEFAULT_MAX_EVENTS>
+class LoLaSyncedEventService : public ILoLaService, public ISyncedEventTimerListener
+{
+public:
+	struct SyncedEventStatsType
+	{
+		uint32_t Scheduled = 0;
+		uint32_t Received = 0;
+		uint32_t Duplicates = 0;
+		uint32_t Fired = 0;
+		uint32_t Late = 0;
+		uint32_t Missed = 0;
+		uint32_t Sent = 0;
+		uint32_t JitterSumMicros = 0;
+		uint32_t MaxJitterMicros = 0;
+	};
+
+private:
+	SyncedEventPacketDefinition<BaseHeader> EventDefinition;
+
+	TemplateLoLaPacket<LOLA_PACKET_MIN_PACKET_SIZE + PACKET_DEFINITION_SYNCED_EVENT_PAYLOAD_SIZE> PacketHolder;
+
+	struct EventSlotType
+	{
+		uint32_t FireMicros = 0;
+		uint32_t Arguments = 0;
+		uint32_t SentMillis = 0;
+		volatile uint32_t JitterMicros = 0;
+		uint8_t EventId = 0;
+		uint8_t Sequence = 0;
+		uint8_t Transmissions = 0;
+		bool Remote = false;
+		bool Active = false;
+		volatile bool Fired = false; //Stays active until the main loop catches up.
+	} Events[MaxEvents];
+
+	SyncedEventTimer FireTimer;
+	bool TimerReady = false;
+	EventSlotType* volatile ArmedEvent = nullptr;
+
+	uint8_t NextSequence = 0;
+
+	uint8_t RecentRemote[LOLA_SYNCED_EVENT_RECENT_SIZE];
+	uint8_t RecentCount = 0;
+	uint8_t RecentIndex = 0;
+
+	SyncedEventStatsType Stats;
+
+	union ArrayToUint32 {
+		byte array[4];
+		uint32_t uint;
+	} ATUI;
+
+	//Helpers.
+	EventSlotType* EventSlot = nullptr;
+	uint32_t NowMicros = 0;
+	uint32_t NextWakeMicros = 0;
+	uint32_t ResendMicros = 0;
+	int32_t RemainingMicros = 0;
+
+public:
+	LoLaSyncedEventService(Scheduler* scheduler, ILoLaDriver* driver)
+		: ILoLaService(scheduler, LOLA_SERVICE_DEFAULT_PERIOD_MILLIS, driver)
+	{
+		PacketHolder.ClearDefinition();
+	}
+
+	//Both ends fire the event after delayMicros.
+	bool Schedule(const uint8_t eventId, const uint32_t arguments, const uint32_t delayMicros)
+	{
+		return ScheduleAt(eventId, arguments, GetSyncMicros() + delayMicros);
+	}
+
+	//Both ends fire the event at the synced clock instant.
+	bool ScheduleAt(const uint8_t eventId, const uint32_t arguments, const uint32_t fireSyncMicros)
+	{
+		if (!IsSetupOk() || !LoLaDriver->HasLink() ||
+			(int32_t)(fireSyncMicros - GetSyncMicros()) < (int32_t)LOLA_SYNCED_EVENT_MIN_LEAD_MICROS)
+		{
+			return false;
+		}
+
+		EventSlot = GetFreeSlot();
+		if (EventSlot == nullptr)
+		{
+			return false;
+		}
+
+		EventSlot->Active = true;
+		EventSlot->Remote = false;
+		EventSlot->EventId = eventId;
+		EventSlot->Arguments = arguments;
+		EventSlot->FireMicros = fireSyncMicros;
+		EventSlot->Sequence = NextSequence++;
+		EventSlot->Transmissions = 0;
+		EventSlot->Fired = false;
+		Stats.Scheduled++;
+
+		Enable();
+		SetNextRunASAP();
+
+		return true;
+	}
+
+	uint32_t GetSyncMicros()
+	{
+		return LoLaDriver->GetClockSource()->GetSyncMicros();
+	}
+
+	SyncedEventStatsType* GetStats()
+	{
+		return &Stats;
+	}
+
+	uint32_t GetAverageJitterMicros()
+	{
+		if (Stats.Fired == 0)
+		{
+			return 0;
+		}
+
+		return Stats.JitterSumMicros / Stats.Fired;
+	}
+
+#ifdef DEBUG_LOLA
+	void DebugStats(Stream* serial)
+	{
+		serial->print(F("Fired: "));
+		serial->print(Stats.Fired);
+		serial->print(F(" Late: "));
+		serial->print(Stats.Late);
+		serial->print(F(" Missed: "));
+		serial->println(Stats.Missed);
+		serial->print(F("Jitter avg: "));
+		serial->print(GetAverageJitterMicros());
+		serial->print(F(" us max: "));
+		serial->print(Stats.MaxJitterMicros);
+		serial->println(F(" us"));
+	}
+#endif
+
+	void OnLinkEstablished()
+	{
+		//Pending events were scheduled on the old clock.
+		DisarmFireTimer();
+		for (uint8_t i = 0; i < MaxEvents; i++)
+		{
+			Events[i].Active = false;
+		}
+		RecentCount = 0;
+		NextSequence = 0;
+
+		Enable();
+		SetNextRunASAP();
+	}
+
+	void OnLinkLost()
+	{
+		DisarmFireTimer();
+		for (uint8_t i = 0; i < MaxEvents; i++)
+		{
+			Events[i].Active = false;
+		}
+
+		Disable();
+	}
+
+	bool ProcessPacket(ILoLaPacket* incomingPacket)
+	{
+		if (incomingPacket->GetDataHeader() == EventDefinition.GetHeader())
+		{
+			OnEventReceived(incomingPacket->GetId(), incomingPacket->GetPayload());
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Callback()
+	{
+		NowMicros = GetSyncMicros();
+		NextWakeMicros = NowMicros + (LOLA_SERVICE_LONG_SLEEP_PERIOD_MILLIS * 1000);
+
+		for (uint8_t i = 0; i < MaxEvents; i++)
+		{
+			if (!Events[i].Active)
+			{
+				continue;
+			}
+
+			RemainingMicros = (int32_t)(Events[i].FireMicros - NowMicros);
+
+			//The interrupt sets Fired before releasing the timer, so check in that order.
+			if (&Events[i] == ArmedEvent)
+			{
+				//Timer fires it, check back right after.
+				UpdateNextWake(Events[i].FireMicros + LOLA_SYNCED_EVENT_WAKE_EARLY_MICROS);
+			}
+			else if (Events[i].Fired)
+			{
+				OnFired(&Events[i]);
+			}
+			else if (RemainingMicros <= 0)
+			{
+				//Late or no timer, fire now.
+				Fire(&Events[i]);
+				NowMicros = GetSyncMicros();
+			}
+			else if (RemainingMicros <= (int32_t)LOLA_SYNCED_EVENT_WAKE_EARLY_MICROS &&
+				ArmFireTimer(&Events[i]))
+			{
+				UpdateNextWake(Events[i].FireMicros + LOLA_SYNCED_EVENT_WAKE_EARLY_MICROS);
+			}
+			else if (TimerReady && RemainingMicros > (int32_t)LOLA_SYNCED_EVENT_WAKE_EARLY_MICROS)
+			{
+				UpdateNextWake(Events[i].FireMicros - LOLA_SYNCED_EVENT_WAKE_EARLY_MICROS);
+			}
+			else
+			{
+				//Timer busy or missing, the task fires it on time to the milli.
+				UpdateNextWake(Events[i].FireMicros);
+			}
+		}
+
+		if (LoLaDriver->HasLink())
+		{
+			EventSlot = GetNextToSend();
+
+			if (EventSlot != nullptr)
+			{
+				if (AllowedSend() && SendEvent(EventSlot))
+				{
+					SetNextRunASAP();
+
+					return true;
+				}
+
+				//Don't sleep through the next local fire time.
+				if ((int32_t)(NextWakeMicros - NowMicros) > 0)
+				{
+					SetNextRunOnSendSlot((NextWakeMicros - NowMicros) / 1000);
+				}
+				else
+				{
+					SetNextRunOnSendSlot(0);
+				}
+
+				return false;
+			}
+		}
+
+		if ((int32_t)(NextWakeMicros - NowMicros) > 0)
+		{
+			SetNextRunDelay((NextWakeMicros - NowMicros) / 1000);
+		}
+		else
+		{
+			SetNextRunASAP();
+		}
+
+		return false;
+	}
+
+	//Final approach, from the timer interrupt.
+	void OnTimerFired()
+	{
+		if (ArmedEvent != nullptr)
+		{
+			ArmedEvent->JitterMicros = GetJitterMicros(ArmedEvent->FireMicros);
+			ArmedEvent->Fired = true;
+			OnEvent(ArmedEvent->EventId, ArmedEvent->Arguments, ArmedEvent->JitterMicros);
+			ArmedEvent = nullptr;
+		}
+	}
+
+protected:
+	//Called at the synced instant, on both ends. Jitter is how late it fired.
+	//With the hardware timer it runs from its interrupt: keep it short, no Serial, no sends.
+	virtual void OnEvent(const uint8_t eventId, const uint32_t arguments, const uint32_t jitterMicros) {}
+
+	bool OnSetup()
+	{
+		//Without it, events fire from the task.
+		TimerReady = FireTimer.Setup(this);
+
+		return true;
+	}
+
+#ifdef DEBUG_LOLA
+	virtual void PrintName(Stream* serial)
+	{
+		serial->print(F("SyncedEvent"));
+	}
+#endif
+
+	bool OnAddPacketMap(LoLaPacketMap* packetMap)
+	{
+		return packetMap->AddMapping(&EventDefinition);
+	}
+
+private:
+	EventSlotType* GetFreeSlot()
+	{
+		for (uint8_t i = 0; i < MaxEvents; i++)
+		{
+			if (!Events[i].Active)
+			{
+				return &Events[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	uint32_t GetJitterMicros(const uint32_t fireMicros)
+	{
+		if ((int32_t)(GetSyncMicros() - fireMicros) > 0)
+		{
+			return GetSyncMicros() - fireMicros;
+		}
+
+		return 0;
+	}
+
+	inline void UpdateNextWake(const uint32_t wakeMicros)
+	{
+		if ((int32_t)(wakeMicros - NextWakeMicros) < 0)
+		{
+			NextWakeMicros = wakeMicros;
+		}
+	}
+
+	bool ArmFireTimer(EventSlotType* event)
+	{
+		if (!TimerReady ||
+			ArmedEvent != nullptr)
+		{
+			return false;
+		}
+
+		ArmedEvent = event;
+		RemainingMicros = (int32_t)(event->FireMicros - GetSyncMicros());
+		if (RemainingMicros <= 0 ||
+			!FireTimer.Arm(RemainingMicros))
+		{
+			ArmedEvent = nullptr;
+
+			return false;
+		}
+
+		return true;
+	}
+
+	void DisarmFireTimer()
+	{
+		FireTimer.Disarm();
+		ArmedEvent = nullptr;
+	}
+
+	//From the task, when the timer couldn't take it.
+	void Fire(EventSlotType* event)
+	{
+		event->JitterMicros = GetJitterMicros(event->FireMicros);
+		event->Fired = true;
+		OnEvent(event->EventId, event->Arguments, event->JitterMicros);
+		OnFired(event);
+	}
+
+	//Bookkeeping, always from the main loop.
+	void OnFired(EventSlotType* event)
+	{
+		event->Active = false;
+		event->Fired = false;
+
+		Stats.Fired++;
+		Stats.JitterSumMicros += event->JitterMicros;
+		Stats.MaxJitterMicros = max(Stats.MaxJitterMicros, (uint32_t)event->JitterMicros);
+
+		if (event->Remote)
+		{
+			RecentRemote[RecentIndex] = event->Sequence;
+			RecentIndex = (RecentIndex + 1) % LOLA_SYNCED_EVENT_RECENT_SIZE;
+			if (RecentCount < LOLA_SYNCED_EVENT_RECENT_SIZE)
+			{
+				RecentCount++;
+			}
+		}
+	}
+
+	//Copies are spread over the lead time, and stop when too close to the fire time.
+	EventSlotType* GetNextToSend()
+	{
+		for (uint8_t i = 0; i < MaxEvents; i++)
+		{
+			if (Events[i].Active &&
+				!Events[i].Remote &&
+				Events[i].Transmissions < LOLA_SYNCED_EVENT_REDUNDANCY &&
+				(int32_t)(Events[i].FireMicros - NowMicros) > (int32_t)LOLA_SYNCED_EVENT_SEND_MARGIN_MICROS)
+			{
+				if (Events[i].Transmissions == 0 ||
+					millis() - Events[i].SentMillis >= LOLA_SYNCED_EVENT_RESEND_MILLIS)
+				{
+					return &Events[i];
+				}
+
+				ResendMicros = NowMicros + ((LOLA_SYNCED_EVENT_RESEND_MILLIS - (millis() - Events[i].SentMillis)) * 1000);
+				if ((int32_t)(ResendMicros - NextWakeMicros) < 0)
+				{
+					NextWakeMicros = ResendMicros;
+				}
+			}
+		}
+
+		return nullptr;
+	}
+
+	bool SendEvent(EventSlotType* event)
+	{
+		PacketHolder.SetDefinition(&EventDefinition);
+		PacketHolder.SetId(event->Sequence);
+		PacketHolder.GetPayload()[0] = event->EventId;
+
+		ATUI.uint = event->FireMicros;
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+		{
+			PacketHolder.GetPayload()[1 + i] = ATUI.array[i];
+		}
+
+		ATUI.uint = event->Arguments;
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+		{
+			PacketHolder.GetPayload()[5 + i] = ATUI.array[i];
+		}
+
+		if (SendPacket(&PacketHolder))
+		{
+			event->Transmissions++;
+			event->SentMillis = millis();
+			Stats.Sent++;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void OnEventReceived(const uint8_t sequence, uint8_t* payload)
+	{
+		if (IsDuplicate(sequence))
+		{
+			Stats.Duplicates++;
+
+			return;
+		}
+
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+		{
+			ATUI.array[i] = payload[1 + i];
+		}
+
+		NowMicros = GetSyncMicros();
+
+		if ((int32_t)(NowMicros - ATUI.uint) > (int32_t)LOLA_SYNCED_EVENT_LATE_TOLERANCE_MICROS)
+		{
+			Stats.Missed++;
+
+			return;
+		}
+
+		EventSlot = GetFreeSlot();
+		if (EventSlot == nullptr)
+		{
+			Stats.Missed++;
+
+			return;
+		}
+
+		Stats.Received++;
+		if ((int32_t)(NowMicros - ATUI.uint) > 0)
+		{
+			Stats.Late++;
+		}
+
+		EventSlot->Active = true;
+		EventSlot->Fired = false;
+		EventSlot->Remote = true;
+		EventSlot->Sequence = sequence;
+		EventSlot->EventId = payload[0];
+		EventSlot->FireMicros = ATUI.uint;
+
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+		{
+			ATUI.array[i] = payload[5 + i];
+		}
+		EventSlot->Arguments = ATUI.uint;
+
+		SetNextRunASAP();
+	}
+
+	bool IsDuplicate(const uint8_t sequence)
+	{
+		for (uint8_t i = 0; i < MaxEvents; i++)
+		{
+			if (Events[i].Active && Events[i].Remote && Events[i].Sequence == sequence)
+			{
+				return true;
+			}
+		}
+
+		for (uint8_t i = 0; i < RecentCount; i++)
+		{
+			if (RecentRemote[i] == sequence)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+#endif
@@ -0,0 +1,29 @@
+// SyncedEventPacketDefinitions.h
+
+#ifndef _SYNCEDEVENTPACKETDEFINITIONS_h
+#define _SYNCEDEVENTPACKETDEFINITIONS_h
+
+#include <Packet\PacketDefinition.h>
+
+// Event: [Sequence as Id|EventId|FireMicros(4)|Arguments(4)]. FireMicros is on the synced clock.
+#define PACKET_DEFINITION_SYNCED_EVENT_HEADER_OFFSET		0
+#define PACKET_DEFINITION_SYNCED_EVENT_PAYLOAD_SIZE			9
+
+#define SYNCED_EVENT_SERVICE_PACKET_DEFINITION_COUNT		1
+
+template <const uint8_t BaseHeader>
+class SyncedEventPacketDefinition : public PacketDefinition
+{
+public:
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_SYNCED_EVENT_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_SYNCED_EVENT_PAYLOAD_SIZE; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("SyncedEvent"));
+	}
+#endif
+};
+#endif
@@ -0,0 +1,126 @@
+// SyncedEventTimer.h
+
+#ifndef _SYNCED_EVENT_TIMER_h
+#define _SYNCED_EVENT_TIMER_h
+
+#include <Arduino.h>
+
+//Hardware timer used for the final approach, STM32F1 only.
+#define LOLA_SYNCED_EVENT_TIMER_INDEX				(uint8_t)(3)
+//16 bit compare, at 1 us per tick.
+#define LOLA_SYNCED_EVENT_TIMER_MAX_MICROS			(uint32_t)(UINT16_MAX)
+
+class ISyncedEventTimerListener
+{
+public:
+	//Called from the timer interrupt.
+	virtual void OnTimerFired() {}
+};
+
+//One-shot micros timer, owned by a single listener.
+//Without a hardware timer Setup() fails, and the owner fires from its task instead.
+class SyncedEventTimer
+{
+private:
+#if defined(ARDUINO_ARCH_STM32F1)
+	HardwareTimer Timer;
+#endif
+
+	volatile bool Armed = false;
+
+public:
+	SyncedEventTimer()
+#if defined(ARDUINO_ARCH_STM32F1)
+		: Timer(LOLA_SYNCED_EVENT_TIMER_INDEX)
+#endif
+	{
+	}
+
+	bool Setup(ISyncedEventTimerListener* listener)
+	{
+#if defined(ARDUINO_ARCH_STM32F1)
+		if (listener == nullptr ||
+			GetListener() != nullptr)
+		{
+			//Only one owner for the hardware timer.
+			return false;
+		}
+
+		GetListener() = listener;
+		GetTimer() = this;
+
+		Timer.pause();
+		Timer.setPrescaleFactor(CYCLES_PER_MICROSECOND);
+		Timer.setOverflow(UINT16_MAX);
+		Timer.setMode(TIMER_CH1, TIMER_OUTPUT_COMPARE);
+		Timer.attachInterrupt(TIMER_CH1, OnCompareInterrupt);
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool IsArmed()
+	{
+		return Armed;
+	}
+
+	bool Arm(const uint32_t delayMicros)
+	{
+#if defined(ARDUINO_ARCH_STM32F1)
+		if (Armed ||
+			GetListener() == nullptr ||
+			delayMicros > LOLA_SYNCED_EVENT_TIMER_MAX_MICROS)
+		{
+			return false;
+		}
+
+		Timer.pause();
+		Timer.setCount(0);
+		Timer.setCompare(TIMER_CH1, max((uint32_t)1, delayMicros));
+		Timer.refresh();
+		Armed = true;
+		Timer.resume();
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void Disarm()
+	{
+#if defined(ARDUINO_ARCH_STM32F1)
+		Timer.pause();
+#endif
+		Armed = false;
+	}
+
+private:
+#if defined(ARDUINO_ARCH_STM32F1)
+	static ISyncedEventTimerListener*& GetListener()
+	{
+		static ISyncedEventTimerListener* listener = nullptr;
+
+		return listener;
+	}
+
+	static SyncedEventTimer*& GetTimer()
+	{
+		static SyncedEventTimer* timer = nullptr;
+
+		return timer;
+	}
+
+	static void OnCompareInterrupt()
+	{
+		if (GetTimer()->Armed)
+		{
+			GetTimer()->Disarm();
+			GetListener()->OnTimerFired();
+		}
+	}
+#endif
+};
+#endif
@@ -0,0 +1,460 @@
+// LoLaTelemetryService.h
+
+#ifndef _LOLA_TELEMETRY_SERVICE_h
+#define _LOLA_TELEMETRY_SERVICE_h
+
+#include <Services\ILoLaService.h>
+#include <Services\Telemetry\TelemetryPacketDefinitions.h>
+
+#define LOLA_TELEMETRY_DEFAULT_MAX_TOPICS			(uint8_t)(16)
+#define LOLA_TELEMETRY_DEFAULT_MAX_SUBSCRIPTIONS	(uint8_t)(16)
+
+#define LOLA_TELEMETRY_DEFAULT_MIN_PERIOD_MILLIS	(uint16_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*10)
+
+//Many small topics multiplexed onto one header.
+//Published topics are rate limited and packed into shared frames, highest priority first.
+//Frames aren't acknowledged, a topic with a refresh period is sent again even if unchanged.
+template<const uint8_t BaseHeader,
+	const uint8_t MaxTopics = LOLA_TELEMETRY_DEFAULT_MAX_TOPICS,
+	const uint8_t MaxSubscriptions = LOLA_TELEMETRY_DEFAULT_MAX_SUBSCRIPTIONS>
+class LoLaTelemetryService : public ILoLaService
+{
+public:
+	struct TelemetryStatsType
+	{
+		uint32_t FramesSent = 0;
+		uint32_t RecordsSent = 0;
+		uint32_t BytesPacked = 0;
+		uint32_t BytesSaved = 0;
+		uint32_t Published = 0;
+		uint32_t Coalesced = 0;
+		uint32_t FramesReceived = 0;
+		uint32_t RecordsReceived = 0;
+		uint32_t UnknownTopics = 0;
+		uint32_t SizeMismatches = 0;
+	};
+
+private:
+	TelemetryPacketDefinition<BaseHeader> TelemetryDefinition;
+
+	TemplateLoLaPacket<LOLA_PACKET_MIN_PACKET_SIZE + PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE> PacketHolder;
+
+	struct TopicType
+	{
+		uint8_t* Data = nullptr;
+		uint32_t LastSentMillis = 0;
+		uint16_t MinPeriodMillis = 0;
+		uint16_t RefreshPeriodMillis = 0;
+		uint8_t Size = 0;
+		uint8_t TopicId = 0;
+		uint8_t Priority = 0;
+		bool Pending = false;
+		bool Packed = false;
+	} Topics[MaxTopics];
+
+	uint8_t TopicCount = 0;
+
+	struct SubscriptionType
+	{
+		uint8_t* Target = nullptr;
+		uint8_t Size = 0;
+		uint8_t TopicId = 0;
+	} Subscriptions[MaxSubscriptions];
+
+	uint8_t SubscriptionCount = 0;
+
+	uint8_t NextSequence = 0;
+
+	TelemetryStatsType Stats;
+
+	//Helpers.
+	TopicType* Topic = nullptr;
+	TopicType* BestTopic = nullptr;
+	SubscriptionType* Subscription = nullptr;
+	uint8_t PackedSize = 0;
+	uint8_t Offset = 0;
+	uint32_t Elapsed = 0;
+	uint32_t SleepMillis = 0;
+
+public:
+	LoLaTelemetryService(Scheduler* scheduler, ILoLaDriver* driver)
+		: ILoLaService(scheduler, LOLA_SERVICE_DEFAULT_PERIOD_MILLIS, driver)
+	{
+		PacketHolder.ClearDefinition();
+	}
+
+	//Data is read at send time, so the latest value is always the one sent.
+	//Higher priority topics are packed first. Refresh period of 0 means only send when published.
+	bool AddTopic(const uint8_t topicId, uint8_t* data, const uint8_t size,
+		const uint8_t priority = 0,
+		const uint16_t minPeriodMillis = LOLA_TELEMETRY_DEFAULT_MIN_PERIOD_MILLIS,
+		const uint16_t refreshPeriodMillis = 0)
+	{
+		if (TopicCount >= MaxTopics ||
+			topicId == LOLA_TELEMETRY_END_MARKER ||
+			data == nullptr || size == 0 || size > LOLA_TELEMETRY_MAX_TOPIC_SIZE ||
+			FindTopic(topicId) != nullptr)
+		{
+			return false;
+		}
+
+		Topics[TopicCount].TopicId = topicId;
+		Topics[TopicCount].Data = data;
+		Topics[TopicCount].Size = size;
+		Topics[TopicCount].Priority = priority;
+		Topics[TopicCount].MinPeriodMillis = minPeriodMillis;
+		Topics[TopicCount].RefreshPeriodMillis = refreshPeriodMillis;
+		Topics[TopicCount].Pending = false;
+		TopicCount++;
+
+		return true;
+	}
+
+	//Received topic data is copied to target, then OnTopicReceived() is called.
+	bool Subscribe(const uint8_t topicId, uint8_t* target, const uint8_t size)
+	{
+		if (SubscriptionCount >= MaxSubscriptions ||
+			topicId == LOLA_TELEMETRY_END_MARKER ||
+			target == nullptr || size == 0 || size > LOLA_TELEMETRY_MAX_TOPIC_SIZE ||
+			FindSubscription(topicId) != nullptr)
+		{
+			return false;
+		}
+
+		Subscriptions[SubscriptionCount].TopicId = topicId;
+		Subscriptions[SubscriptionCount].Target = target;
+		Subscriptions[SubscriptionCount].Size = size;
+		SubscriptionCount++;
+
+		return true;
+	}
+
+	//Marks the topic as updated. Publishing again before it's sent costs nothing.
+	bool Publish(const uint8_t topicId)
+	{
+		Topic = FindTopic(topicId);
+
+		if (Topic == nullptr)
+		{
+			return false;
+		}
+
+		Stats.Published++;
+		if (Topic->Pending)
+		{
+			Stats.Coalesced++;
+		}
+		else
+		{
+			Topic->Pending = true;
+			if (LoLaDriver->HasLink())
+			{
+				Enable();
+				SetNextRunASAP();
+			}
+		}
+
+		return true;
+	}
+
+	TelemetryStatsType* GetStats()
+	{
+		return &Stats;
+	}
+
+	//Average packed bytes per frame, out of PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE.
+	uint8_t GetAverageFrameFill()
+	{
+		if (Stats.FramesSent == 0)
+		{
+			return 0;
+		}
+
+		return Stats.BytesPacked / Stats.FramesSent;
+	}
+
+#ifdef DEBUG_LOLA
+	void DebugStats(Stream* serial)
+	{
+		serial->print(F("Frames sent: "));
+		serial->print(Stats.FramesSent);
+		serial->print(F(" Records: "));
+		serial->print(Stats.RecordsSent);
+		serial->print(F(" Fill: "));
+		serial->print(GetAverageFrameFill());
+		serial->print('/');
+		serial->print(PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE);
+		serial->print(F(" Saved: "));
+		serial->println(Stats.BytesSaved);
+		serial->print(F("Frames received: "));
+		serial->print(Stats.FramesReceived);
+		serial->print(F(" Records: "));
+		serial->print(Stats.RecordsReceived);
+		serial->print(F(" Unknown: "));
+		serial->println(Stats.UnknownTopics);
+	}
+#endif
+
+	void OnLinkEstablished()
+	{
+		NextSequence = 0;
+		for (uint8_t i = 0; i < TopicCount; i++)
+		{
+			//Everything goes out once on a new link.
+			Topics[i].Pending = true;
+			Topics[i].LastSentMillis = millis() - Topics[i].MinPeriodMillis;
+		}
+
+		Enable();
+		SetNextRunASAP();
+	}
+
+	void OnLinkLost()
+	{
+		Disable();
+	}
+
+	bool ProcessPacket(ILoLaPacket* incomingPacket)
+	{
+		if (incomingPacket->GetDataHeader() == TelemetryDefinition.GetHeader())
+		{
+			OnFrameReceived(incomingPacket->GetPayload(), incomingPacket->GetPayloadSize());
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Callback()
+	{
+		if (!LoLaDriver->HasLink())
+		{
+			Disable();
+
+			return false;
+		}
+
+		SleepMillis = LOLA_SERVICE_LONG_SLEEP_PERIOD_MILLIS;
+
+		if (HasTopicDue())
+		{
+			if (AllowedSend() && SendFrame())
+			{
+				SetNextRunASAP();
+
+				return true;
+			}
+
+			SetNextRunOnSendSlot(SleepMillis);
+		}
+		else
+		{
+			SetNextRunDelay(SleepMillis);
+		}
+
+		return false;
+	}
+
+protected:
+	//Called after the subscription target has been updated.
+	virtual void OnTopicReceived(const uint8_t topicId) {}
+
+	//Called for topics with no subscription, data is only valid during the call.
+	virtual void OnUnknownTopicReceived(const uint8_t topicId, const uint8_t* data, const uint8_t size) {}
+
+#ifdef DEBUG_LOLA
+	virtual void PrintName(Stream* serial)
+	{
+		serial->print(F("Telemetry"));
+	}
+#endif
+
+	bool OnAddPacketMap(LoLaPacketMap* packetMap)
+	{
+		return packetMap->AddMapping(&TelemetryDefinition);
+	}
+
+private:
+	TopicType* FindTopic(const uint8_t topicId)
+	{
+		for (uint8_t i = 0; i < TopicCount; i++)
+		{
+			if (Topics[i].TopicId == topicId)
+			{
+				return &Topics[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	SubscriptionType* FindSubscription(const uint8_t topicId)
+	{
+		for (uint8_t i = 0; i < SubscriptionCount; i++)
+		{
+			if (Subscriptions[i].TopicId == topicId)
+			{
+				return &Subscriptions[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	//Due topics are flagged as not packed yet. Also finds out how long to sleep, if none is due.
+	bool HasTopicDue()
+	{
+		bool anyDue = false;
+
+		for (uint8_t i = 0; i < TopicCount; i++)
+		{
+			Topic = &Topics[i];
+			Elapsed = millis() - Topic->LastSentMillis;
+
+			if (!Topic->Pending && Topic->RefreshPeriodMillis > 0 &&
+				Elapsed >= Topic->RefreshPeriodMillis)
+			{
+				Topic->Pending = true;
+			}
+
+			if (Topic->Pending)
+			{
+				if (Elapsed >= Topic->MinPeriodMillis)
+				{
+					Topic->Packed = false;
+					anyDue = true;
+				}
+				else
+				{
+					//Rate limited, wake up when it's allowed.
+					Topic->Packed = true;
+					SleepMillis = min(SleepMillis, (uint32_t)(Topic->MinPeriodMillis - Elapsed));
+				}
+			}
+			else
+			{
+				Topic->Packed = true;
+				if (Topic->RefreshPeriodMillis > 0)
+				{
+					SleepMillis = min(SleepMillis, (uint32_t)(Topic->RefreshPeriodMillis - Elapsed));
+				}
+			}
+		}
+
+		return anyDue;
+	}
+
+	//Highest priority first, ties go to the one waiting longest.
+	//Smaller topics fill what's left after bigger ones don't fit.
+	TopicType* GetBestFit(const uint8_t spaceLeft)
+	{
+		BestTopic = nullptr;
+
+		for (uint8_t i = 0; i < TopicCount; i++)
+		{
+			Topic = &Topics[i];
+			if (!Topic->Packed &&
+				(Topic->Size + LOLA_TELEMETRY_RECORD_HEADER_SIZE) <= spaceLeft)
+			{
+				if (BestTopic == nullptr ||
+					Topic->Priority > BestTopic->Priority ||
+					(Topic->Priority == BestTopic->Priority &&
+					(millis() - Topic->LastSentMillis) > (millis() - BestTopic->LastSentMillis)))
+				{
+					BestTopic = Topic;
+				}
+			}
+		}
+
+		return BestTopic;
+	}
+
+	bool SendFrame()
+	{
+		PacketHolder.SetDefinition(&TelemetryDefinition);
+		PacketHolder.SetId(NextSequence);
+
+		PackedSize = 0;
+		Topic = GetBestFit(PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE);
+		while (Topic != nullptr)
+		{
+			Topic->Packed = true;
+			PacketHolder.GetPayload()[PackedSize++] = Topic->TopicId;
+			PacketHolder.GetPayload()[PackedSize++] = Topic->Size;
+			for (uint8_t i = 0; i < Topic->Size; i++)
+			{
+				PacketHolder.GetPayload()[PackedSize++] = Topic->Data[i];
+			}
+
+			Topic = GetBestFit(PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE - PackedSize);
+		}
+
+		PacketHolder.SetPayloadSize(PackedSize);
+
+		if (!SendPacket(&PacketHolder))
+		{
+			return false;
+		}
+
+		//Only the topics in this frame are cleared, the rest go in the next one.
+		for (uint8_t i = 0; i < TopicCount; i++)
+		{
+			if (Topics[i].Pending && Topics[i].Packed &&
+				(millis() - Topics[i].LastSentMillis) >= Topics[i].MinPeriodMillis)
+			{
+				Topics[i].Pending = false;
+				Topics[i].LastSentMillis = millis();
+				Stats.RecordsSent++;
+			}
+		}
+
+		NextSequence++;
+		Stats.FramesSent++;
+		Stats.BytesPacked += PackedSize;
+		Stats.BytesSaved += PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE - PackedSize;
+
+		return true;
+	}
+
+	void OnFrameReceived(uint8_t* payload, const uint8_t payloadSize)
+	{
+		Stats.FramesReceived++;
+
+		Offset = 0;
+		while (Offset + LOLA_TELEMETRY_RECORD_HEADER_SIZE <= payloadSize &&
+			payload[Offset] != LOLA_TELEMETRY_END_MARKER)
+		{
+			PackedSize = payload[Offset + 1];
+			if (PackedSize == 0 ||
+				Offset + LOLA_TELEMETRY_RECORD_HEADER_SIZE + PackedSize > payloadSize)
+			{
+				//Malformed, nothing after this can be trusted.
+				break;
+			}
+
+			Stats.RecordsReceived++;
+			Subscription = FindSubscription(payload[Offset]);
+			if (Subscription == nullptr)
+			{
+				Stats.UnknownTopics++;
+				OnUnknownTopicReceived(payload[Offset], &payload[Offset + LOLA_TELEMETRY_RECORD_HEADER_SIZE], PackedSize);
+			}
+			else if (Subscription->Size != PackedSize)
+			{
+				Stats.SizeMismatches++;
+			}
+			else
+			{
+				for (uint8_t i = 0; i < PackedSize; i++)
+				{
+					Subscription->Target[i] = payload[Offset + LOLA_TELEMETRY_RECORD_HEADER_SIZE + i];
+				}
+				OnTopicReceived(Subscription->TopicId);
+			}
+
+			Offset += LOLA_TELEMETRY_RECORD_HEADER_SIZE + PackedSize;
+		}
+	}
+};
+#endif
@@ -0,0 +1,34 @@
+// TelemetryPacketDefinitions.h
+
+#ifndef _TELEMETRYPACKETDEFINITIONS_h
+#define _TELEMETRYPACKETDEFINITIONS_h
+
+#include <Packet\PacketDefinition.h>
+
+// Frame: [Sequence as Id|Record|Record|...]. Record: [TopicId|Size|Data(Size)].
+// Records are packed until the frame is full, variable size frame ends after the last record.
+#define PACKET_DEFINITION_TELEMETRY_HEADER_OFFSET		0
+#define PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE		(uint8_t)(LOLA_PACKET_MAX_PACKET_SIZE - LOLA_PACKET_MIN_PACKET_SIZE)
+
+#define TELEMETRY_SERVICE_PACKET_DEFINITION_COUNT		1
+
+#define LOLA_TELEMETRY_RECORD_HEADER_SIZE				2
+#define LOLA_TELEMETRY_END_MARKER						(uint8_t)0xFF
+#define LOLA_TELEMETRY_MAX_TOPIC_SIZE					(uint8_t)(PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE - LOLA_TELEMETRY_RECORD_HEADER_SIZE)
+
+template <const uint8_t BaseHeader>
+class TelemetryPacketDefinition : public PacketDefinition
+{
+public:
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_VARIABLE_SIZE; }
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_TELEMETRY_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_TELEMETRY_PAYLOAD_SIZE; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("Telemetry"));
+	}
+#endif
+};
+#endif
@@ -0,0 +1,195 @@
+// TemplateServicesManager.h
+
+#ifndef _TEMPLATE_SERVICES_MANAGER_h
+#define _TEMPLATE_SERVICES_MANAGER_h
+
+#include <Services\LoLaServicesManager.h>
+
+//Compile time list of services, each call is unrolled by the compiler.
+//Services declared final get their hooks devirtualized and inlined too.
+template<typename... ServiceTypes>
+class TemplateServicesList;
+
+template<>
+class TemplateServicesList<>
+{
+public:
+	TemplateServicesList() {}
+
+	bool Init() { return true; }
+	bool ProcessPacket(ILoLaPacket* receivedPacket) { return false; }
+	bool ProcessAckedPacket(ILoLaPacket* receivedPacket) { return false; }
+	bool ProcessAck(const uint8_t header, const uint8_t id) { return false; }
+	bool ProcessSent(const uint8_t header) { return false; }
+	bool ProcessSendFailed(const uint8_t header, const uint8_t id) { return false; }
+	void NotifySendSlotOpen() {}
+	void NotifyLinkUpdated(const bool connected) {}
+	uint32_t GetWakeCount() { return 0; }
+
+#ifdef DEBUG_LOLA
+	void Debug(Stream* serial) {}
+#endif
+};
+
+template<typename ServiceType, typename... NextTypes>
+class TemplateServicesList<ServiceType, NextTypes...>
+{
+private:
+	ServiceType* Service;
+	TemplateServicesList<NextTypes...> Next;
+
+public:
+	TemplateServicesList(ServiceType* service, NextTypes*... next)
+		: Service(service)
+		, Next(next...)
+	{
+	}
+
+	bool Init()
+	{
+		return Service->Init() && Next.Init();
+	}
+
+	bool ProcessPacket(ILoLaPacket* receivedPacket)
+	{
+		return Service->ReceivedPacket(receivedPacket) || Next.ProcessPacket(receivedPacket);
+	}
+
+	bool ProcessAckedPacket(ILoLaPacket* receivedPacket)
+	{
+		return Service->ReceivedAckedPacket(receivedPacket) || Next.ProcessAckedPacket(receivedPacket);
+	}
+
+	bool ProcessAck(const uint8_t header, const uint8_t id)
+	{
+		return Service->ReceivedAck(header, id) || Next.ProcessAck(header, id);
+	}
+
+	bool ProcessSent(const uint8_t header)
+	{
+		return Service->ProcessSent(header) || Next.ProcessSent(header);
+	}
+
+	bool ProcessSendFailed(const uint8_t header, const uint8_t id)
+	{
+		return Service->ProcessSendFailed(header, id) || Next.ProcessSendFailed(header, id);
+	}
+
+	void NotifySendSlotOpen()
+	{
+		Service->OnSendSlotOpen();
+		Next.NotifySendSlotOpen();
+	}
+
+	void NotifyLinkUpdated(const bool connected)
+	{
+		if (connected)
+		{
+			Service->OnLinkEstablished();
+		}
+		else
+		{
+			Service->OnLinkLost();
+		}
+		Next.NotifyLinkUpdated(connected);
+	}
+
+	uint32_t GetWakeCount()
+	{
+		return Service->GetWakeCount() + Next.GetWakeCount();
+	}
+
+#ifdef DEBUG_LOLA
+	void Debug(Stream* serial)
+	{
+		Service->Debug(serial);
+		serial->println();
+		Next.Debug(serial);
+	}
+#endif
+};
+
+//Application services composed at compile time, no slots or null checks.
+//The link services stay in the dynamic manager, these are served right after them.
+//Usage: TemplateServicesManager<SurfaceWriter, RpcService> Services(&Writer, &Rpc);
+//	Services.Attach(LoLaDriver.GetServices());
+template<typename... ServiceTypes>
+class TemplateServicesManager : public ILoLaServicesGroup
+{
+public:
+	static const uint8_t ServicesCount = sizeof...(ServiceTypes);
+
+private:
+	TemplateServicesList<ServiceTypes...> Services;
+
+public:
+	TemplateServicesManager(ServiceTypes*... services)
+		: ILoLaServicesGroup()
+		, Services(services...)
+	{
+	}
+
+	bool Attach(LoLaServicesManager* servicesManager)
+	{
+		if (servicesManager == nullptr ||
+			!Services.Init())
+		{
+			return false;
+		}
+
+		return servicesManager->SetServicesGroup(this);
+	}
+
+	bool ProcessPacket(ILoLaPacket* receivedPacket)
+	{
+		return Services.ProcessPacket(receivedPacket);
+	}
+
+	bool ProcessAckedPacket(ILoLaPacket* receivedPacket)
+	{
+		return Services.ProcessAckedPacket(receivedPacket);
+	}
+
+	bool ProcessAck(const uint8_t header, const uint8_t id)
+	{
+		return Services.ProcessAck(header, id);
+	}
+
+	bool ProcessSent(const uint8_t header)
+	{
+		return Services.ProcessSent(header);
+	}
+
+	bool ProcessSendFailed(const uint8_t header, const uint8_t id)
+	{
+		return Services.ProcessSendFailed(header, id);
+	}
+
+	void NotifySendSlotOpen()
+	{
+		Services.NotifySendSlotOpen();
+	}
+
+	void NotifyLinkUpdated(const bool connected)
+	{
+		Services.NotifyLinkUpdated(connected);
+	}
+
+	uint32_t GetWakeCount()
+	{
+		return Services.GetWakeCount();
+	}
+
+	uint8_t GetCount()
+	{
+		return ServicesCount;
+	}
+
+#ifdef DEBUG_LOLA
+	void Debug(Stream* serial)
+	{
+		Services.Debug(serial);
+	}
+#endif
+};
+#endif
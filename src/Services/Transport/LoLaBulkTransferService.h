@@ -0,0 +1,542 @@
+// LoLaBulkTransferService.h
+
+#ifndef _LOLA_BULK_TRANSFER_SERVICE_h
+#define _LOLA_BULK_TRANSFER_SERVICE_h
+
+#include <Services\Transport\LoLaReliableTransportService.h>
+#include <FastCRC.h>
+
+// Messages, on top of the transport:
+// Offer: [Offer|ImageId|Size(4)|CRC32(4)], sender to receiver.
+// Resume: [Resume|ImageId|Offset(4)], receiver to sender, where to (re)start.
+// Block: [Block|Offset(4)|Data].
+// Result: [Result|ImageId|Result], receiver to sender, ends the transfer.
+// Abort: [Abort|ImageId|Result], sender to receiver, ends the transfer.
+#define LOLA_BULK_BLOCK_HEADER_SIZE				(uint8_t)(5)
+#define LOLA_BULK_BLOCK_CHUNKS					(uint8_t)(4)
+#define LOLA_BULK_BLOCK_SIZE					(uint8_t)((LOLA_TRANSPORT_CHUNK_SIZE * LOLA_BULK_BLOCK_CHUNKS) - LOLA_BULK_BLOCK_HEADER_SIZE)
+#define LOLA_BULK_MAX_MESSAGE_SIZE				(uint8_t)(LOLA_BULK_BLOCK_HEADER_SIZE + LOLA_BULK_BLOCK_SIZE)
+#define LOLA_BULK_CONTROL_MESSAGE_SIZE			(uint8_t)(10)
+
+//Data is held back after someone else used the slot, doubling while it keeps happening.
+#define LOLA_BULK_YIELD_MIN_MILLIS				(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS)
+#define LOLA_BULK_YIELD_MAX_MILLIS				(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*8)
+
+//Images are pushed in blocks, with a whole image CRC32 checked at the end.
+//An interrupted transfer resumes from the receiver's last written offset, on the next link.
+//Bulk is background traffic, it yields to every other service.
+template<const uint8_t BaseHeader, const uint8_t WindowSize = LOLA_TRANSPORT_DEFAULT_WINDOW_SIZE>
+class LoLaBulkTransferService : public LoLaReliableTransportService<BaseHeader, WindowSize>
+{
+	static_assert(((uint16_t)WindowSize * LOLA_TRANSPORT_CHUNK_SIZE) >= LOLA_BULK_MAX_MESSAGE_SIZE, "Bulk block doesn't fit the transport window.");
+
+private:
+	typedef LoLaReliableTransportService<BaseHeader, WindowSize> BaseTransport;
+
+	enum BulkMessageEnum : uint8_t
+	{
+		Offer = 0,
+		Resume = 1,
+		Block = 2,
+		Result = 3,
+		Abort = 4
+	};
+
+public:
+	enum BulkResultEnum : uint8_t
+	{
+		Success = 0,
+		CrcMismatch = 1,
+		Rejected = 2,
+		WriteFailed = 3,
+		ReadFailed = 4
+	};
+
+private:
+	//Sender.
+	enum TransmitStateEnum : uint8_t
+	{
+		Idle = 0,
+		Offering = 1,
+		WaitingForResume = 2,
+		Sending = 3,
+		WaitingForResult = 4
+	} TransmitState = TransmitStateEnum::Idle;
+
+	uint8_t TransmitImageId = 0;
+	uint32_t TransmitSize = 0;
+	uint32_t TransmitCrc = 0;
+	uint32_t TransmitOffset = 0;
+	uint32_t TransmitStartMillis = 0;
+
+	//Receiver.
+	FastCRC32 CRC32;
+	bool ReceiveActive = false;
+	uint8_t ReceiveImageId = 0;
+	uint32_t ReceiveSize = 0;
+	uint32_t ReceiveCrc = 0;
+	uint32_t ReceiveOffset = 0;
+	uint32_t ReceiveRunningCrc = 0;
+
+	uint8_t IncomingMessage[LOLA_BULK_MAX_MESSAGE_SIZE];
+	uint8_t IncomingLength = 0;
+	bool IncomingOverflow = false;
+
+	uint8_t OutgoingMessage[LOLA_BULK_MAX_MESSAGE_SIZE];
+
+	//Control replies wait here if the window is full.
+	uint8_t ReplyMessage[LOLA_BULK_CONTROL_MESSAGE_SIZE];
+	uint8_t ReplyLength = 0;
+
+	//Yield to real-time services.
+	uint32_t OwnLastSentMicros = ILOLA_INVALID_MICROS;
+	uint32_t YieldStartMillis = 0;
+	uint32_t YieldMillis = LOLA_BULK_YIELD_MIN_MILLIS;
+	bool Yielding = false;
+	bool SentSinceYield = true;
+
+	//Statistics.
+	uint32_t YieldCount = 0;
+	uint32_t ResumeCount = 0;
+	uint32_t LastTransferMillis = 0;
+	uint32_t LastTransferSize = 0;
+
+	union ArrayToUint32 {
+		byte array[4];
+		uint32_t uint;
+	} ATUI;
+
+	//Helpers.
+	uint8_t BlockSize = 0;
+
+public:
+	LoLaBulkTransferService(Scheduler* scheduler, ILoLaDriver* driver)
+		: BaseTransport(scheduler, driver)
+	{
+	}
+
+	//CRC32 of the whole image, as FastCRC32::crc32().
+	bool StartTransfer(const uint8_t imageId, const uint32_t size, const uint32_t crc)
+	{
+		if (TransmitState != TransmitStateEnum::Idle || size == 0)
+		{
+			return false;
+		}
+
+		TransmitImageId = imageId;
+		TransmitSize = size;
+		TransmitCrc = crc;
+		TransmitOffset = 0;
+		TransmitStartMillis = millis();
+		TransmitState = TransmitStateEnum::Offering;
+
+		this->SetNextRunASAP();
+
+		return true;
+	}
+
+	bool IsTransferring()
+	{
+		return TransmitState != TransmitStateEnum::Idle;
+	}
+
+	//Queued to the transport, not yet confirmed.
+	uint32_t GetTransmitOffset()
+	{
+		return TransmitOffset;
+	}
+
+	uint32_t GetReceiveOffset()
+	{
+		return ReceiveOffset;
+	}
+
+	uint32_t GetYieldCount()
+	{
+		return YieldCount;
+	}
+
+	uint32_t GetResumeCount()
+	{
+		return ResumeCount;
+	}
+
+	//Whole image, from offer to result, resumes included.
+	uint32_t GetLastTransferMillis()
+	{
+		return LastTransferMillis;
+	}
+
+	uint32_t GetLastTransferBytesPerSecond()
+	{
+		if (LastTransferMillis == 0)
+		{
+			return 0;
+		}
+
+		return (uint32_t)(((uint64_t)LastTransferSize * 1000) / LastTransferMillis);
+	}
+
+	void OnLinkEstablished()
+	{
+		BaseTransport::OnLinkEstablished();
+
+		//Transport session restarts, so does the handshake.
+		IncomingLength = 0;
+		IncomingOverflow = false;
+		ReplyLength = 0;
+		OwnLastSentMicros = ILOLA_INVALID_MICROS;
+		Yielding = false;
+		SentSinceYield = true;
+		YieldMillis = LOLA_BULK_YIELD_MIN_MILLIS;
+
+		if (TransmitState != TransmitStateEnum::Idle)
+		{
+			TransmitState = TransmitStateEnum::Offering;
+		}
+	}
+
+	bool ProcessSent(const uint8_t header)
+	{
+		if (header == BaseHeader + PACKET_DEFINITION_TRANSPORT_DATA_HEADER_OFFSET ||
+			header == BaseHeader + PACKET_DEFINITION_TRANSPORT_SACK_HEADER_OFFSET)
+		{
+			OwnLastSentMicros = this->LoLaDriver->GetLastValidSentMicros();
+			SentSinceYield = true;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Callback()
+	{
+		if (this->LoLaDriver->HasLink())
+		{
+			FeedTransport();
+		}
+
+		return BaseTransport::Callback();
+	}
+
+protected:
+	///Sender side.
+	virtual bool OnReadImage(const uint32_t offset, uint8_t* buffer, const uint8_t length) { return false; }
+	virtual void OnTransferFinished(const uint8_t imageId, const BulkResultEnum result) {}
+	///
+
+	///Receiver side.
+	//Return true to accept the image, starting at offset 0.
+	virtual bool OnTransferOffered(const uint8_t imageId, const uint32_t size) { return false; }
+	virtual bool OnWriteImage(const uint32_t offset, const uint8_t* data, const uint8_t length) { return false; }
+	virtual void OnTransferReceived(const uint8_t imageId, const BulkResultEnum result) {}
+	///
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("BulkTransfer"));
+	}
+#endif
+
+	void OnDataReceived(uint8_t* data, const uint8_t length, const bool endOfMessage)
+	{
+		if (!IncomingOverflow)
+		{
+			if (IncomingLength + length <= LOLA_BULK_MAX_MESSAGE_SIZE)
+			{
+				memcpy(&IncomingMessage[IncomingLength], data, length);
+				IncomingLength += length;
+			}
+			else
+			{
+				IncomingOverflow = true;
+			}
+		}
+
+		if (endOfMessage)
+		{
+			if (!IncomingOverflow && IncomingLength > 0)
+			{
+				OnMessageReceived();
+			}
+
+			IncomingLength = 0;
+			IncomingOverflow = false;
+		}
+	}
+
+	//At least one packet of ours goes out between yields, bulk is slowed down but never starved.
+	uint32_t GetDataYieldMillis()
+	{
+		if (Yielding)
+		{
+			if (millis() - YieldStartMillis < YieldMillis)
+			{
+				return YieldMillis - (millis() - YieldStartMillis);
+			}
+
+			Yielding = false;
+		}
+
+		if (SentSinceYield &&
+			OwnLastSentMicros != ILOLA_INVALID_MICROS &&
+			this->LoLaDriver->GetLastValidSentMicros() != OwnLastSentMicros)
+		{
+			//Someone else sent since our last.
+			OwnLastSentMicros = this->LoLaDriver->GetLastValidSentMicros();
+			SentSinceYield = false;
+			Yielding = true;
+			YieldStartMillis = millis();
+			YieldCount++;
+
+			if (YieldMillis < LOLA_BULK_YIELD_MAX_MILLIS)
+			{
+				YieldMillis = min(YieldMillis * 2, LOLA_BULK_YIELD_MAX_MILLIS);
+			}
+
+			return YieldMillis;
+		}
+		else if (SentSinceYield && YieldMillis > LOLA_BULK_YIELD_MIN_MILLIS)
+		{
+			YieldMillis = max(YieldMillis / 2, LOLA_BULK_YIELD_MIN_MILLIS);
+		}
+
+		return 0;
+	}
+
+private:
+	void FeedTransport()
+	{
+		if (ReplyLength > 0)
+		{
+			if (this->WriteMessage(ReplyMessage, ReplyLength))
+			{
+				ReplyLength = 0;
+			}
+			else
+			{
+				return;
+			}
+		}
+
+		switch (TransmitState)
+		{
+		case TransmitStateEnum::Offering:
+			OutgoingMessage[0] = BulkMessageEnum::Offer;
+			OutgoingMessage[1] = TransmitImageId;
+			SetUint32(&OutgoingMessage[2], TransmitSize);
+			SetUint32(&OutgoingMessage[6], TransmitCrc);
+
+			if (this->WriteMessage(OutgoingMessage, LOLA_BULK_CONTROL_MESSAGE_SIZE))
+			{
+				TransmitState = TransmitStateEnum::WaitingForResume;
+			}
+			break;
+		case TransmitStateEnum::Sending:
+			while (TransmitOffset < TransmitSize &&
+				this->GetWriteSpace() >= LOLA_BULK_MAX_MESSAGE_SIZE)
+			{
+				BlockSize = (uint8_t)min((uint32_t)LOLA_BULK_BLOCK_SIZE, TransmitSize - TransmitOffset);
+
+				OutgoingMessage[0] = BulkMessageEnum::Block;
+				SetUint32(&OutgoingMessage[1], TransmitOffset);
+
+				if (!OnReadImage(TransmitOffset, &OutgoingMessage[LOLA_BULK_BLOCK_HEADER_SIZE], BlockSize))
+				{
+					QueueReply(BulkMessageEnum::Abort, TransmitImageId, BulkResultEnum::ReadFailed);
+					FinishTransmit(BulkResultEnum::ReadFailed);
+
+					return;
+				}
+
+				this->WriteMessage(OutgoingMessage, LOLA_BULK_BLOCK_HEADER_SIZE + BlockSize);
+				TransmitOffset += BlockSize;
+			}
+
+			if (TransmitOffset >= TransmitSize)
+			{
+				TransmitState = TransmitStateEnum::WaitingForResult;
+			}
+			break;
+		case TransmitStateEnum::Idle:
+		case TransmitStateEnum::WaitingForResume:
+		case TransmitStateEnum::WaitingForResult:
+		default:
+			break;
+		}
+	}
+
+	void OnMessageReceived()
+	{
+		switch (IncomingMessage[0])
+		{
+		case BulkMessageEnum::Offer:
+			if (IncomingLength == LOLA_BULK_CONTROL_MESSAGE_SIZE)
+			{
+				OnOfferReceived(IncomingMessage[1], GetUint32(&IncomingMessage[2]), GetUint32(&IncomingMessage[6]));
+			}
+			break;
+		case BulkMessageEnum::Resume:
+			if (IncomingLength == 6 &&
+				TransmitState == TransmitStateEnum::WaitingForResume &&
+				IncomingMessage[1] == TransmitImageId)
+			{
+				TransmitOffset = min(GetUint32(&IncomingMessage[2]), TransmitSize);
+				if (TransmitOffset > 0)
+				{
+					ResumeCount++;
+				}
+				TransmitState = TransmitStateEnum::Sending;
+				this->SetNextRunASAP();
+			}
+			break;
+		case BulkMessageEnum::Block:
+			if (IncomingLength > LOLA_BULK_BLOCK_HEADER_SIZE)
+			{
+				OnBlockReceived(GetUint32(&IncomingMessage[1]), &IncomingMessage[LOLA_BULK_BLOCK_HEADER_SIZE], IncomingLength - LOLA_BULK_BLOCK_HEADER_SIZE);
+			}
+			break;
+		case BulkMessageEnum::Result:
+			if (IncomingLength == 3 &&
+				TransmitState != TransmitStateEnum::Idle &&
+				IncomingMessage[1] == TransmitImageId)
+			{
+				FinishTransmit((BulkResultEnum)IncomingMessage[2]);
+			}
+			break;
+		case BulkMessageEnum::Abort:
+			if (IncomingLength == 3 &&
+				ReceiveActive &&
+				IncomingMessage[1] == ReceiveImageId)
+			{
+				ReceiveActive = false;
+				OnTransferReceived(ReceiveImageId, (BulkResultEnum)IncomingMessage[2]);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	void OnOfferReceived(const uint8_t imageId, const uint32_t size, const uint32_t crc)
+	{
+		if (ReceiveActive &&
+			imageId == ReceiveImageId && size == ReceiveSize && crc == ReceiveCrc)
+		{
+			//Same image, pick up where we left.
+			ResumeCount++;
+		}
+		else if (size > 0 && OnTransferOffered(imageId, size))
+		{
+			ReceiveActive = true;
+			ReceiveImageId = imageId;
+			ReceiveSize = size;
+			ReceiveCrc = crc;
+			ReceiveOffset = 0;
+		}
+		else
+		{
+			QueueReply(BulkMessageEnum::Result, imageId, BulkResultEnum::Rejected);
+
+			return;
+		}
+
+		ReplyMessage[0] = BulkMessageEnum::Resume;
+		ReplyMessage[1] = ReceiveImageId;
+		SetUint32(&ReplyMessage[2], ReceiveOffset);
+		ReplyLength = 6;
+
+		this->SetNextRunASAP();
+	}
+
+	void OnBlockReceived(const uint32_t offset, uint8_t* data, const uint8_t length)
+	{
+		if (!ReceiveActive || offset != ReceiveOffset)
+		{
+			//Stale, from before a resume.
+			return;
+		}
+
+		if (offset + length > ReceiveSize ||
+			!OnWriteImage(offset, data, length))
+		{
+			ReceiveActive = false;
+			QueueReply(BulkMessageEnum::Result, ReceiveImageId, BulkResultEnum::WriteFailed);
+			OnTransferReceived(ReceiveImageId, BulkResultEnum::WriteFailed);
+
+			return;
+		}
+
+		//Blocks arrive in order, the CRC runs along.
+		if (ReceiveOffset == 0)
+		{
+			ReceiveRunningCrc = CRC32.crc32(data, length);
+		}
+		else
+		{
+			ReceiveRunningCrc = CRC32.crc32_upd(data, length);
+		}
+		ReceiveOffset += length;
+
+		if (ReceiveOffset >= ReceiveSize)
+		{
+			ReceiveActive = false;
+
+			if (ReceiveRunningCrc == ReceiveCrc)
+			{
+				QueueReply(BulkMessageEnum::Result, ReceiveImageId, BulkResultEnum::Success);
+				OnTransferReceived(ReceiveImageId, BulkResultEnum::Success);
+			}
+			else
+			{
+				QueueReply(BulkMessageEnum::Result, ReceiveImageId, BulkResultEnum::CrcMismatch);
+				OnTransferReceived(ReceiveImageId, BulkResultEnum::CrcMismatch);
+			}
+		}
+	}
+
+	void FinishTransmit(const BulkResultEnum result)
+	{
+		TransmitState = TransmitStateEnum::Idle;
+
+		if (result == BulkResultEnum::Success)
+		{
+			LastTransferMillis = millis() - TransmitStartMillis;
+			LastTransferSize = TransmitSize;
+		}
+
+		OnTransferFinished(TransmitImageId, result);
+	}
+
+	void QueueReply(const BulkMessageEnum message, const uint8_t imageId, const BulkResultEnum result)
+	{
+		ReplyMessage[0] = message;
+		ReplyMessage[1] = imageId;
+		ReplyMessage[2] = result;
+		ReplyLength = 3;
+
+		this->SetNextRunASAP();
+	}
+
+	void SetUint32(uint8_t* target, const uint32_t value)
+	{
+		ATUI.uint = value;
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+		{
+			target[i] = ATUI.array[i];
+		}
+	}
+
+	uint32_t GetUint32(const uint8_t* source)
+	{
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+		{
+			ATUI.array[i] = source[i];
+		}
+
+		return ATUI.uint;
+	}
+};
+#endif
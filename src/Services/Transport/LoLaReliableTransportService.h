@@ -0,0 +1,721 @@
+// LoLaReliableTransportService.h
+
+#ifndef _LOLA_RELIABLE_TRANSPORT_SERVICE_h
+#define _LOLA_RELIABLE_TRANSPORT_SERVICE_h
+
+#include <Arduino.h>
+#include <Services\ILoLaService.h>
+#include <Services\Transport\TransportPacketDefinitions.h>
+
+#define LOLA_TRANSPORT_DEFAULT_WINDOW_SIZE			(uint8_t)(8)
+#define LOLA_TRANSPORT_MAX_WINDOW_SIZE				(uint8_t)(32) //SACK bitmap is 32 bits wide.
+
+#define LOLA_TRANSPORT_CHECK_PERIOD_MILLIS			(uint32_t)1
+#define LOLA_TRANSPORT_SACK_DELAY_MILLIS			(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS/2) //Coalesces a burst into one SACK.
+
+//Retransmit time out, adapted from the measured RTT.
+#define LOLA_TRANSPORT_RTO_INITIAL_MILLIS			(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*3)
+#define LOLA_TRANSPORT_RTO_MIN_MILLIS				(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*2)
+#define LOLA_TRANSPORT_RTO_MAX_MILLIS				(uint32_t)(ILOLA_DEFAULT_DUPLEX_PERIOD_MILLIS*20)
+#define LOLA_TRANSPORT_RTO_MAX_BACK_OFF_SHIFT		(uint8_t)(3)
+
+//A gap is a loss once this many later packets got through.
+#ifdef LOLA_TRANSPORT_USE_FEC
+#define LOLA_TRANSPORT_GAP_LOSS_DISTANCE			(uint8_t)(LOLA_PACKET_FEC_GROUP_SIZE) //Until the group's parity is in, FEC may still repair it.
+#else
+#define LOLA_TRANSPORT_GAP_LOSS_DISTANCE			(uint8_t)(1)
+#endif
+
+//Sliding window with selective acks, on top of the packet driver.
+//Both partners run the same service with the same BaseHeader, each is sender and receiver.
+//Sequence numbers restart on every link.
+template<const uint8_t BaseHeader, const uint8_t WindowSize = LOLA_TRANSPORT_DEFAULT_WINDOW_SIZE>
+class LoLaReliableTransportService : public ILoLaService
+{
+	static_assert(WindowSize > 1 && WindowSize <= LOLA_TRANSPORT_MAX_WINDOW_SIZE, "Transport window size out of range.");
+	static_assert((WindowSize & (WindowSize - 1)) == 0, "Transport window size must be a power of 2.");
+
+public:
+	struct TransportStatsType
+	{
+		uint32_t StartMillis = 0;
+		uint32_t BytesAcked = 0;
+		uint32_t BytesDelivered = 0;
+		uint32_t DataSent = 0;
+		uint32_t Retransmits = 0;
+		uint32_t SacksSent = 0;
+		uint32_t Duplicates = 0;
+	};
+
+private:
+	TransportDataPacketDefinition<BaseHeader> DataDefinition;
+	TransportSackPacketDefinition<BaseHeader> SackDefinition;
+
+	TemplateLoLaPacket<LOLA_PACKET_MIN_PACKET_SIZE + PACKET_DEFINITION_TRANSPORT_DATA_PAYLOAD_SIZE> PacketHolder;
+
+	struct TransmitSlotType
+	{
+		uint8_t Chunk[LOLA_TRANSPORT_CHUNK_SIZE];
+		uint8_t Control = 0;
+		uint8_t Transmissions = 0;
+		uint16_t SendStamp = 0; //Send order, to detect gaps.
+		uint32_t SentMillis = 0;
+		bool Acked = false;
+		bool Retransmit = false;
+	} TransmitWindow[WindowSize];
+
+	struct ReceiveSlotType
+	{
+		uint8_t Chunk[LOLA_TRANSPORT_CHUNK_SIZE];
+		uint8_t Control = 0;
+		bool Valid = false;
+	} ReceiveWindow[WindowSize];
+
+	//Sender.
+	uint8_t TransmitBase = 0; //Oldest not cumulatively acked.
+	uint8_t TransmitNext = 0; //Next to be queued.
+	uint16_t SendStampCounter = 0;
+
+	//Jacobson/Karels, fixed point.
+	uint32_t SmoothedRTT = 0; //x8
+	uint32_t RTTVariation = 0; //x4
+	uint32_t RetransmitTimeout = LOLA_TRANSPORT_RTO_INITIAL_MILLIS;
+	bool HasRTT = false;
+
+	//Receiver.
+	uint8_t ReceiveBase = 0; //Next expected.
+	bool SackPending = false;
+	bool SackUrgent = false;
+	uint8_t SackPendingCount = 0;
+	uint32_t SackPendingSince = 0;
+
+	TransportStatsType Stats;
+
+	union ArrayToUint32 {
+		byte array[4];
+		uint32_t uint;
+	} ATUI;
+
+	//Helpers.
+	TransmitSlotType* TransmitSlot = nullptr;
+	ReceiveSlotType* ReceiveSlot = nullptr;
+	uint8_t Sequence = 0;
+	uint8_t Offset = 0;
+	uint32_t NextTimeout = 0;
+	uint32_t Elapsed = 0;
+
+public:
+	LoLaReliableTransportService(Scheduler* scheduler, ILoLaDriver* driver)
+		: ILoLaService(scheduler, LOLA_TRANSPORT_CHECK_PERIOD_MILLIS, driver)
+	{
+		PacketHolder.ClearDefinition();
+	}
+
+	//Byte stream. Returns how many bytes were queued.
+	uint8_t Write(const uint8_t* data, const uint8_t length)
+	{
+		if (!IsReady())
+		{
+			return 0;
+		}
+
+		uint8_t written = 0;
+
+		//Top up the last chunk, if it hasn't gone out yet.
+		if (GetQueuedCount() > 0)
+		{
+			TransmitSlot = GetTransmitSlot(TransmitNext - 1);
+			if (TransmitSlot->Transmissions == 0 &&
+				!(TransmitSlot->Control & LOLA_TRANSPORT_CONTROL_END_OF_MESSAGE))
+			{
+				written = FillSlot(TransmitSlot, data, length);
+			}
+		}
+
+		while (written < length && GetQueuedCount() < WindowSize)
+		{
+			written += FillSlot(QueueSlot(), &data[written], length - written);
+		}
+
+		if (written > 0)
+		{
+			SetNextRunASAP();
+		}
+
+		return written;
+	}
+
+	//Whole message or nothing, delivered with an end of message mark.
+	//Don't mix with Write() on the same service, message starts aren't marked.
+	bool WriteMessage(const uint8_t* data, const uint16_t length)
+	{
+		if (!IsReady() || length == 0 || length > GetWriteSpace())
+		{
+			return false;
+		}
+
+		uint16_t written = 0;
+
+		while (written < length)
+		{
+			TransmitSlot = QueueSlot();
+			written += FillSlot(TransmitSlot, &data[written], (uint8_t)min((uint16_t)LOLA_TRANSPORT_CHUNK_SIZE, (uint16_t)(length - written)));
+		}
+
+		TransmitSlot->Control |= LOLA_TRANSPORT_CONTROL_END_OF_MESSAGE;
+
+		SetNextRunASAP();
+
+		return true;
+	}
+
+	uint16_t GetWriteSpace()
+	{
+		return (uint16_t)(WindowSize - GetQueuedCount()) * LOLA_TRANSPORT_CHUNK_SIZE;
+	}
+
+	//Everything written has been acked.
+	bool IsFlushed()
+	{
+		return GetQueuedCount() == 0;
+	}
+
+	TransportStatsType* GetStats()
+	{
+		return &Stats;
+	}
+
+	uint32_t GetGoodputBytesPerSecond()
+	{
+		Elapsed = millis() - Stats.StartMillis;
+
+		if (Elapsed == 0)
+		{
+			return 0;
+		}
+
+		return (uint32_t)(((uint64_t)Stats.BytesAcked * 1000) / Elapsed);
+	}
+
+	uint32_t GetRetransmitTimeoutMillis()
+	{
+		return RetransmitTimeout;
+	}
+
+#ifdef DEBUG_LOLA
+	void DebugStats(Stream* serial)
+	{
+		serial->print(F("Goodput: "));
+		serial->print(GetGoodputBytesPerSecond());
+		serial->println(F(" B/s"));
+		serial->print(F("Sent: "));
+		serial->print(Stats.DataSent);
+		serial->print(F(" Retransmits: "));
+		serial->print(Stats.Retransmits);
+		serial->print(F(" SACKs: "));
+		serial->print(Stats.SacksSent);
+		serial->print(F(" Duplicates: "));
+		serial->println(Stats.Duplicates);
+		serial->print(F("RTO: "));
+		serial->print(RetransmitTimeout);
+		serial->println(F(" ms"));
+	}
+#endif
+
+	void OnLinkEstablished()
+	{
+		ResetSession();
+		Enable();
+		SetNextRunASAP();
+	}
+
+	void OnLinkLost()
+	{
+		ResetSession();
+		Disable();
+	}
+
+	//Dropped by the driver, goes again without waiting for the retransmit time out.
+	bool ProcessSendFailed(const uint8_t header, const uint8_t id)
+	{
+		if (header == DataDefinition.GetHeader())
+		{
+			if ((uint8_t)(id - TransmitBase) < (uint8_t)(TransmitNext - TransmitBase) &&
+				!GetTransmitSlot(id)->Acked)
+			{
+				GetTransmitSlot(id)->Retransmit = true;
+				SetNextRunASAP();
+			}
+
+			return true;
+		}
+		else if (header == SackDefinition.GetHeader())
+		{
+			SackPending = true;
+			SetNextRunASAP();
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool ProcessPacket(ILoLaPacket* incomingPacket)
+	{
+		if (incomingPacket->GetDataHeader() == DataDefinition.GetHeader())
+		{
+			OnDataPacketReceived(incomingPacket->GetId(), incomingPacket->GetPayload());
+
+			return true;
+		}
+		else if (incomingPacket->GetDataHeader() == SackDefinition.GetHeader())
+		{
+			for (uint8_t i = 0; i < PACKET_DEFINITION_TRANSPORT_SACK_PAYLOAD_SIZE; i++)
+			{
+				ATUI.array[i] = incomingPacket->GetPayload()[i];
+			}
+
+			OnSackReceived(incomingPacket->GetId(), ATUI.uint);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Callback()
+	{
+		if (!LoLaDriver->HasLink())
+		{
+			SetNextRunLong();
+
+			return false;
+		}
+
+		//Also updates NextTimeout.
+		bool dataDue = GetNextToSend(Sequence);
+		bool sackDue = ShouldSendSack();
+
+		if (!dataDue && !sackDue)
+		{
+			SetNextRunDelay(NextTimeout);
+
+			return false;
+		}
+
+		//SACKs always go, only data can be held back.
+		if (!sackDue)
+		{
+			const uint32_t yieldMillis = GetDataYieldMillis();
+
+			if (yieldMillis > 0)
+			{
+				SetNextRunDelay(yieldMillis);
+
+				return false;
+			}
+		}
+
+		if (!AllowedSend())
+		{
+			SetNextRunOnSendSlot(NextTimeout);
+
+			return false;
+		}
+
+		//SACKs first, they unblock the partner's window.
+		if (sackDue ? SendSack() : SendData(Sequence))
+		{
+			SetNextRunASAP();
+		}
+		else
+		{
+			SetNextRunOnSendSlot(NextTimeout);
+		}
+
+		return true;
+	}
+
+protected:
+	//Chunks are delivered in order.
+	virtual void OnDataReceived(uint8_t* data, const uint8_t length, const bool endOfMessage) {}
+
+	//Background users hold back data for this long, to leave the slot to others.
+	virtual uint32_t GetDataYieldMillis() { return 0; }
+
+#ifdef DEBUG_LOLA
+	virtual void PrintName(Stream* serial)
+	{
+		serial->print(F("ReliableTransport"));
+	}
+#endif
+
+	bool OnAddPacketMap(LoLaPacketMap* packetMap)
+	{
+		if (!packetMap->AddMapping(&DataDefinition) ||
+			!packetMap->AddMapping(&SackDefinition))
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	inline bool IsReady()
+	{
+		return IsSetupOk() && LoLaDriver->HasLink();
+	}
+
+	inline uint8_t GetQueuedCount()
+	{
+		return (uint8_t)(TransmitNext - TransmitBase);
+	}
+
+	inline TransmitSlotType* GetTransmitSlot(const uint8_t sequence)
+	{
+		return &TransmitWindow[sequence % WindowSize];
+	}
+
+	inline ReceiveSlotType* GetReceiveSlot(const uint8_t sequence)
+	{
+		return &ReceiveWindow[sequence % WindowSize];
+	}
+
+	inline uint8_t GetChunkLength(const uint8_t control)
+	{
+		return min((uint8_t)(control & LOLA_TRANSPORT_CONTROL_LENGTH_MASK), LOLA_TRANSPORT_CHUNK_SIZE);
+	}
+
+	void ResetSession()
+	{
+		TransmitBase = 0;
+		TransmitNext = 0;
+		SendStampCounter = 0;
+		ReceiveBase = 0;
+
+		for (uint8_t i = 0; i < WindowSize; i++)
+		{
+			ReceiveWindow[i].Valid = false;
+		}
+
+		SmoothedRTT = 0;
+		RTTVariation = 0;
+		RetransmitTimeout = LOLA_TRANSPORT_RTO_INITIAL_MILLIS;
+		HasRTT = false;
+
+		SackPending = false;
+		SackUrgent = false;
+		SackPendingCount = 0;
+
+		Stats = TransportStatsType();
+		Stats.StartMillis = millis();
+	}
+
+	///Sender.
+	TransmitSlotType* QueueSlot()
+	{
+		TransmitSlot = GetTransmitSlot(TransmitNext);
+		TransmitSlot->Control = 0;
+		TransmitSlot->Transmissions = 0;
+		TransmitSlot->Acked = false;
+		TransmitSlot->Retransmit = false;
+		TransmitNext++;
+
+		return TransmitSlot;
+	}
+
+	uint8_t FillSlot(TransmitSlotType* slot, const uint8_t* data, const uint8_t length)
+	{
+		uint8_t size = min((uint8_t)(LOLA_TRANSPORT_CHUNK_SIZE - GetChunkLength(slot->Control)), length);
+
+		memcpy(&slot->Chunk[GetChunkLength(slot->Control)], data, size);
+		slot->Control += size;
+
+		return size;
+	}
+
+	//Oldest first, so gaps are filled before new data goes out.
+	bool GetNextToSend(uint8_t &sequence)
+	{
+		NextTimeout = LOLA_SERVICE_LONG_SLEEP_PERIOD_MILLIS;
+
+		for (uint8_t s = TransmitBase; s != TransmitNext; s++)
+		{
+			TransmitSlot = GetTransmitSlot(s);
+
+			if (TransmitSlot->Acked)
+			{
+				continue;
+			}
+
+			if (TransmitSlot->Transmissions == 0 || TransmitSlot->Retransmit)
+			{
+				sequence = s;
+				return true;
+			}
+
+			Elapsed = millis() - TransmitSlot->SentMillis;
+			if (Elapsed >= GetSlotTimeout(TransmitSlot))
+			{
+				sequence = s;
+				return true;
+			}
+
+			NextTimeout = min(NextTimeout, GetSlotTimeout(TransmitSlot) - Elapsed);
+		}
+
+		return false;
+	}
+
+	//Exponential back off on consecutive time outs.
+	inline uint32_t GetSlotTimeout(TransmitSlotType* slot)
+	{
+		return min(LOLA_TRANSPORT_RTO_MAX_MILLIS,
+			RetransmitTimeout << min((uint8_t)(slot->Transmissions - 1), LOLA_TRANSPORT_RTO_MAX_BACK_OFF_SHIFT));
+	}
+
+	bool SendData(const uint8_t sequence)
+	{
+		TransmitSlot = GetTransmitSlot(sequence);
+
+		PacketHolder.SetDefinition(&DataDefinition);
+		PacketHolder.SetId(sequence);
+		PacketHolder.GetPayload()[0] = TransmitSlot->Control;
+		memcpy(&PacketHolder.GetPayload()[1], TransmitSlot->Chunk, LOLA_TRANSPORT_CHUNK_SIZE);
+
+		if (SendPacket(&PacketHolder))
+		{
+			if (TransmitSlot->Transmissions > 0)
+			{
+				Stats.Retransmits++;
+			}
+
+			if (TransmitSlot->Transmissions < UINT8_MAX)
+			{
+				TransmitSlot->Transmissions++;
+			}
+
+			TransmitSlot->Retransmit = false;
+			TransmitSlot->SentMillis = millis();
+			TransmitSlot->SendStamp = SendStampCounter++;
+			Stats.DataSent++;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void OnSackReceived(const uint8_t nextExpected, const uint32_t bitmap)
+	{
+		if ((uint8_t)(nextExpected - TransmitBase) > GetQueuedCount())
+		{
+			//Stale or invalid.
+			return;
+		}
+
+		while (TransmitBase != nextExpected)
+		{
+			AckSlot(GetTransmitSlot(TransmitBase));
+			TransmitBase++;
+		}
+
+		bool hasHighest = false;
+		uint16_t highestStamp = 0;
+
+		for (uint8_t i = 0; i < WindowSize - 1; i++)
+		{
+			Sequence = nextExpected + 1 + i;
+
+			if (((bitmap >> i) & 1) &&
+				(uint8_t)(Sequence - TransmitBase) < GetQueuedCount())
+			{
+				TransmitSlot = GetTransmitSlot(Sequence);
+
+				if (TransmitSlot->Transmissions > 0)
+				{
+					AckSlot(TransmitSlot);
+
+					if (!hasHighest || (int16_t)(TransmitSlot->SendStamp - highestStamp) > 0)
+					{
+						hasHighest = true;
+						highestStamp = TransmitSlot->SendStamp;
+					}
+				}
+			}
+		}
+
+		//The radio doesn't reorder, anything sent before a packet that got through is lost.
+		//FEC repaired packets do arrive late, so recent gaps wait for their group's parity.
+		if (hasHighest)
+		{
+			for (uint8_t s = TransmitBase; s != TransmitNext; s++)
+			{
+				TransmitSlot = GetTransmitSlot(s);
+
+				if (!TransmitSlot->Acked &&
+					TransmitSlot->Transmissions > 0 &&
+					(int16_t)(highestStamp - TransmitSlot->SendStamp) >= LOLA_TRANSPORT_GAP_LOSS_DISTANCE)
+				{
+					TransmitSlot->Retransmit = true;
+				}
+			}
+		}
+
+		SetNextRunASAP();
+	}
+
+	void AckSlot(TransmitSlotType* slot)
+	{
+		if (!slot->Acked)
+		{
+			slot->Acked = true;
+			Stats.BytesAcked += GetChunkLength(slot->Control);
+
+			//Karn's rule, only unambiguous samples.
+			if (slot->Transmissions == 1)
+			{
+				AddRTTSample(millis() - slot->SentMillis);
+			}
+		}
+	}
+
+	void AddRTTSample(const uint32_t rttMillis)
+	{
+		if (!HasRTT)
+		{
+			HasRTT = true;
+			SmoothedRTT = rttMillis << 3;
+			RTTVariation = rttMillis << 1;
+		}
+		else
+		{
+			RTTVariation += (uint32_t)abs((int32_t)rttMillis - (int32_t)(SmoothedRTT >> 3)) - (RTTVariation >> 2);
+			SmoothedRTT += rttMillis - (SmoothedRTT >> 3);
+		}
+
+		RetransmitTimeout = constrain((SmoothedRTT >> 3) + RTTVariation, LOLA_TRANSPORT_RTO_MIN_MILLIS, LOLA_TRANSPORT_RTO_MAX_MILLIS);
+	}
+	///
+
+	///Receiver.
+	void OnDataPacketReceived(const uint8_t sequence, uint8_t* payload)
+	{
+		Offset = sequence - ReceiveBase;
+
+		if (Offset >= WindowSize)
+		{
+			//Already delivered, our SACK must have been lost.
+			Stats.Duplicates++;
+			SackUrgent = true;
+		}
+		else
+		{
+			ReceiveSlot = GetReceiveSlot(sequence);
+
+			if (ReceiveSlot->Valid)
+			{
+				Stats.Duplicates++;
+			}
+			else
+			{
+				ReceiveSlot->Valid = true;
+				ReceiveSlot->Control = payload[0];
+				memcpy(ReceiveSlot->Chunk, &payload[1], LOLA_TRANSPORT_CHUNK_SIZE);
+			}
+
+			if (Offset >= LOLA_TRANSPORT_GAP_LOSS_DISTANCE)
+			{
+				//Gap, let the sender know right away.
+				SackUrgent = true;
+			}
+
+			DeliverInOrder();
+		}
+
+		if (!SackPending)
+		{
+			SackPending = true;
+			SackPendingSince = millis();
+			SackPendingCount = 0;
+		}
+		SackPendingCount++;
+
+		SetNextRunASAP();
+	}
+
+	void DeliverInOrder()
+	{
+		ReceiveSlot = GetReceiveSlot(ReceiveBase);
+
+		while (ReceiveSlot->Valid)
+		{
+			ReceiveSlot->Valid = false;
+			ReceiveBase++;
+
+			Stats.BytesDelivered += GetChunkLength(ReceiveSlot->Control);
+			OnDataReceived(ReceiveSlot->Chunk, GetChunkLength(ReceiveSlot->Control),
+				ReceiveSlot->Control & LOLA_TRANSPORT_CONTROL_END_OF_MESSAGE);
+
+			ReceiveSlot = GetReceiveSlot(ReceiveBase);
+		}
+	}
+
+	bool ShouldSendSack()
+	{
+		if (!SackPending)
+		{
+			return false;
+		}
+
+		if (SackUrgent || SackPendingCount >= (WindowSize / 2))
+		{
+			return true;
+		}
+
+		Elapsed = millis() - SackPendingSince;
+		if (Elapsed >= LOLA_TRANSPORT_SACK_DELAY_MILLIS)
+		{
+			return true;
+		}
+
+		NextTimeout = min(NextTimeout, LOLA_TRANSPORT_SACK_DELAY_MILLIS - Elapsed);
+
+		return false;
+	}
+
+	bool SendSack()
+	{
+		ATUI.uint = 0;
+		for (uint8_t i = 0; i < WindowSize - 1; i++)
+		{
+			if (GetReceiveSlot(ReceiveBase + 1 + i)->Valid)
+			{
+				ATUI.uint |= (uint32_t)1 << i;
+			}
+		}
+
+		PacketHolder.SetDefinition(&SackDefinition);
+		PacketHolder.SetId(ReceiveBase);
+
+		for (uint8_t i = 0; i < PACKET_DEFINITION_TRANSPORT_SACK_PAYLOAD_SIZE; i++)
+		{
+			PacketHolder.GetPayload()[i] = ATUI.array[i];
+		}
+
+		if (SendPacket(&PacketHolder))
+		{
+			SackPending = false;
+			SackUrgent = false;
+			SackPendingCount = 0;
+			Stats.SacksSent++;
+
+			return true;
+		}
+
+		return false;
+	}
+	///
+};
+#endif
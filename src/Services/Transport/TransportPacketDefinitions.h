@@ -0,0 +1,57 @@
+// TransportPacketDefinitions.h
+
+#ifndef _TRANSPORTPACKETDEFINITIONS_h
+#define _TRANSPORTPACKETDEFINITIONS_h
+
+#include <Packet\PacketDefinition.h>
+#include <LoLaDefinitions.h>
+
+// Data: [Seq as Id|Control|Chunk]. Control: [EndOfMessage|0|0|Length(5)].
+// SACK: [Next expected Seq as Id|Bitmap(4)]. Bit i is set if Seq (Next + 1 + i) was received.
+#define PACKET_DEFINITION_TRANSPORT_DATA_HEADER_OFFSET		0
+#define PACKET_DEFINITION_TRANSPORT_DATA_PAYLOAD_SIZE		16
+#define PACKET_DEFINITION_TRANSPORT_SACK_HEADER_OFFSET		1
+#define PACKET_DEFINITION_TRANSPORT_SACK_PAYLOAD_SIZE		4
+
+#define TRANSPORT_SERVICE_PACKET_DEFINITION_COUNT			2
+
+#define LOLA_TRANSPORT_CHUNK_SIZE							(uint8_t)(PACKET_DEFINITION_TRANSPORT_DATA_PAYLOAD_SIZE - 1)
+#define LOLA_TRANSPORT_CONTROL_LENGTH_MASK					(uint8_t)(B00011111)
+#define LOLA_TRANSPORT_CONTROL_END_OF_MESSAGE				(uint8_t)(B10000000)
+
+template <const uint8_t BaseHeader>
+class TransportDataPacketDefinition : public PacketDefinition
+{
+public:
+#ifdef LOLA_TRANSPORT_USE_FEC
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_FEC; }
+#else
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+#endif
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_TRANSPORT_DATA_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_TRANSPORT_DATA_PAYLOAD_SIZE; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("TransportData"));
+	}
+#endif
+};
+
+template <const uint8_t BaseHeader>
+class TransportSackPacketDefinition : public PacketDefinition
+{
+public:
+	const uint8_t GetConfiguration() { return PACKET_DEFINITION_MASK_BASIC; }
+	const uint8_t GetHeader() { return BaseHeader + PACKET_DEFINITION_TRANSPORT_SACK_HEADER_OFFSET; }
+	const uint8_t GetPayloadSize() { return PACKET_DEFINITION_TRANSPORT_SACK_PAYLOAD_SIZE; }
+
+#ifdef DEBUG_LOLA
+	void PrintName(Stream* serial)
+	{
+		serial->print(F("TransportSack"));
+	}
+#endif
+};
+#endif